@@ -0,0 +1,112 @@
+#ifndef AABB_H
+#define AABB_H
+
+#include "vec3.h"
+#include "ray.h"
+#include <cfloat>
+
+// Define the axis-aligned bounding box structure
+struct AABB {
+    vec3 bmin = vec3(FLT_MAX, FLT_MAX, FLT_MAX);     // Minimum corner (empty box by default)
+    vec3 bmax = vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX);  // Maximum corner
+};
+
+// Grow the box so that it contains the point p
+inline void grow(AABB& box, const vec3& p) {
+    for (int a = 0; a < 3; a++) {
+        if (p[a] < box.bmin[a]) box.bmin[a] = p[a];
+        if (p[a] > box.bmax[a]) box.bmax[a] = p[a];
+    }
+}
+
+// Grow the box so that it contains the box b
+inline void grow(AABB& box, const AABB& b) {
+    for (int a = 0; a < 3; a++) {
+        if (b.bmin[a] < box.bmin[a]) box.bmin[a] = b.bmin[a];
+        if (b.bmax[a] > box.bmax[a]) box.bmax[a] = b.bmax[a];
+    }
+}
+
+// Overlap of two boxes, empty if they are disjoint
+inline AABB intersection(const AABB& a, const AABB& b) {
+    AABB box;
+    for (int i = 0; i < 3; i++) {
+        box.bmin[i] = a.bmin[i] > b.bmin[i] ? a.bmin[i] : b.bmin[i];
+        box.bmax[i] = a.bmax[i] < b.bmax[i] ? a.bmax[i] : b.bmax[i];
+        if (box.bmin[i] > box.bmax[i]) return AABB();
+    }
+    return box;
+}
+
+inline bool is_empty_box(const AABB& box) {
+    return box.bmin.x() > box.bmax.x();
+}
+
+inline vec3 centroid(const AABB& box) {
+    return 0.5f * (box.bmin + box.bmax);
+}
+
+// Surface area of the box, used by the SAH cost model
+inline float surface_area(const AABB& box) {
+    if (is_empty_box(box)) return 0.0f;
+    vec3 d = box.bmax - box.bmin;
+    return 2.0f * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+}
+
+// Ray data precomputed once per ray for repeated box tests during traversal
+struct RayBoxQuery {
+    vec3 origin;   // Ray origin
+    vec3 inv_dir;  // Reciprocal of the ray direction
+};
+
+inline RayBoxQuery make_box_query(const ray& r) {
+    RayBoxQuery q;
+    q.origin = r.origin();
+    q.inv_dir = vec3(1.0f / r.direction().x(), 1.0f / r.direction().y(), 1.0f / r.direction().z());
+    return q;
+}
+
+// Exit distances are scaled up by twice the bound on their 3 roundings (Pharr, Jakob and Humphreys), so a ray through
+// a triangle's edge or vertex, which may just touch the boxes around it, is never culled before the watertight
+// triangle test sees it
+const float BOX_EXIT_ROUNDING = 1.0f + 2.0f * 3.0f * (0.5f * FLT_EPSILON) / (1.0f - 3.0f * (0.5f * FLT_EPSILON));
+
+// Slab test of a ray against a box given by its corners.
+// Returns true if the ray overlaps the box within [0, t_max], writing the entry distance to t_near.
+inline bool hit_aabb(const float lo[3], const float hi[3], const RayBoxQuery& q, float t_max, float& t_near) {
+    float t0 = 0.0f;
+    float t1 = t_max;
+    for (int a = 0; a < 3; a++) {
+        float ta = (lo[a] - q.origin[a]) * q.inv_dir[a];
+        float tb = (hi[a] - q.origin[a]) * q.inv_dir[a];
+        if (ta > tb) { float tmp = ta; ta = tb; tb = tmp; }
+        tb *= BOX_EXIT_ROUNDING;
+        t0 = ta > t0 ? ta : t0;  // Written this way so NaN slabs (0 * inf) are ignored
+        t1 = tb < t1 ? tb : t1;
+    }
+    t_near = t0;
+    return t0 <= t1;
+}
+
+inline bool hit_aabb(const AABB& box, const RayBoxQuery& q, float t_max, float& t_near) {
+    return hit_aabb(box.bmin.e, box.bmax.e, q, t_max, t_near);
+}
+
+// Slab test that also returns where the ray leaves the box, for marching through its inside
+inline bool clip_aabb(const AABB& box, const RayBoxQuery& q, float t_max, float& t_near, float& t_far) {
+    float t0 = 0.0f;
+    float t1 = t_max;
+    for (int a = 0; a < 3; a++) {
+        float ta = (box.bmin[a] - q.origin[a]) * q.inv_dir[a];
+        float tb = (box.bmax[a] - q.origin[a]) * q.inv_dir[a];
+        if (ta > tb) { float tmp = ta; ta = tb; tb = tmp; }
+        tb *= BOX_EXIT_ROUNDING;
+        t0 = ta > t0 ? ta : t0;
+        t1 = tb < t1 ? tb : t1;
+    }
+    t_near = t0;
+    t_far = t1;
+    return t0 <= t1;
+}
+
+#endif // AABB_H
@@ -0,0 +1,255 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+#include "Triangle.h"
+#include "Profile.h"
+#include <vector>
+#include <cfloat>
+
+using namespace std;
+
+// Define the binary BVH node (32 bytes)
+struct BVHNode {
+    AABB bounds;     // Bounds of everything below this node
+    int left_first;  // Inner node: index of the left child (the right child follows it). Leaf: first entry in prim_indices
+    int count;       // Number of primitives in a leaf, 0 for inner nodes
+};
+
+// Define the bounding volume hierarchy over an external primitive array
+struct BVH {
+    vector<BVHNode> nodes;     // nodes[0] is the root
+    vector<int> prim_indices;  // Primitive references, leaves point into ranges of this array
+};
+
+// Options controlling the binned SAH builder
+struct BVHBuildOptions {
+    int max_leaf_size = 4;         // Leaves never hold more primitives than this unless the depth limit is reached
+    int sah_bins = 16;             // Number of bins per axis evaluated for each split
+    float traversal_cost = 1.0f;   // SAH cost of visiting a node relative to one primitive test
+};
+
+const int BVH_MAX_DEPTH = 64;  // Also the size of the traversal stack
+
+inline size_t bvh_memory_bytes(const BVH& bvh) {
+    return bvh.nodes.size() * sizeof(BVHNode) + bvh.prim_indices.size() * sizeof(int);
+}
+
+// Find the best SAH split of prim_indices[begin, end) by binning centroids.
+// Returns false if splitting is not cheaper than a leaf (or impossible), otherwise writes axis and split position.
+inline bool find_sah_split(const vector<int>& prims, int begin, int end, const vector<AABB>& prim_bounds,
+                           const vector<vec3>& centroids, const AABB& node_bounds, const BVHBuildOptions& opt,
+                           int& best_axis, float& best_pos) {
+    const int MAX_BINS = 64;
+    int bins = opt.sah_bins < 2 ? 2 : (opt.sah_bins > MAX_BINS ? MAX_BINS : opt.sah_bins);
+    int n = end - begin;
+
+    AABB cbounds;  // Bounds of the primitive centroids
+    for (int i = begin; i < end; i++) grow(cbounds, centroids[prims[i]]);
+
+    float best_cost = FLT_MAX;
+    best_axis = -1;
+    for (int axis = 0; axis < 3; axis++) {
+        float cmin = cbounds.bmin[axis];
+        float extent = cbounds.bmax[axis] - cmin;
+        if (extent <= 0.0f) continue;  // All centroids coincide on this axis
+
+        AABB bin_bounds[MAX_BINS];
+        int bin_count[MAX_BINS] = {0};
+        float scale = bins / extent;
+        for (int i = begin; i < end; i++) {
+            int p = prims[i];
+            int b = int((centroids[p][axis] - cmin) * scale);
+            if (b > bins - 1) b = bins - 1;
+            bin_count[b]++;
+            grow(bin_bounds[b], prim_bounds[p]);
+        }
+
+        // Sweep from the right to get the cost of every right partition
+        float right_area[MAX_BINS];
+        int right_count[MAX_BINS];
+        AABB acc;
+        int count = 0;
+        for (int b = bins - 1; b > 0; b--) {
+            grow(acc, bin_bounds[b]);
+            count += bin_count[b];
+            right_area[b] = surface_area(acc);
+            right_count[b] = count;
+        }
+
+        // Sweep from the left and evaluate the split after every bin
+        acc = AABB();
+        count = 0;
+        for (int b = 0; b < bins - 1; b++) {
+            grow(acc, bin_bounds[b]);
+            count += bin_count[b];
+            if (count == 0 || right_count[b + 1] == 0) continue;
+            float cost = surface_area(acc) * count + right_area[b + 1] * right_count[b + 1];
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_axis = axis;
+                best_pos = cmin + (b + 1) / scale;
+            }
+        }
+    }
+
+    if (best_axis < 0) return false;
+    float parent_area = surface_area(node_bounds);
+    float split_cost = opt.traversal_cost + (parent_area > 0.0f ? best_cost / parent_area : 0.0f);
+    return split_cost < float(n) || n > opt.max_leaf_size;
+}
+
+// Build a BVH over primitives given only by their bounding boxes (binned SAH, top-down)
+inline void build_bvh(BVH& bvh, const vector<AABB>& prim_bounds, const BVHBuildOptions& opt = BVHBuildOptions()) {
+    int n = int(prim_bounds.size());
+    bvh.nodes.clear();
+    bvh.prim_indices.resize(n);
+    for (int i = 0; i < n; i++) bvh.prim_indices[i] = i;
+
+    vector<vec3> centroids(n);
+    for (int i = 0; i < n; i++) centroids[i] = centroid(prim_bounds[i]);
+
+    bvh.nodes.reserve(n > 0 ? 2 * n - 1 : 1);
+    bvh.nodes.push_back(BVHNode());
+    bvh.nodes[0].left_first = 0;
+    bvh.nodes[0].count = n;
+
+    struct Task { int node, begin, end, depth; };
+    vector<Task> stack;
+    stack.push_back({0, 0, n, 1});
+    while (!stack.empty()) {
+        Task task = stack.back();
+        stack.pop_back();
+
+        AABB bounds;
+        for (int i = task.begin; i < task.end; i++) grow(bounds, prim_bounds[bvh.prim_indices[i]]);
+        bvh.nodes[task.node].bounds = bounds;
+
+        int count = task.end - task.begin;
+        int axis;
+        float pos;
+        bool split = count > 1 && task.depth < BVH_MAX_DEPTH &&
+                     find_sah_split(bvh.prim_indices, task.begin, task.end, prim_bounds, centroids, bounds, opt, axis, pos);
+
+        int mid = task.begin;
+        if (split) {
+            // Partition the references around the split plane
+            int* first = bvh.prim_indices.data() + task.begin;
+            int* last = bvh.prim_indices.data() + task.end;
+            while (first < last) {
+                if (centroids[*first][axis] < pos) first++;
+                else swap(*first, *--last);
+            }
+            mid = int(first - bvh.prim_indices.data());
+            if (mid == task.begin || mid == task.end) mid = task.begin + count / 2;  // Float edge case, fall back to median
+        } else if (count > opt.max_leaf_size && task.depth < BVH_MAX_DEPTH) {
+            mid = task.begin + count / 2;  // Coincident centroids, split the range in half
+        }
+
+        if (mid == task.begin) {
+            bvh.nodes[task.node].left_first = task.begin;
+            bvh.nodes[task.node].count = count;
+            continue;
+        }
+
+        int left = int(bvh.nodes.size());
+        bvh.nodes.push_back(BVHNode());
+        bvh.nodes.push_back(BVHNode());
+        bvh.nodes[task.node].left_first = left;
+        bvh.nodes[task.node].count = 0;
+        stack.push_back({left, task.begin, mid, task.depth + 1});
+        stack.push_back({left + 1, mid, task.end, task.depth + 1});
+    }
+}
+
+// Visit the primitives whose leaves the ray reaches, nearest node first, with node_box(index) giving the box of a
+// node. hit_prim(prim, t_max) must return true and shrink t_max when it finds a closer hit.
+// If steps is given the number of nodes visited is added to it.
+template <class NodeBox, class HitPrim>
+inline bool traverse_bvh_boxes(const BVH& bvh, const ray& r, float& t_max, NodeBox&& node_box, HitPrim&& hit_prim,
+                               int* steps = nullptr) {
+    if (bvh.prim_indices.empty()) return false;
+    RayBoxQuery q = make_box_query(r);
+    float t_near;
+    if (!hit_aabb(node_box(0), q, t_max, t_near)) return false;
+
+    bool hit = false;
+    int stack[BVH_MAX_DEPTH];       // Deferred far children
+    float stack_t[BVH_MAX_DEPTH];   // Their entry distances, to skip them once a closer hit is known
+    int sp = 0;
+    int node_index = 0;
+    int visited = 0, tested = 0;    // Profile counts, added once per traversal
+    while (true) {
+        const BVHNode& node = bvh.nodes[node_index];
+        if (steps) (*steps)++;
+        visited++;
+        if (node.count > 0) {
+            tested += node.count;
+            for (int i = 0; i < node.count; i++) {
+                if (hit_prim(bvh.prim_indices[node.left_first + i], t_max)) hit = true;
+            }
+        } else {
+            // Descend into the nearer child and push the farther one
+            int c0 = node.left_first;
+            int c1 = node.left_first + 1;
+            float t0, t1;
+            bool h0 = hit_aabb(node_box(c0), q, t_max, t0);
+            bool h1 = hit_aabb(node_box(c1), q, t_max, t1);
+            if (h0 && h1) {
+                if (t1 < t0) { swap(c0, c1); swap(t0, t1); }
+                stack[sp] = c1;
+                stack_t[sp++] = t1;
+                node_index = c0;
+                continue;
+            }
+            if (h0) { node_index = c0; continue; }
+            if (h1) { node_index = c1; continue; }
+        }
+        do {
+            if (sp == 0) {
+                PROFILE_COUNT(PROF_NODES, visited);
+                PROFILE_COUNT(PROF_PRIMITIVES, tested);
+                return hit;
+            }
+            node_index = stack[--sp];
+        } while (stack_t[sp] > t_max);
+    }
+}
+
+template <class HitPrim>
+inline bool traverse_bvh(const BVH& bvh, const ray& r, float& t_max, HitPrim&& hit_prim, int* steps = nullptr) {
+    return traverse_bvh_boxes(bvh, r, t_max, [&](int node) -> const AABB& { return bvh.nodes[node].bounds; }, hit_prim,
+                              steps);
+}
+
+// Build a BVH over a triangle array
+inline void build_triangle_bvh(BVH& bvh, const vector<Triangle>& triangles, const BVHBuildOptions& opt = BVHBuildOptions()) {
+    vector<AABB> bounds(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        grow(bounds[i], triangles[i].v0);
+        grow(bounds[i], triangles[i].v1);
+        grow(bounds[i], triangles[i].v2);
+    }
+    build_bvh(bvh, bounds, opt);
+}
+
+// Function to find the nearest intersection of a ray with a triangle array through its BVH
+inline bool hit_bvh(const BVH& bvh, const vector<Triangle>& triangles, const ray& r, float& t, vec3& N) {
+    float t_max = FLT_MAX;
+    bool hit = traverse_bvh(bvh, r, t_max, [&](int prim, float& t_closest) {
+        float t_tri;
+        vec3 N_tri;
+        if (hit_triangle(triangles[prim], r, t_tri, N_tri) && t_tri < t_closest) {
+            t_closest = t_tri;
+            N = N_tri;
+            return true;
+        }
+        return false;
+    });
+    if (hit) t = t_max;
+    return hit;
+}
+
+#endif // BVH_H
@@ -0,0 +1,321 @@
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "vec3.h"
+#include "ray.h"
+#include "Random.h"
+#include "Scene.h"
+#include "RayDifferential.h"
+
+using namespace std;
+
+enum Projection {
+    PROJ_PERSPECTIVE,   // Pinhole or thin lens
+    PROJ_ORTHOGRAPHIC,  // Parallel rays through the view rectangle
+    PROJ_EQUIRECT       // Full sphere of directions, longitude across and latitude up the image
+};
+
+// Camera rays of a batch as a structure of arrays. The caller fills the film coordinates s and t, both in [0, 1)
+// across the image and up the image, and Camera::generate turns them into rays and cones.
+struct CameraRays {
+    vector<float> s, t;        // Film coordinates
+    vector<float> ox, oy, oz;  // Origins
+    vector<float> dx, dy, dz;  // Directions, unnormalized for the perspective projection like the old viewport rays
+    vector<float> cw, cs;      // Ray cone width and spread
+    vector<float> time;        // Shutter time
+    int size = 0;
+
+    void resize(int n) {
+        for (auto* v : {&s, &t, &ox, &oy, &oz, &dx, &dy, &dz, &cw, &cs, &time}) {
+            if (int(v->size()) < n) v->resize(n);
+        }
+        size = n;
+    }
+    inline ray get(int i) const { return ray(vec3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i]), time[i]); }
+    // The cone starts the path's mesh level choice from the camera ray
+    inline RayCone cone(int i) const {
+        RayCone c;
+        c.width = cw[i];
+        c.spread = cs[i];
+        c.lod_u = lod_sample(get(i));
+        return c;
+    }
+};
+
+// Define the camera. For the perspective projection the image rectangle lower_left_corner + s * horizontal +
+// t * vertical is the plane in focus, for the orthographic projection it is the view rectangle the rays start
+// from. u, v and w are the camera's right, up and backward axes.
+struct Camera {
+    Projection projection = PROJ_PERSPECTIVE;
+    vec3 origin = vec3(0, 0, 0);
+    vec3 lower_left_corner = vec3(-2, -1, -1);
+    vec3 horizontal = vec3(4, 0, 0);
+    vec3 vertical = vec3(0, 2, 0);
+    vec3 u = vec3(1, 0, 0);
+    vec3 v = vec3(0, 1, 0);
+    vec3 w = vec3(0, 0, 1);
+    float lens_radius = 0.0f;  // Thin lens aperture radius, 0 for a pinhole
+    int width = 1;             // Image size in pixels, sets the ray cones
+    int height = 1;
+    // Part of the frame's time [0, 1] the shutter is open, which moving primitives span from 0 to 1. Ray times are
+    // spread uniformly over it; equal values render the instant shutter_open without motion blur.
+    float shutter_open = 0.0f;
+    float shutter_close = 0.0f;
+
+    // Function to generate the ray through film coordinates (s, t). lens1 and lens2 in [0, 1) pick the point on the
+    // lens and are ignored by pinhole cameras, time_sample in [0, 1) picks the time within the shutter interval.
+    inline ray get_ray(float s, float t, float lens1 = 0.0f, float lens2 = 0.0f, float time_sample = 0.0f) const {
+        float time = shutter_open + time_sample * (shutter_close - shutter_open);
+        if (projection == PROJ_ORTHOGRAPHIC) {
+            return ray(lower_left_corner + (s * horizontal) + (t * vertical), -w, time);
+        }
+        if (projection == PROJ_EQUIRECT) {
+            return ray(origin, equirect_direction(s, t), time);
+        }
+        if (lens_radius > 0.0f) {
+            vec3 offset = lens_offset(lens1, lens2);
+            return ray(origin + offset, lower_left_corner + (s * horizontal) + (t * vertical) - origin - offset, time);
+        }
+        return ray(origin, lower_left_corner + (s * horizontal) + (t * vertical) - origin, time);
+    }
+
+    // Function to compute the footprint of a camera ray, one pixel wide. Thin lens rays get the pinhole cone, the
+    // lens blur is not part of the footprint.
+    inline RayCone cone(const ray& r) const {
+        RayCone c;
+        if (projection == PROJ_ORTHOGRAPHIC) {
+            float cx = horizontal.length() / float(width), cy = vertical.length() / float(height);
+            c.width = cx > cy ? cx : cy;
+        } else if (projection == PROJ_EQUIRECT) {
+            // A pixel spans 2 pi / width of longitude, which shrinks with the cosine of the latitude
+            float sin_lat = dot(r.direction(), v);
+            float cos_lat = sqrtf(1.0f - sin_lat * sin_lat > 0.0f ? 1.0f - sin_lat * sin_lat : 0.0f);
+            float cx = 2.0f * float(M_PI) * cos_lat / float(width), cy = float(M_PI) / float(height);
+            c.spread = cx > cy ? cx : cy;
+        } else {
+            c = camera_cone(r.direction(), horizontal / float(width), vertical / float(height));
+        }
+        return c;
+    }
+
+    // Function to compute the ray differentials of a camera ray, per pixel step. Thin lens rays get the pinhole
+    // differentials like their cones.
+    inline RayDifferential differential(const ray& r) const {
+        RayDifferential d;
+        if (projection == PROJ_ORTHOGRAPHIC) {
+            d.dOdx = horizontal / float(width);
+            d.dOdy = vertical / float(height);
+        } else if (projection == PROJ_EQUIRECT) {
+            // D = cos(lat) (sin(lon) u - cos(lon) w) + sin(lat) v, lon spans 2 pi across and lat pi up the image
+            const vec3& D = r.direction();
+            float sin_lat = dot(D, v);
+            float cos_lat = sqrtf(1.0f - sin_lat * sin_lat > 1e-8f ? 1.0f - sin_lat * sin_lat : 1e-8f);
+            vec3 across = -dot(D, w) * u + dot(D, u) * w;  // dD / dlon
+            d.dDdx = (2.0f * float(M_PI) / float(width)) * across;
+            d.dDdy = (float(M_PI) / float(height)) * (cos_lat * v - (sin_lat / cos_lat) * (D - sin_lat * v));
+        } else {
+            d.dDdx = horizontal / float(width);
+            d.dDdy = vertical / float(height);
+        }
+        return d;
+    }
+
+    // Function to turn the film coordinates [begin, end) of a batch into rays and cones. rng is only used for lens
+    // and time samples, the times are drawn after the lens samples so images without motion blur are unchanged.
+    inline void generate(CameraRays& rays, int begin, int end, Rng& rng) const {
+        generate_projection(rays, begin, end, rng);
+        if (shutter_close > shutter_open) {
+            for (int i = begin; i < end; i++) rays.time[i] = shutter_open + rng.next() * (shutter_close - shutter_open);
+        } else {
+            fill(rays.time.begin() + begin, rays.time.begin() + end, shutter_open);
+        }
+    }
+
+    // Origins, directions and cones of the batch. Every projection has its own loop without branches.
+    inline void generate_projection(CameraRays& rays, int begin, int end, Rng& rng) const {
+        if (projection == PROJ_PERSPECTIVE) {
+            // camera_cone with the rejections from D expanded: |a - (a.n) n|^2 = |a|^2 - (a.D)^2 / |D|^2
+            vec3 dDdx = horizontal / float(width), dDdy = vertical / float(height);
+            // Plain floats and ivdep, otherwise the loop stays scalar
+            float lx = lower_left_corner.x(), ly = lower_left_corner.y(), lz = lower_left_corner.z();
+            float hx = horizontal.x(), hy = horizontal.y(), hz = horizontal.z();
+            float vx = vertical.x(), vy = vertical.y(), vz = vertical.z();
+            float ox = origin.x(), oy = origin.y(), oz = origin.z();
+            float ax = dDdx.x(), ay = dDdx.y(), az = dDdx.z(), bx = dDdy.x(), by = dDdy.y(), bz = dDdy.z();
+            float aa = dDdx.squared_length(), bb = dDdy.squared_length();
+            const float* s = rays.s.data();
+            const float* t = rays.t.data();
+            float* dx = rays.dx.data();
+            float* dy = rays.dy.data();
+            float* dz = rays.dz.data();
+            float* cs = rays.cs.data();
+#pragma GCC ivdep
+            for (int i = begin; i < end; i++) {
+                // Same operation order as lower_left_corner + s * horizontal + t * vertical - origin
+                float x = lx + s[i] * hx + t[i] * vx - ox;
+                float y = ly + s[i] * hy + t[i] * vy - oy;
+                float z = lz + s[i] * hz + t[i] * vz - oz;
+                float dd = x * x + y * y + z * z;
+                float a = ax * x + ay * y + az * z;
+                float b = bx * x + by * y + bz * z;
+                dx[i] = x;
+                dy[i] = y;
+                dz[i] = z;
+                cs[i] = max(max(aa - a * a / dd, bb - b * b / dd), 0.0f) / dd;
+            }
+            // sqrtf sets errno and keeps the loop above scalar, take the roots in a separate pass
+            int i = begin;
+#if defined(__SSE2__)
+            for (; i + 4 <= end; i += 4) _mm_storeu_ps(cs + i, _mm_sqrt_ps(_mm_loadu_ps(cs + i)));
+#endif
+            for (; i < end; i++) cs[i] = sqrtf(cs[i]);
+            fill(rays.ox.begin() + begin, rays.ox.begin() + end, origin.x());
+            fill(rays.oy.begin() + begin, rays.oy.begin() + end, origin.y());
+            fill(rays.oz.begin() + begin, rays.oz.begin() + end, origin.z());
+            fill(rays.cw.begin() + begin, rays.cw.begin() + end, 0.0f);
+            if (lens_radius <= 0.0f) return;
+            // Thin lens: move the pinhole rays' origins onto the lens, still aimed at the same point in focus
+            for (int i = begin; i < end; i++) {
+                float lens1 = rng.next();
+                vec3 offset = lens_offset(lens1, rng.next());
+                rays.ox[i] += offset.x(); rays.oy[i] += offset.y(); rays.oz[i] += offset.z();
+                rays.dx[i] -= offset.x(); rays.dy[i] -= offset.y(); rays.dz[i] -= offset.z();
+            }
+            return;
+        }
+        if (projection == PROJ_ORTHOGRAPHIC) {
+            RayCone c = cone(ray());
+            for (int i = begin; i < end; i++) {
+                float s = rays.s[i], t = rays.t[i];
+                rays.ox[i] = lower_left_corner.x() + s * horizontal.x() + t * vertical.x();
+                rays.oy[i] = lower_left_corner.y() + s * horizontal.y() + t * vertical.y();
+                rays.oz[i] = lower_left_corner.z() + s * horizontal.z() + t * vertical.z();
+                rays.dx[i] = -w.x();
+                rays.dy[i] = -w.y();
+                rays.dz[i] = -w.z();
+                rays.cw[i] = c.width;
+                rays.cs[i] = c.spread;
+            }
+            return;
+        }
+        for (int i = begin; i < end; i++) {
+            ray r(origin, equirect_direction(rays.s[i], rays.t[i]));
+            RayCone c = cone(r);
+            rays.ox[i] = r.O.x(); rays.oy[i] = r.O.y(); rays.oz[i] = r.O.z();
+            rays.dx[i] = r.D.x(); rays.dy[i] = r.D.y(); rays.dz[i] = r.D.z();
+            rays.cw[i] = c.width;
+            rays.cs[i] = c.spread;
+        }
+    }
+
+    // Unit direction for film coordinates (s, t): s = 0.5 looks down -w, t = 0 straight down and t = 1 straight up
+    inline vec3 equirect_direction(float s, float t) const {
+        float phi = (s - 0.5f) * 2.0f * float(M_PI);
+        float theta = (t - 0.5f) * float(M_PI);
+        float c = cosf(theta);
+        return c * sinf(phi) * u - c * cosf(phi) * w + sinf(theta) * v;
+    }
+
+    // Point on the lens disk for two uniform numbers (concentric mapping, Shirley and Chiu 1997)
+    inline vec3 lens_offset(float lens1, float lens2) const {
+        float a = 2.0f * lens1 - 1.0f, b = 2.0f * lens2 - 1.0f;
+        if (a == 0.0f && b == 0.0f) return vec3(0, 0, 0);
+        float r, phi;
+        if (fabsf(a) > fabsf(b)) {
+            r = a;
+            phi = float(M_PI) / 4.0f * (b / a);
+        } else {
+            r = b;
+            phi = float(M_PI) / 2.0f - float(M_PI) / 4.0f * (a / b);
+        }
+        return lens_radius * r * (cosf(phi) * u + sinf(phi) * v);
+    }
+};
+
+// Function to wrap the loose viewport vectors of the hw1 programs in a camera, rays are bit for bit the same
+inline Camera viewport_camera(const vec3& lower_left_corner, const vec3& horizontal, const vec3& vertical,
+                              const vec3& origin, int width, int height) {
+    Camera cam;
+    cam.origin = origin;
+    cam.lower_left_corner = lower_left_corner;
+    cam.horizontal = horizontal;
+    cam.vertical = vertical;
+    cam.u = unit_vector(horizontal);
+    cam.v = unit_vector(vertical);
+    cam.w = cross(cam.u, cam.v);
+    cam.width = width;
+    cam.height = height;
+    return cam;
+}
+
+// Function to set up the camera basis at from looking at at, up only needs to be roughly up
+inline void look_at_basis(Camera& cam, const vec3& from, const vec3& at, const vec3& up) {
+    cam.origin = from;
+    cam.w = unit_vector(from - at);
+    cam.u = unit_vector(cross(up, cam.w));
+    cam.v = cross(cam.w, cam.u);
+}
+
+// Function to build a perspective camera. vfov is the vertical field of view in degrees. A thin lens of diameter
+// aperture blurs everything off the plane focus_distance away, aperture 0 gives a pinhole.
+inline Camera look_at_camera(const vec3& from, const vec3& at, const vec3& up, float vfov, int width, int height,
+                             float aperture = 0.0f, float focus_distance = 1.0f) {
+    Camera cam;
+    look_at_basis(cam, from, at, up);
+    float aspect = float(width) / float(height);
+    float half_height = tanf(vfov * float(M_PI) / 360.0f);
+    float half_width = aspect * half_height;
+    cam.lower_left_corner = from - focus_distance * (half_width * cam.u + half_height * cam.v + cam.w);
+    cam.horizontal = 2.0f * half_width * focus_distance * cam.u;
+    cam.vertical = 2.0f * half_height * focus_distance * cam.v;
+    cam.lens_radius = aperture / 2.0f;
+    cam.width = width;
+    cam.height = height;
+    return cam;
+}
+
+// Function to build an orthographic camera whose view rectangle is view_height tall, centered on from
+inline Camera orthographic_camera(const vec3& from, const vec3& at, const vec3& up, float view_height, int width,
+                                  int height) {
+    Camera cam;
+    look_at_basis(cam, from, at, up);
+    cam.projection = PROJ_ORTHOGRAPHIC;
+    float view_width = view_height * float(width) / float(height);
+    cam.horizontal = view_width * cam.u;
+    cam.vertical = view_height * cam.v;
+    cam.lower_left_corner = from - 0.5f * cam.horizontal - 0.5f * cam.vertical;
+    cam.width = width;
+    cam.height = height;
+    return cam;
+}
+
+// Function to build an equirectangular panorama camera at from, the image center looks at at
+inline Camera equirect_camera(const vec3& from, const vec3& at, const vec3& up, int width, int height) {
+    Camera cam;
+    look_at_basis(cam, from, at, up);
+    cam.projection = PROJ_EQUIRECT;
+    cam.width = width;
+    cam.height = height;
+    return cam;
+}
+
+// Footprint of camera ray i of a batch for each footprint type, used by render_pixels
+inline void camera_footprint(const Camera&, const CameraRays&, int, NoFootprint&) {}
+
+inline void camera_footprint(const Camera&, const CameraRays& rays, int i, RayCone& cone) {
+    cone = rays.cone(i);
+}
+
+inline void camera_footprint(const Camera& camera, const CameraRays& rays, int i, RayDifferential& diff) {
+    ray r = rays.get(i);
+    diff = camera.differential(r);
+    diff.lod_u = lod_sample(r);
+}
+
+#endif // CAMERA_H
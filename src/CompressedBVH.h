@@ -0,0 +1,257 @@
+#ifndef COMPRESSED_BVH_H
+#define COMPRESSED_BVH_H
+
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+#include "BVH.h"
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+// Define the compressed 8-wide BVH node (80 bytes).
+// Child boxes are stored as 8-bit offsets on a per-axis power-of-two grid anchored at the node origin,
+// following Ylitie et al., "Efficient Incoherent Ray Traversal on GPUs Through Compressed Wide BVHs" (2017).
+struct CompressedBVHNode {
+    float origin[3];     // Minimum corner of the node box, the quantization grid starts here
+    int8_t exponent[3];  // Grid spacing per axis is 2^exponent
+    uint8_t inner_mask;  // Bit i is set if child slot i is an inner node
+    uint32_t child_base; // Index of the first inner child in nodes, the others follow in slot order
+    uint32_t prim_base;  // Index of the first primitive reference, leaf slots follow in slot order
+    uint8_t meta[8];     // Inner slot: offset from child_base. Leaf slot: primitive count (0 marks an empty slot)
+    uint8_t qlo[3][8];   // Quantized child box minimum per axis and slot
+    uint8_t qhi[3][8];   // Quantized child box maximum per axis and slot
+};
+
+static_assert(sizeof(CompressedBVHNode) == 80, "CompressedBVHNode should stay at 80 bytes");
+
+// Define the compressed BVH over an external primitive array
+struct CompressedBVH {
+    vector<CompressedBVHNode> nodes;  // nodes[0] is the root
+    vector<int> prim_refs;            // Primitive references, grouped per node in leaf slot order
+};
+
+const int COMPRESSED_BVH_MAX_LEAF = 255;  // Largest primitive count a leaf slot's meta byte holds
+const int COMPRESSED_BVH_STACK_SIZE = 8 * BVH_MAX_DEPTH;
+
+inline size_t compressed_bvh_memory_bytes(const CompressedBVH& cbvh) {
+    return cbvh.nodes.size() * sizeof(CompressedBVHNode) + cbvh.prim_refs.size() * sizeof(int);
+}
+
+// Build a float equal to 2^e directly from its exponent bits
+inline float exp2_int(int e) {
+    uint32_t bits = uint32_t(e + 127) << 23;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Quantize the child boxes of one node. Rounding is conservative so decoded boxes always contain the originals.
+inline void quantize_children(CompressedBVHNode& node, const AABB& parent, const AABB* children, int count) {
+    for (int a = 0; a < 3; a++) {
+        float lo = parent.bmin[a];
+        float extent = parent.bmax[a] - lo;
+        int e = extent > 0.0f ? int(ceil(log2(extent / 255.0f))) : -126;
+        if (e < -126) e = -126;
+        while (e < 127 && lo + 255.0f * exp2_int(e) < parent.bmax[a]) e++;  // Make sure the grid covers the box
+        float scale = exp2_int(e);
+        node.origin[a] = lo;
+        node.exponent[a] = int8_t(e);
+
+        for (int i = 0; i < 8; i++) {
+            if (i >= count) {
+                node.qlo[a][i] = 0;
+                node.qhi[a][i] = 0;
+                continue;
+            }
+            int ql = int(floor((children[i].bmin[a] - lo) / scale));
+            int qh = int(ceil((children[i].bmax[a] - lo) / scale));
+            ql = ql < 0 ? 0 : (ql > 255 ? 255 : ql);
+            qh = qh < 0 ? 0 : (qh > 255 ? 255 : qh);
+            while (ql > 0 && lo + ql * scale > children[i].bmin[a]) ql--;
+            while (qh < 255 && lo + qh * scale < children[i].bmax[a]) qh++;
+            node.qlo[a][i] = uint8_t(ql);
+            node.qhi[a][i] = uint8_t(qh);
+        }
+    }
+}
+
+// Collapse a binary BVH into the compressed 8-wide format. A binary leaf of more than COMPRESSED_BVH_MAX_LEAF
+// primitives (the builder makes them only at BVH_MAX_DEPTH or with a large max_leaf_size) becomes an inner slot
+// whose node splits the leaf's primitives over its slots, every piece with the leaf's box.
+inline void compress_bvh(const BVH& bvh, CompressedBVH& cbvh) {
+    cbvh.nodes.clear();
+    cbvh.prim_refs.clear();
+    if (bvh.prim_indices.empty()) return;
+    cbvh.nodes.reserve(bvh.nodes.size() / 4 + 1);
+    cbvh.prim_refs.reserve(bvh.prim_indices.size());
+
+    // A slot or task is a binary node (count == 0) or the primitives [begin, begin + count) of binary leaf
+    struct Slot { int binary, begin, count; };
+    struct Task { Slot source; int compressed; };
+    vector<Task> queue;
+    cbvh.nodes.push_back(CompressedBVHNode());
+    queue.push_back({{0, 0, 0}, 0});
+
+    for (size_t q = 0; q < queue.size(); q++) {
+        Task task = queue[q];
+        const BVHNode& root = bvh.nodes[task.source.binary];
+
+        Slot slots[8];
+        int count = 0;
+        if (task.source.count > 0) {
+            // Split an oversized leaf into pieces of equal size, pieces still too large get another node
+            int pieces = (task.source.count + COMPRESSED_BVH_MAX_LEAF - 1) / COMPRESSED_BVH_MAX_LEAF;
+            if (pieces > 8) pieces = 8;
+            for (int i = 0; i < pieces; i++) {
+                int b = int(int64_t(task.source.count) * i / pieces);
+                int e = int(int64_t(task.source.count) * (i + 1) / pieces);
+                slots[count++] = {task.source.binary, task.source.begin + b, e - b};
+            }
+        } else if (root.count > 0) {
+            slots[count++] = {task.source.binary, root.left_first, root.count};
+        } else {
+            // Open the largest inner children until the node has 8 slots or only leaves remain
+            slots[count++] = {root.left_first, 0, 0};
+            slots[count++] = {root.left_first + 1, 0, 0};
+            for (int i = 0; i < 2; i++) {
+                const BVHNode& child = bvh.nodes[slots[i].binary];
+                if (child.count > 0) slots[i] = {slots[i].binary, child.left_first, child.count};
+            }
+            while (count < 8) {
+                int best = -1;
+                float best_area = -1.0f;
+                for (int i = 0; i < count; i++) {
+                    const BVHNode& child = bvh.nodes[slots[i].binary];
+                    if (slots[i].count == 0 && surface_area(child.bounds) > best_area) {
+                        best_area = surface_area(child.bounds);
+                        best = i;
+                    }
+                }
+                if (best < 0) break;
+                int opened = bvh.nodes[slots[best].binary].left_first;
+                for (int c = 0; c < 2; c++) {
+                    const BVHNode& child = bvh.nodes[opened + c];
+                    Slot slot = {opened + c, child.count > 0 ? child.left_first : 0, child.count};
+                    if (c == 0) slots[best] = slot;
+                    else slots[count++] = slot;
+                }
+            }
+        }
+
+        AABB child_bounds[8];
+        for (int i = 0; i < count; i++) child_bounds[i] = bvh.nodes[slots[i].binary].bounds;
+
+        CompressedBVHNode node;
+        memset(&node, 0, sizeof(node));
+        quantize_children(node, root.bounds, child_bounds, count);
+        node.child_base = uint32_t(cbvh.nodes.size());
+        node.prim_base = uint32_t(cbvh.prim_refs.size());
+
+        int inner = 0;
+        for (int i = 0; i < count; i++) {
+            const Slot& slot = slots[i];
+            if (slot.count == 0 || slot.count > COMPRESSED_BVH_MAX_LEAF) {
+                node.inner_mask |= uint8_t(1 << i);
+                node.meta[i] = uint8_t(inner);
+                queue.push_back({slot, int(node.child_base) + inner});
+                inner++;
+            } else {
+                node.meta[i] = uint8_t(slot.count);
+                for (int p = 0; p < slot.count; p++) cbvh.prim_refs.push_back(bvh.prim_indices[slot.begin + p]);
+            }
+        }
+        cbvh.nodes.resize(cbvh.nodes.size() + inner);
+        cbvh.nodes[task.compressed] = node;
+    }
+}
+
+// Decode the child boxes of a compressed node and visit the primitives the ray reaches, nearest first.
+// hit_prim has the same contract as in traverse_bvh.
+template <class HitPrim>
+inline bool traverse_compressed_bvh(const CompressedBVH& cbvh, const ray& r, float& t_max, HitPrim&& hit_prim) {
+    if (cbvh.nodes.empty()) return false;
+    RayBoxQuery q = make_box_query(r);
+
+    // A stack entry is either a node (count == 0) or a leaf range of prim_refs
+    struct Entry { uint32_t index; uint32_t count; float t; };
+    Entry stack[COMPRESSED_BVH_STACK_SIZE];
+    int sp = 0;
+    stack[sp++] = {0, 0, 0.0f};
+
+    bool hit = false;
+    while (sp > 0) {
+        Entry entry = stack[--sp];
+        if (entry.t > t_max) continue;
+
+        if (entry.count > 0) {
+            for (uint32_t i = 0; i < entry.count; i++) {
+                if (hit_prim(cbvh.prim_refs[entry.index + i], t_max)) hit = true;
+            }
+            continue;
+        }
+
+        // Fold the grid origin and spacing into the ray so each slab distance is one multiply-add
+        const CompressedBVHNode& node = cbvh.nodes[entry.index];
+        float slope[3], offset[3];
+        for (int a = 0; a < 3; a++) {
+            slope[a] = exp2_int(node.exponent[a]) * q.inv_dir[a];
+            offset[a] = (node.origin[a] - q.origin[a]) * q.inv_dir[a];
+        }
+
+        Entry hits[8];
+        int hit_count = 0;
+        uint32_t prim_offset = node.prim_base;
+        for (int i = 0; i < 8; i++) {
+            bool inner = (node.inner_mask >> i) & 1;
+            if (!inner && node.meta[i] == 0) continue;  // Empty slot
+
+            float t0 = 0.0f;
+            float t1 = t_max;
+            for (int a = 0; a < 3; a++) {
+                float ta = node.qlo[a][i] * slope[a] + offset[a];
+                float tb = node.qhi[a][i] * slope[a] + offset[a];
+                if (ta > tb) { float tmp = ta; ta = tb; tb = tmp; }
+                t0 = ta > t0 ? ta : t0;
+                t1 = tb < t1 ? tb : t1;
+            }
+            if (t0 <= t1) {
+                if (inner) hits[hit_count++] = {node.child_base + node.meta[i], 0, t0};
+                else hits[hit_count++] = {prim_offset, node.meta[i], t0};
+            }
+            if (!inner) prim_offset += node.meta[i];
+        }
+
+        // Sort by decreasing distance so the nearest child ends up on top of the stack
+        for (int i = 1; i < hit_count; i++) {
+            Entry e = hits[i];
+            int j = i - 1;
+            while (j >= 0 && hits[j].t < e.t) { hits[j + 1] = hits[j]; j--; }
+            hits[j + 1] = e;
+        }
+        for (int i = 0; i < hit_count; i++) stack[sp++] = hits[i];
+    }
+    return hit;
+}
+
+// Function to find the nearest intersection of a ray with a triangle array through its compressed BVH
+inline bool hit_compressed_bvh(const CompressedBVH& cbvh, const vector<Triangle>& triangles, const ray& r, float& t, vec3& N) {
+    float t_max = FLT_MAX;
+    bool hit = traverse_compressed_bvh(cbvh, r, t_max, [&](int prim, float& t_closest) {
+        float t_tri;
+        vec3 N_tri;
+        if (hit_triangle(triangles[prim], r, t_tri, N_tri) && t_tri < t_closest) {
+            t_closest = t_tri;
+            N = N_tri;
+            return true;
+        }
+        return false;
+    });
+    if (hit) t = t_max;
+    return hit;
+}
+
+#endif // COMPRESSED_BVH_H
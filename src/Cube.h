@@ -13,9 +13,10 @@ struct Cube {
     float side_length;  // Side length of the cube
 };
 
-// Function to check if a ray intersects with a cube
-bool hit_cube(const Cube& cube, const ray& r, float& t, vec3& N) {
-    const float EPSILON = 0.0000001;  // Small value for floating-point comparisons
+// Function to check if a ray intersects with a cube. The normal comes from the slab that bounds the hit rather than
+// from comparing the hit point with the faces.
+inline bool hit_cube(const Cube& cube, const ray& r, float& t, vec3& N) {
+    int axis_min = 0, axis_max = 0;  // Axes of the slabs the ray enters and leaves the cube through
     // Compute the intersection distances along the x-axis
     float t_min = (cube.center.x() - cube.side_length / 2 - r.origin().x()) / r.direction().x();
     float t_max = (cube.center.x() + cube.side_length / 2 - r.origin().x()) / r.direction().x();
@@ -33,11 +34,15 @@ bool hit_cube(const Cube& cube, const ray& r, float& t, vec3& N) {
         return false;
 
     // Update t_min and t_max
-    if (ty_min > t_min)
+    if (ty_min > t_min) {
         t_min = ty_min;
+        axis_min = 1;
+    }
 
-    if (ty_max < t_max)
+    if (ty_max < t_max) {
         t_max = ty_max;
+        axis_max = 1;
+    }
 
     // Compute the intersection distances along the z-axis
     float tz_min = (cube.center.z() - cube.side_length / 2 - r.origin().z()) / r.direction().z();
@@ -50,30 +55,32 @@ bool hit_cube(const Cube& cube, const ray& r, float& t, vec3& N) {
         return false;
 
     // Update t_min and t_max
-    if (tz_min > t_min)
+    if (tz_min > t_min) {
         t_min = tz_min;
+        axis_min = 2;
+    }
 
-    if (tz_max < t_max)
+    if (tz_max < t_max) {
         t_max = tz_max;
+        axis_max = 2;
+    }
 
+    // The entry face, or the exit face for rays starting inside. Rays start off the surface (see offset_ray_origin),
+    // so no epsilon is needed.
     t = t_min;
-    if (t < EPSILON) {
+    int axis = axis_min;
+    float side = -1.0f;  // The entry face faces against the ray
+    if (t <= 0) {
         t = t_max;
-        if (t < EPSILON)
+        axis = axis_max;
+        side = 1.0f;
+        if (t <= 0)
             return false;
     }
 
-    vec3 hit_point = r.point_at_parameter(t);  // Compute the hit point
-    vec3 cube_min = cube.center - vec3(cube.side_length / 2, cube.side_length / 2, cube.side_length / 2);
-    vec3 cube_max = cube.center + vec3(cube.side_length / 2, cube.side_length / 2, cube.side_length / 2);
-
     // Determine the normal at the hit point
-    if (abs(hit_point.x() - cube_min.x()) < EPSILON) N = vec3(-1, 0, 0);
-    else if (abs(hit_point.x() - cube_max.x()) < EPSILON) N = vec3(1, 0, 0);
-    else if (abs(hit_point.y() - cube_min.y()) < EPSILON) N = vec3(0, -1, 0);
-    else if (abs(hit_point.y() - cube_max.y()) < EPSILON) N = vec3(0, 1, 0);
-    else if (abs(hit_point.z() - cube_min.z()) < EPSILON) N = vec3(0, 0, -1);
-    else if (abs(hit_point.z() - cube_max.z()) < EPSILON) N = vec3(0, 0, 1);
+    N = vec3(0, 0, 0);
+    N[axis] = r.direction()[axis] > 0 ? side : -side;
 
     return true;
 }
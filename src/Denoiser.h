@@ -0,0 +1,290 @@
+#ifndef DENOISER_H
+#define DENOISER_H
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "vec3.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Edge-aware a-trous wavelet filter after SVGF (Schied et al. 2017), without the temporal part.
+// The noisy color is divided by the albedo, the remaining illumination is blurred with a 5x5 B3-spline kernel whose
+// taps are spread 1, 2, 4, ... pixels apart, and every tap is weighted by how similar its normal, depth and
+// luminance are to the center pixel.
+
+struct DenoiseSettings {
+    int iterations = 5;            // Filter passes, pass i spaces the taps 2^i pixels apart
+    float sigma_luminance = 4.0f;  // Luminance edge stopping, in standard deviations of the local noise
+    float sigma_depth = 1.0f;      // Depth edge stopping, relative to the local depth gradient
+    int normal_power = 7;          // Normal weight is max(0, dot(n_p, n_q))^(2^normal_power)
+    bool simd = true;              // Use the SSE2 kernel where available, the scalar one otherwise
+};
+
+// Scratch planes of the filter, kept between frames so denoising does not allocate
+struct DenoiseBuffers {
+    int width = 0;
+    int height = 0;
+    vector<float> color[2][3];  // Illumination (color / albedo), ping-ponged between passes
+    vector<float> variance[2];  // Luminance variance of the illumination, filtered alongside it
+    vector<float> depth;
+    vector<float> depth_gradient;
+    vector<float> normal[3];
+
+    void resize(int w, int h) {
+        if (w == width && h == height) return;
+        width = w;
+        height = h;
+        size_t n = size_t(w) * h;
+        for (int b = 0; b < 2; b++) {
+            for (int c = 0; c < 3; c++) color[b][c].assign(n, 0.0f);
+            variance[b].assign(n, 0.0f);
+        }
+        depth.assign(n, 0.0f);
+        depth_gradient.assign(n, 0.0f);
+        for (int c = 0; c < 3; c++) normal[c].assign(n, 0.0f);
+    }
+};
+
+const float ATROUS_KERNEL[5] = {1.0f / 16, 1.0f / 4, 3.0f / 8, 1.0f / 4, 1.0f / 16};
+const float DENOISE_ALBEDO_EPSILON = 1e-3f;  // Keeps the demodulation finite on black surfaces
+const int DENOISE_ROW_GRAIN = 4;
+
+inline float luminance(float r, float g, float b) {
+    return 0.2126f * r + 0.7152f * g + 0.0722f * b;
+}
+
+// Smallest one-sided depth difference to a neighbour along x and y, so depth edges do not widen the gradient
+inline float local_depth_gradient(const DenoiseBuffers& buf, int x, int y) {
+    const float* z = buf.depth.data();
+    size_t p = size_t(y) * buf.width + x;
+    if (z[p] == FLT_MAX) return 0.0f;
+    float gx = FLT_MAX, gy = FLT_MAX;
+    if (x > 0 && z[p - 1] != FLT_MAX) gx = fminf(gx, fabsf(z[p] - z[p - 1]));
+    if (x + 1 < buf.width && z[p + 1] != FLT_MAX) gx = fminf(gx, fabsf(z[p + 1] - z[p]));
+    if (y > 0 && z[p - buf.width] != FLT_MAX) gy = fminf(gy, fabsf(z[p] - z[p - buf.width]));
+    if (y + 1 < buf.height && z[p + buf.width] != FLT_MAX) gy = fminf(gy, fabsf(z[p + buf.width] - z[p]));
+    if (gx == FLT_MAX) gx = 0.0f;
+    if (gy == FLT_MAX) gy = 0.0f;
+    return gx > gy ? gx : gy;
+}
+
+// Split the framebuffer into illumination planes and copy the guides, then estimate the noise variance of every
+// pixel from its 3x3 neighbourhood (SVGF's fallback when no temporal history exists)
+inline void denoise_prepare(const Framebuffer& fb, const FeatureBuffers& features, DenoiseBuffers& buf) {
+    buf.resize(fb.width, fb.height);
+    int w = fb.width;
+    parallel_for(fb.height, DENOISE_ROW_GRAIN, [&](int begin, int end) {
+        for (size_t p = size_t(begin) * w; p < size_t(end) * w; p++) {
+            const vec3& a = features.albedo[p];
+            for (int c = 0; c < 3; c++) {
+                buf.color[0][c][p] = fb.pixels[p][c] / fmaxf(a[c], DENOISE_ALBEDO_EPSILON);
+                buf.normal[c][p] = features.normal[p][c];
+            }
+            buf.depth[p] = features.depth[p];
+        }
+    });
+    parallel_for(fb.height, DENOISE_ROW_GRAIN, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            for (int x = 0; x < w; x++) {
+                double sum = 0, sum2 = 0;
+                int n = 0;
+                for (int dy = -1; dy <= 1; dy++) {
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int qx = x + dx, qy = y + dy;
+                        if (qx < 0 || qy < 0 || qx >= w || qy >= fb.height) continue;
+                        size_t q = size_t(qy) * w + qx;
+                        float l = luminance(buf.color[0][0][q], buf.color[0][1][q], buf.color[0][2][q]);
+                        sum += l;
+                        sum2 += double(l) * l;
+                        n++;
+                    }
+                }
+                double mean = sum / n;
+                size_t p = size_t(y) * w + x;
+                buf.variance[0][p] = float(fmax(0.0, sum2 / n - mean * mean));
+                buf.depth_gradient[p] = local_depth_gradient(buf, x, y);
+            }
+        }
+    });
+}
+
+// 3x3 Gaussian blur of the variance at (x, y), steadies the luminance edge stopping
+inline float blurred_variance(const vector<float>& var, int w, int h, int x, int y) {
+    static const float k[3] = {0.25f, 0.5f, 0.25f};
+    float sum = 0.0f, wsum = 0.0f;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            int qx = x + dx, qy = y + dy;
+            if (qx < 0 || qy < 0 || qx >= w || qy >= h) continue;
+            float kw = k[dx + 1] * k[dy + 1];
+            sum += kw * var[size_t(qy) * w + qx];
+            wsum += kw;
+        }
+    }
+    return sum / wsum;
+}
+
+// Filter one pixel with the scalar kernel, reading buffer src and writing buffer 1 - src
+inline void atrous_pixel(DenoiseBuffers& buf, int src, int step, const DenoiseSettings& settings, int x, int y) {
+    int w = buf.width, h = buf.height;
+    size_t p = size_t(y) * w + x;
+    const vector<float>* col = buf.color[src];
+    const vector<float>& var = buf.variance[src];
+    float l_p = luminance(col[0][p], col[1][p], col[2][p]);
+    float luminance_scale = 1.0f / (settings.sigma_luminance * sqrtf(blurred_variance(var, w, h, x, y)) + 1e-10f);
+    float depth_scale = settings.sigma_depth * buf.depth_gradient[p] * step;
+    float n_p[3] = {buf.normal[0][p], buf.normal[1][p], buf.normal[2][p]};
+
+    float sum[3] = {0, 0, 0};
+    float sum_var = 0.0f, sum_w = 0.0f;
+    for (int dy = -2; dy <= 2; dy++) {
+        int qy = y + dy * step;
+        if (qy < 0 || qy >= h) continue;
+        for (int dx = -2; dx <= 2; dx++) {
+            int qx = x + dx * step;
+            if (qx < 0 || qx >= w) continue;
+            size_t q = size_t(qy) * w + qx;
+            float weight = ATROUS_KERNEL[dx + 2] * ATROUS_KERNEL[dy + 2];
+            if (q != p) {
+                float l_q = luminance(col[0][q], col[1][q], col[2][q]);
+                float n_dot = n_p[0] * buf.normal[0][q] + n_p[1] * buf.normal[1][q] + n_p[2] * buf.normal[2][q];
+                float w_n = fmaxf(n_dot, 0.0f);
+                for (int k = 0; k < settings.normal_power; k++) w_n *= w_n;
+                float e_l = fabsf(l_p - l_q) * luminance_scale;
+                float e_z = fabsf(buf.depth[p] - buf.depth[q]) / (depth_scale * (abs(dx) + abs(dy)) + 1e-3f);
+                weight *= w_n * expf(-e_l - e_z);
+            }
+            for (int c = 0; c < 3; c++) sum[c] += weight * col[c][q];
+            sum_var += weight * weight * var[q];
+            sum_w += weight;
+        }
+    }
+    for (int c = 0; c < 3; c++) buf.color[1 - src][c][p] = sum[c] / sum_w;
+    buf.variance[1 - src][p] = sum_var / (sum_w * sum_w);
+}
+
+#if defined(__SSE2__)
+// exp(x) for x <= 0 in four lanes (Cephes polynomial, about 1 ulp)
+inline __m128 exp_ps(__m128 x) {
+    x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+    __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504f)));
+    __m128 fn = _mm_cvtepi32_ps(n);
+    x = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(0.693359375f)));
+    x = _mm_add_ps(x, _mm_mul_ps(fn, _mm_set1_ps(2.12194440e-4f)));
+    __m128 y = _mm_set1_ps(1.9875691500e-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, x), x), _mm_add_ps(x, _mm_set1_ps(1.0f)));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(y, scale);
+}
+
+inline __m128 abs_ps(__m128 x) {
+    return _mm_andnot_ps(_mm_set1_ps(-0.0f), x);
+}
+
+// Filter the four pixels x..x+3 of row y with SSE2. Every horizontal tap must lie inside the image.
+inline void atrous_pixels4(DenoiseBuffers& buf, int src, int step, const DenoiseSettings& settings, int x, int y) {
+    int w = buf.width, h = buf.height;
+    size_t p = size_t(y) * w + x;
+    const float* col[3] = {buf.color[src][0].data(), buf.color[src][1].data(), buf.color[src][2].data()};
+    const float* var = buf.variance[src].data();
+    const float* nrm[3] = {buf.normal[0].data(), buf.normal[1].data(), buf.normal[2].data()};
+    const float* z = buf.depth.data();
+    const __m128 lr = _mm_set1_ps(0.2126f), lg = _mm_set1_ps(0.7152f), lb = _mm_set1_ps(0.0722f);
+
+    alignas(16) float scale[4];
+    for (int k = 0; k < 4; k++) {
+        scale[k] = 1.0f / (settings.sigma_luminance * sqrtf(blurred_variance(buf.variance[src], w, h, x + k, y)) + 1e-10f);
+    }
+    __m128 luminance_scale = _mm_load_ps(scale);
+    __m128 depth_scale = _mm_mul_ps(_mm_loadu_ps(buf.depth_gradient.data() + p), _mm_set1_ps(settings.sigma_depth * step));
+    __m128 c_p[3] = {_mm_loadu_ps(col[0] + p), _mm_loadu_ps(col[1] + p), _mm_loadu_ps(col[2] + p)};
+    __m128 l_p = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lr, c_p[0]), _mm_mul_ps(lg, c_p[1])), _mm_mul_ps(lb, c_p[2]));
+    __m128 n_p[3] = {_mm_loadu_ps(nrm[0] + p), _mm_loadu_ps(nrm[1] + p), _mm_loadu_ps(nrm[2] + p)};
+    __m128 z_p = _mm_loadu_ps(z + p);
+
+    __m128 sum[3] = {_mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps()};
+    __m128 sum_var = _mm_setzero_ps(), sum_w = _mm_setzero_ps();
+    for (int dy = -2; dy <= 2; dy++) {
+        int qy = y + dy * step;
+        if (qy < 0 || qy >= h) continue;
+        for (int dx = -2; dx <= 2; dx++) {
+            size_t q = size_t(qy) * w + x + dx * step;
+            __m128 kernel = _mm_set1_ps(ATROUS_KERNEL[dx + 2] * ATROUS_KERNEL[dy + 2]);
+            __m128 c_q[3] = {_mm_loadu_ps(col[0] + q), _mm_loadu_ps(col[1] + q), _mm_loadu_ps(col[2] + q)};
+            __m128 weight = kernel;
+            if (dx != 0 || dy != 0) {
+                __m128 l_q = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lr, c_q[0]), _mm_mul_ps(lg, c_q[1])), _mm_mul_ps(lb, c_q[2]));
+                __m128 n_dot = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n_p[0], _mm_loadu_ps(nrm[0] + q)),
+                                                     _mm_mul_ps(n_p[1], _mm_loadu_ps(nrm[1] + q))),
+                                          _mm_mul_ps(n_p[2], _mm_loadu_ps(nrm[2] + q)));
+                __m128 w_n = _mm_max_ps(n_dot, _mm_setzero_ps());
+                for (int k = 0; k < settings.normal_power; k++) w_n = _mm_mul_ps(w_n, w_n);
+                __m128 e_l = _mm_mul_ps(abs_ps(_mm_sub_ps(l_p, l_q)), luminance_scale);
+                __m128 taps = _mm_set1_ps(float(abs(dx) + abs(dy)));
+                __m128 e_z = _mm_div_ps(abs_ps(_mm_sub_ps(z_p, _mm_loadu_ps(z + q))),
+                                        _mm_add_ps(_mm_mul_ps(depth_scale, taps), _mm_set1_ps(1e-3f)));
+                weight = _mm_mul_ps(weight, _mm_mul_ps(w_n, exp_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(e_l, e_z)))));
+            }
+            for (int c = 0; c < 3; c++) sum[c] = _mm_add_ps(sum[c], _mm_mul_ps(weight, c_q[c]));
+            sum_var = _mm_add_ps(sum_var, _mm_mul_ps(_mm_mul_ps(weight, weight), _mm_loadu_ps(var + q)));
+            sum_w = _mm_add_ps(sum_w, weight);
+        }
+    }
+    __m128 inv_w = _mm_div_ps(_mm_set1_ps(1.0f), sum_w);
+    for (int c = 0; c < 3; c++) _mm_storeu_ps(buf.color[1 - src][c].data() + p, _mm_mul_ps(sum[c], inv_w));
+    _mm_storeu_ps(buf.variance[1 - src].data() + p, _mm_mul_ps(sum_var, _mm_mul_ps(inv_w, inv_w)));
+}
+#endif
+
+// One a-trous pass with taps step pixels apart, rows in parallel
+inline void atrous_pass(DenoiseBuffers& buf, int src, int step, const DenoiseSettings& settings) {
+    int w = buf.width;
+    parallel_for(buf.height, DENOISE_ROW_GRAIN, [&](int begin, int end) {
+        for (int y = begin; y < end; y++) {
+            int x = 0;
+#if defined(__SSE2__)
+            if (settings.simd) {
+                // Pixels whose taps reach past the left or right edge take the scalar path
+                int margin = 2 * step;
+                for (; x < margin && x < w; x++) atrous_pixel(buf, src, step, settings, x, y);
+                for (; x + 4 + margin <= w; x += 4) atrous_pixels4(buf, src, step, settings, x, y);
+            }
+#endif
+            for (; x < w; x++) atrous_pixel(buf, src, step, settings, x, y);
+        }
+    });
+}
+
+// Denoise the framebuffer in place, guided by the features of the same view
+inline void denoise(Framebuffer& fb, const FeatureBuffers& features, const DenoiseSettings& settings, DenoiseBuffers& buf) {
+    denoise_prepare(fb, features, buf);
+    int src = 0;
+    for (int i = 0; i < settings.iterations; i++) {
+        atrous_pass(buf, src, 1 << i, settings);
+        src = 1 - src;
+    }
+    // Modulate the filtered illumination with the albedo again
+    int w = fb.width;
+    parallel_for(fb.height, DENOISE_ROW_GRAIN, [&](int begin, int end) {
+        for (size_t p = size_t(begin) * w; p < size_t(end) * w; p++) {
+            const vec3& a = features.albedo[p];
+            fb.pixels[p] = vec3(buf.color[src][0][p] * fmaxf(a[0], DENOISE_ALBEDO_EPSILON),
+                                buf.color[src][1][p] * fmaxf(a[1], DENOISE_ALBEDO_EPSILON),
+                                buf.color[src][2][p] * fmaxf(a[2], DENOISE_ALBEDO_EPSILON));
+        }
+    });
+}
+
+#endif // DENOISER_H
@@ -0,0 +1,126 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <ostream>
+#include <cstdio>
+#include "vec3.h"
+#include "ray.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Parallel.h"
+
+using namespace std;
+
+// Traversal cost heatmap: the work intersect_scene does for the primary ray through every pixel center, drawn in
+// false color so the regions that are expensive to trace stand out. The cost of a pixel is its nodes visited plus
+// primitives tested.
+
+// Define the per-pixel traversal work, rows stored top to bottom like Framebuffer
+struct TraversalHeatmap {
+    int width = 0;
+    int height = 0;
+    vector<TraversalStats> pixels;
+
+    TraversalHeatmap() {}
+    TraversalHeatmap(int w, int h) : width(w), height(h), pixels(size_t(w) * h) {}
+
+    // Pixel (i, j) with j counted from the bottom row, as in the render loops
+    inline TraversalStats& at(int i, int j) { return pixels[size_t(height - 1 - j) * width + i]; }
+};
+
+inline int traversal_cost(const TraversalStats& s) {
+    return s.nodes + s.primitives;
+}
+
+// Mean, 99th percentile and maximum of one per-pixel count
+struct HeatmapStat {
+    double mean = 0;
+    int p99 = 0;
+    int max = 0;
+};
+
+struct HeatmapSummary {
+    HeatmapStat nodes;
+    HeatmapStat primitives;
+    HeatmapStat cost;  // Nodes plus primitives
+};
+
+// Function to trace the primary ray through every pixel center and record what it cost
+inline void render_heatmap(const Scene& scene, const Camera& camera, TraversalHeatmap& heatmap) {
+    heatmap = TraversalHeatmap(camera.width, camera.height);
+    parallel_for(camera.height, 4, [&](int begin, int end) {
+        for (int j = begin; j < end; j++) {
+            for (int i = 0; i < camera.width; i++) {
+                ray r = camera.get_ray((i + 0.5f) / camera.width, (j + 0.5f) / camera.height);
+                HitRecord rec;
+                intersect_scene(scene, r, rec, FLT_MAX, RayCone(), &heatmap.at(i, j));
+            }
+        }
+    });
+}
+
+inline HeatmapStat heatmap_stat(vector<int> values) {
+    HeatmapStat stat;
+    if (values.empty()) return stat;
+    double sum = 0;
+    for (int v : values) sum += v;
+    stat.mean = sum / values.size();
+    size_t k = min(values.size() - 1, size_t(0.99 * values.size()));
+    nth_element(values.begin(), values.begin() + k, values.end());
+    stat.p99 = values[k];
+    stat.max = *max_element(values.begin(), values.end());
+    return stat;
+}
+
+inline HeatmapSummary summarize_heatmap(const TraversalHeatmap& heatmap) {
+    vector<int> nodes, primitives, cost;
+    for (const TraversalStats& s : heatmap.pixels) {
+        nodes.push_back(s.nodes);
+        primitives.push_back(s.primitives);
+        cost.push_back(traversal_cost(s));
+    }
+    HeatmapSummary summary;
+    summary.nodes = heatmap_stat(nodes);
+    summary.primitives = heatmap_stat(primitives);
+    summary.cost = heatmap_stat(cost);
+    return summary;
+}
+
+inline void print_heatmap_summary(ostream& os, const HeatmapSummary& summary) {
+    char line[128];
+    os << "traversal per primary ray:        mean      p99      max\n";
+    const HeatmapStat* stats[3] = {&summary.nodes, &summary.primitives, &summary.cost};
+    const char* names[3] = {"nodes visited", "primitives tested", "total"};
+    for (int k = 0; k < 3; k++) {
+        snprintf(line, sizeof(line), "  %-26s %10.1f %8d %8d\n", names[k], stats[k]->mean, stats[k]->p99, stats[k]->max);
+        os << line;
+    }
+}
+
+// False color of x in [0, 1]: blue, cyan, green, yellow, red
+inline vec3 heatmap_color(float x) {
+    static const vec3 ramp[5] = {vec3(0, 0, 1), vec3(0, 1, 1), vec3(0, 1, 0), vec3(1, 1, 0), vec3(1, 0, 0)};
+    x = x < 0.0f ? 0.0f : (x > 1.0f ? 1.0f : x);
+    float f = x * 4.0f;
+    int k = f >= 4.0f ? 3 : int(f);
+    f -= k;
+    return (1.0f - f) * ramp[k] + f * ramp[k + 1];
+}
+
+// Function to write the heatmap as a PPM. The color ramp spans 0 to the 99th percentile of the cost, pixels above
+// it are white, so the worst percent stands out rather than squeezing everything else into blue.
+inline bool write_heatmap_ppm(const TraversalHeatmap& heatmap, const HeatmapSummary& summary, const string& path) {
+    Framebuffer fb(heatmap.width, heatmap.height);
+    float scale = summary.cost.p99 > 0 ? 1.0f / summary.cost.p99 : 0.0f;
+    for (size_t p = 0; p < heatmap.pixels.size(); p++) {
+        int cost = traversal_cost(heatmap.pixels[p]);
+        fb.pixels[p] = cost > summary.cost.p99 ? vec3(1, 1, 1) : heatmap_color(cost * scale);
+    }
+    return write_ppm(fb, path);
+}
+
+#endif // HEATMAP_H
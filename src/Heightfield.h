@@ -0,0 +1,255 @@
+#ifndef HEIGHTFIELD_H
+#define HEIGHTFIELD_H
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+#include "Triangle.h"
+
+using namespace std;
+
+// Terrain stored as a grid of 16-bit heights instead of triangles. Every grid cell is the two triangles a
+// triangulation of the grid would have; rays find them through a min/max pyramid over blocks of cells, descending
+// only into blocks whose height range the ray passes through (maximum mipmaps, Tevs et al. 2008).
+
+const int HEIGHTFIELD_BLOCK = 8;  // Cells per side of the pyramid's finest level, whose cells are tested one by one
+
+// Height range of a block of the pyramid, in height units
+struct HeightRange {
+    uint16_t lo;
+    uint16_t hi;
+};
+
+// Define the heightfield. Sample (x, z) lies at origin + (x * cell_size, heights[z * samples_x + x] * height_scale,
+// z * cell_size).
+struct Heightfield {
+    int samples_x = 0, samples_z = 0;
+    vec3 origin = vec3(0, 0, 0);
+    float cell_size = 1.0f;
+    float height_scale = 1.0f;  // World height of one height unit
+    vector<uint16_t> heights;
+
+    // levels[0] has one range per HEIGHTFIELD_BLOCK x HEIGHTFIELD_BLOCK cells, each next level halves both sides
+    // down to a single range
+    vector<vector<HeightRange>> levels;
+    vector<int> level_x, level_z;  // Ranges per row and rows of each level
+    AABB bounds;
+};
+
+// Function to size the heightfield's grid, all heights 0. Fill heights, then call build_heightfield_pyramid.
+inline void make_heightfield(Heightfield& hf, int samples_x, int samples_z, const vec3& origin, float cell_size,
+                             float height_scale) {
+    hf.samples_x = samples_x;
+    hf.samples_z = samples_z;
+    hf.origin = origin;
+    hf.cell_size = cell_size;
+    hf.height_scale = height_scale;
+    hf.heights.assign(size_t(samples_x) * samples_z, 0);
+    hf.levels.clear();
+}
+
+inline float heightfield_y(const Heightfield& hf, int x, int z) {
+    return hf.origin.y() + hf.heights[size_t(z) * hf.samples_x + x] * hf.height_scale;
+}
+
+inline vec3 heightfield_point(const Heightfield& hf, int x, int z) {
+    return vec3(hf.origin.x() + x * hf.cell_size, heightfield_y(hf, x, z), hf.origin.z() + z * hf.cell_size);
+}
+
+// Function to build the min/max pyramid and the bounds after the heights changed. A block's range covers the
+// samples on its far edges too, since its cells' corners lie there.
+inline void build_heightfield_pyramid(Heightfield& hf) {
+    hf.levels.clear();
+    hf.level_x.clear();
+    hf.level_z.clear();
+    hf.bounds = AABB();
+    int cells_x = hf.samples_x - 1, cells_z = hf.samples_z - 1;
+    if (cells_x < 1 || cells_z < 1) return;
+
+    int nx = (cells_x + HEIGHTFIELD_BLOCK - 1) / HEIGHTFIELD_BLOCK;
+    int nz = (cells_z + HEIGHTFIELD_BLOCK - 1) / HEIGHTFIELD_BLOCK;
+    hf.levels.emplace_back(size_t(nx) * nz);
+    hf.level_x.push_back(nx);
+    hf.level_z.push_back(nz);
+    for (int bz = 0; bz < nz; bz++) {
+        int z1 = (bz + 1) * HEIGHTFIELD_BLOCK < cells_z ? (bz + 1) * HEIGHTFIELD_BLOCK : cells_z;
+        for (int bx = 0; bx < nx; bx++) {
+            int x1 = (bx + 1) * HEIGHTFIELD_BLOCK < cells_x ? (bx + 1) * HEIGHTFIELD_BLOCK : cells_x;
+            HeightRange range = {UINT16_MAX, 0};
+            for (int z = bz * HEIGHTFIELD_BLOCK; z <= z1; z++) {
+                const uint16_t* row = &hf.heights[size_t(z) * hf.samples_x];
+                for (int x = bx * HEIGHTFIELD_BLOCK; x <= x1; x++) {
+                    range.lo = row[x] < range.lo ? row[x] : range.lo;
+                    range.hi = row[x] > range.hi ? row[x] : range.hi;
+                }
+            }
+            hf.levels[0][size_t(bz) * nx + bx] = range;
+        }
+    }
+
+    while (nx > 1 || nz > 1) {
+        const vector<HeightRange>& fine = hf.levels.back();
+        int fx = nx, fz = nz;
+        nx = (nx + 1) / 2;
+        nz = (nz + 1) / 2;
+        vector<HeightRange> coarse(size_t(nx) * nz, HeightRange{UINT16_MAX, 0});
+        for (int z = 0; z < fz; z++) {
+            for (int x = 0; x < fx; x++) {
+                const HeightRange& f = fine[size_t(z) * fx + x];
+                HeightRange& c = coarse[size_t(z / 2) * nx + x / 2];
+                c.lo = f.lo < c.lo ? f.lo : c.lo;
+                c.hi = f.hi > c.hi ? f.hi : c.hi;
+            }
+        }
+        hf.levels.push_back(move(coarse));
+        hf.level_x.push_back(nx);
+        hf.level_z.push_back(nz);
+    }
+
+    const HeightRange& top = hf.levels.back()[0];
+    grow(hf.bounds, vec3(hf.origin.x(), hf.origin.y() + top.lo * hf.height_scale, hf.origin.z()));
+    grow(hf.bounds, vec3(hf.origin.x() + cells_x * hf.cell_size, hf.origin.y() + top.hi * hf.height_scale,
+                         hf.origin.z() + cells_z * hf.cell_size));
+}
+
+inline size_t heightfield_memory_bytes(const Heightfield& hf) {
+    size_t bytes = hf.heights.size() * sizeof(uint16_t);
+    for (const vector<HeightRange>& level : hf.levels) bytes += level.size() * sizeof(HeightRange);
+    return bytes;
+}
+
+// The two triangles of cell (x, z), wound so their normals point up like the other primitives' outward normals
+inline void heightfield_cell_triangles(const Heightfield& hf, int x, int z, Triangle& a, Triangle& b) {
+    vec3 p00 = heightfield_point(hf, x, z), p10 = heightfield_point(hf, x + 1, z);
+    vec3 p01 = heightfield_point(hf, x, z + 1), p11 = heightfield_point(hf, x + 1, z + 1);
+    a = {p00, p11, p10};
+    b = {p00, p01, p11};
+}
+
+// Box of cells [x0, x1) x [z0, z1) between two heights, padded by half a height unit against rounding
+inline AABB heightfield_box(const Heightfield& hf, int x0, int z0, int x1, int z1, uint16_t lo, uint16_t hi) {
+    AABB box;
+    box.bmin = vec3(hf.origin.x() + x0 * hf.cell_size, hf.origin.y() + (lo - 0.5f) * hf.height_scale,
+                    hf.origin.z() + z0 * hf.cell_size);
+    box.bmax = vec3(hf.origin.x() + x1 * hf.cell_size, hf.origin.y() + (hi + 0.5f) * hf.height_scale,
+                    hf.origin.z() + z1 * hf.cell_size);
+    return box;
+}
+
+// Function to test the cell (x, z) the ray crosses between t0 and t1: a quick test of the ray's heights there
+// against the cell's corner heights, then its two triangles
+inline bool hit_heightfield_cell(const Heightfield& hf, const ray& r, const RayShear& shear, int x, int z, float t0,
+                                 float t1, float t_min, float& t, vec3& N) {
+    const uint16_t* row0 = &hf.heights[size_t(z) * hf.samples_x + x];
+    const uint16_t* row1 = row0 + hf.samples_x;
+    uint16_t lo = row0[0], hi = row0[0];
+    for (uint16_t h : {row0[1], row1[0], row1[1]}) {
+        lo = h < lo ? h : lo;
+        hi = h > hi ? h : hi;
+    }
+    float y0 = r.O.y() + t0 * r.D.y(), y1 = r.O.y() + t1 * r.D.y();
+    float y_lo = hf.origin.y() + (lo - 0.5f) * hf.height_scale, y_hi = hf.origin.y() + (hi + 0.5f) * hf.height_scale;
+    if ((y0 > y_hi && y1 > y_hi) || (y0 < y_lo && y1 < y_lo)) return false;
+
+    Triangle tris[2];
+    heightfield_cell_triangles(hf, x, z, tris[0], tris[1]);
+    int hit_tri = -1;
+    for (int k = 0; k < 2; k++) {
+        float t_tri;
+        if (hit_triangle_watertight(tris[k], r, shear, t, t_tri) && t_tri > t_min && t_tri < t) {
+            t = t_tri;
+            hit_tri = k;
+        }
+    }
+    if (hit_tri < 0) return false;
+    N = triangle_normal(tris[hit_tri]);
+    return true;
+}
+
+// Function to find the nearest hit of a ray with the heightfield beyond t_min and before t. The pyramid is walked
+// from the top with a stack, nearer quadrants first, skipping blocks the ray misses or reaches only beyond the
+// nearest hit so far; in the finest blocks the ray steps through the cells in order (Amanatides and Woo) and stops
+// at the first hit. any_hit returns on the first hit anywhere, for shadow rays.
+// If steps is given the pyramid blocks visited are added to it.
+inline bool intersect_heightfield(const Heightfield& hf, const ray& r, float t_min, float& t, vec3& N,
+                                  int* steps = nullptr, bool any_hit = false) {
+    if (hf.levels.empty()) return false;
+    RayBoxQuery q = make_box_query(r);
+    float t_near, t_far;
+    if (!clip_aabb(hf.bounds, q, t, t_near, t_far) || t_far < t_min) return false;
+
+    struct Block { int level, x, z; };
+    Block stack[64 * 3 + 1];  // Every level pushes at most 3 blocks besides the one it continues with
+    int sp = 0;
+    stack[sp++] = {int(hf.levels.size()) - 1, 0, 0};
+    int cells_x = hf.samples_x - 1, cells_z = hf.samples_z - 1;
+    float dx = r.D.x(), dz = r.D.z();
+    RayShear shear = make_ray_shear(r.D);
+    int flip_x = dx < 0.0f, flip_z = dz < 0.0f;
+    int step_x = flip_x ? -1 : 1, step_z = flip_z ? -1 : 1;
+    float delta_x = dx != 0.0f ? hf.cell_size / fabsf(dx) : FLT_MAX;  // Ray parameter across one cell
+    float delta_z = dz != 0.0f ? hf.cell_size / fabsf(dz) : FLT_MAX;
+    bool hit = false;
+    int visited = 0;
+    while (sp > 0) {
+        Block b = stack[--sp];
+        visited++;
+        const HeightRange& range = hf.levels[b.level][size_t(b.z) * hf.level_x[b.level] + b.x];
+        int span = HEIGHTFIELD_BLOCK << b.level;
+        int x0 = b.x * span, z0 = b.z * span;
+        int x1 = x0 + span < cells_x ? x0 + span : cells_x;
+        int z1 = z0 + span < cells_z ? z0 + span : cells_z;
+        if (!clip_aabb(heightfield_box(hf, x0, z0, x1, z1, range.lo, range.hi), q, t, t_near, t_far) ||
+            t_far < t_min) continue;
+
+        if (b.level > 0) {
+            // Quadrants in reverse order of the ray's direction, so the nearest is popped first. The two side
+            // quadrants cannot both be crossed, so their order does not matter.
+            for (int k = 3; k >= 0; k--) {
+                int cx = 2 * b.x + ((k & 1) ^ flip_x), cz = 2 * b.z + ((k >> 1) ^ flip_z);
+                if (cx < hf.level_x[b.level - 1] && cz < hf.level_z[b.level - 1]) stack[sp++] = {b.level - 1, cx, cz};
+            }
+            continue;
+        }
+
+        // Walk the cells of the block from where the ray enters it
+        float t_enter = t_near > t_min ? t_near : t_min;
+        float fx = (r.O.x() + t_enter * dx - hf.origin.x()) / hf.cell_size;
+        float fz = (r.O.z() + t_enter * dz - hf.origin.z()) / hf.cell_size;
+        int x = int(floorf(fx)), z = int(floorf(fz));
+        x = x < x0 ? x0 : (x >= x1 ? x1 - 1 : x);
+        z = z < z0 ? z0 : (z >= z1 ? z1 - 1 : z);
+        float next_x = dx != 0.0f ? (hf.origin.x() + (x + (flip_x ? 0 : 1)) * hf.cell_size - r.O.x()) / dx : FLT_MAX;
+        float next_z = dz != 0.0f ? (hf.origin.z() + (z + (flip_z ? 0 : 1)) * hf.cell_size - r.O.z()) / dz : FLT_MAX;
+        float t_cell = t_enter;
+        bool block_hit = false;
+        while (true) {
+            float t_exit = next_x < next_z ? next_x : next_z;
+            if (t_exit > t_far) t_exit = t_far;
+            if (hit_heightfield_cell(hf, r, shear, x, z, t_cell, t_exit, t_min, t, N)) block_hit = true;
+            if (block_hit && (any_hit || t <= t_exit)) break;  // Cells further on lie behind this hit
+            if (t_exit >= t_far) break;
+            t_cell = t_exit;
+            if (next_x < next_z) {
+                x += step_x;
+                next_x += delta_x;
+                if (x < x0 || x >= x1) break;
+            } else {
+                z += step_z;
+                next_z += delta_z;
+                if (z < z0 || z >= z1) break;
+            }
+        }
+        if (block_hit) {
+            hit = true;
+            if (any_hit) break;
+        }
+    }
+    if (steps) *steps += visited;
+    return hit;
+}
+
+#endif // HEIGHTFIELD_H
@@ -0,0 +1,84 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include "vec3.h"
+
+using namespace std;
+
+// Define the in-memory framebuffer. Rows are stored top to bottom, the order they are written to a PPM.
+struct Framebuffer {
+    int width = 0;
+    int height = 0;
+    vector<vec3> pixels;
+
+    Framebuffer() {}
+    Framebuffer(int w, int h) : width(w), height(h), pixels(size_t(w) * h, vec3(0, 0, 0)) {}
+
+    // Pixel (i, j) with j counted from the bottom row, as in the render loops
+    inline vec3& at(int i, int j) { return pixels[size_t(height - 1 - j) * width + i]; }
+    inline const vec3& at(int i, int j) const { return pixels[size_t(height - 1 - j) * width + i]; }
+};
+
+// Convert a color channel to the 0-255 range written to PPM files
+inline int to_byte(float c) {
+    int v = int(255.99f * c);
+    return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+// Write the framebuffer as a plain (P3) PPM file. Returns false if the file cannot be written.
+inline bool write_ppm(const Framebuffer& fb, const string& path) {
+    string out = "P3\n" + to_string(fb.width) + " " + to_string(fb.height) + "\n255\n";
+    out.reserve(out.size() + fb.pixels.size() * 12);
+    for (const auto& c : fb.pixels) {
+        out += to_string(to_byte(c.x()));
+        out += ' ';
+        out += to_string(to_byte(c.y()));
+        out += ' ';
+        out += to_string(to_byte(c.z()));
+        out += '\n';
+    }
+    ofstream file(path, ios::out | ios::binary);
+    if (!file) return false;
+    file.write(out.data(), out.size());
+    return bool(file);
+}
+
+// Write 8-bit RGB, rows top to bottom, as a binary (P6) PPM file. Returns false if the file cannot be written.
+inline bool write_ppm_rgb(int width, int height, const vector<uint8_t>& rgb, const string& path) {
+    ofstream file(path, ios::out | ios::binary);
+    if (!file) return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    return bool(file);
+}
+
+// Read a plain (P3) or binary (P6) PPM file into 8-bit RGB. Returns false if the file is missing or malformed.
+inline bool read_ppm(const string& path, int& width, int& height, vector<uint8_t>& rgb) {
+    ifstream file(path, ios::in | ios::binary);
+    string magic;
+    int max_value;
+    if (!(file >> magic >> width >> height >> max_value)) return false;
+    if ((magic != "P3" && magic != "P6") || width <= 0 || height <= 0 || max_value <= 0 || max_value > 255) return false;
+    rgb.resize(size_t(width) * height * 3);
+    if (magic == "P6") {
+        file.get();  // Single whitespace after the header
+        file.read(reinterpret_cast<char*>(rgb.data()), rgb.size());
+        if (max_value != 255) {
+            for (auto& c : rgb) c = uint8_t(c > max_value ? 255 : c * 255 / max_value);
+        }
+        return bool(file);
+    }
+    for (auto& c : rgb) {
+        int v;
+        if (!(file >> v)) return false;
+        v = v * 255 / max_value;
+        c = uint8_t(v < 0 ? 0 : (v > 255 ? 255 : v));
+    }
+    return true;
+}
+
+#endif // IMAGE_H
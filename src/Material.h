@@ -0,0 +1,183 @@
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include "vec3.h"
+#include "Random.h"
+
+using namespace std;
+
+// Kinds of surface response
+enum MaterialType {
+    MAT_DIFFUSE,     // Lambertian, lit by the lights directly
+    MAT_MIRROR,      // Perfect reflection
+    MAT_GLOSSY,      // Reflection blurred by roughness
+    MAT_DIELECTRIC   // Glass-like, reflects or refracts with the Fresnel term
+};
+
+const int MATERIAL_TYPE_COUNT = 4;
+
+// Define the material structure, the description a MaterialTable entry is made from
+struct Material {
+    MaterialType type = MAT_DIFFUSE;
+    vec3 albedo = vec3(1, 1, 1);    // Reflectance (diffuse color, or tint of mirror, glossy and glass)
+    float roughness = 0.0f;         // Glossy lobe width, 0 is a mirror
+    float metallic = 0.0f;          // Fraction of a diffuse surface that reflects like a glossy one instead
+    vec3 emission = vec3(0, 0, 0);  // Radiance the surface emits by itself
+    float ior = 1.5f;               // Index of refraction of dielectrics
+    int texture = -1;               // Texture in the scene's TextureCache multiplying the albedo, -1 for none
+};
+
+// Compact material reference stored per primitive
+typedef uint16_t MaterialId;
+const int MAX_MATERIALS = 65536;
+
+// Define the material table: one array per parameter, indexed by MaterialId.
+// Entry 0 is the default white diffuse material that primitives without an id get.
+struct MaterialTable {
+    vector<uint8_t> type;
+    vector<float> albedo_r, albedo_g, albedo_b;
+    vector<float> roughness;
+    vector<float> metallic;
+    vector<float> emission_r, emission_g, emission_b;
+    vector<float> ior;
+    vector<int32_t> texture;
+
+    MaterialTable() { add(Material()); }
+
+    inline int size() const { return int(type.size()); }
+
+    void resize(int n) {
+        type.resize(n);
+        for (auto* v : {&albedo_r, &albedo_g, &albedo_b, &roughness, &metallic, &emission_r, &emission_g, &emission_b, &ior})
+            v->resize(n);
+        texture.resize(n);
+    }
+
+    inline void set(int id, const Material& m) {
+        type[id] = uint8_t(m.type);
+        albedo_r[id] = m.albedo.x(); albedo_g[id] = m.albedo.y(); albedo_b[id] = m.albedo.z();
+        roughness[id] = m.roughness;
+        metallic[id] = m.metallic;
+        emission_r[id] = m.emission.x(); emission_g[id] = m.emission.y(); emission_b[id] = m.emission.z();
+        ior[id] = m.ior;
+        texture[id] = m.texture;
+    }
+
+    // Append a material and return its id. Once the table is full the default material 0 is returned.
+    MaterialId add(const Material& m) {
+        if (size() >= MAX_MATERIALS) return 0;
+        int id = size();
+        resize(id + 1);
+        set(id, m);
+        return MaterialId(id);
+    }
+
+    inline Material get(int id) const {
+        Material m;
+        m.type = MaterialType(type[id]);
+        m.albedo = vec3(albedo_r[id], albedo_g[id], albedo_b[id]);
+        m.roughness = roughness[id];
+        m.metallic = metallic[id];
+        m.emission = vec3(emission_r[id], emission_g[id], emission_b[id]);
+        m.ior = ior[id];
+        m.texture = texture[id];
+        return m;
+    }
+};
+
+// Copy the entries ids[0..count) of the table into entries [first, first + count) of batch, one parameter array at
+// a time, so a sorted batch of hits can be shaded from contiguous arrays. batch must already hold first + count
+// entries, which lets threads fill disjoint ranges of it.
+inline void gather_materials(const MaterialTable& table, const MaterialId* ids, int count, MaterialTable& batch, int first) {
+    for (int k = 0; k < count; k++) batch.type[first + k] = table.type[ids[k]];
+    for (int k = 0; k < count; k++) batch.texture[first + k] = table.texture[ids[k]];
+    vector<float> MaterialTable::* const fields[] = {
+        &MaterialTable::albedo_r, &MaterialTable::albedo_g, &MaterialTable::albedo_b, &MaterialTable::roughness,
+        &MaterialTable::metallic, &MaterialTable::emission_r, &MaterialTable::emission_g, &MaterialTable::emission_b,
+        &MaterialTable::ior};
+    for (auto field : fields) {
+        const float* src = (table.*field).data();
+        float* dst = (batch.*field).data() + first;
+        for (int k = 0; k < count; k++) dst[k] = src[ids[k]];
+    }
+}
+
+inline vec3 reflect(const vec3& v, const vec3& N) {
+    return v - 2.0f * dot(v, N) * N;
+}
+
+// Refract the unit vector v through the surface with unit normal N facing v's side.
+// eta is the ratio of indices (outside / inside). Returns false on total internal reflection.
+inline bool refract(const vec3& v, const vec3& N, float eta, vec3& refracted) {
+    float cos_i = -dot(v, N);
+    float k = 1.0f - eta * eta * (1.0f - cos_i * cos_i);
+    if (k < 0.0f) return false;
+    refracted = eta * v + (eta * cos_i - sqrtf(k)) * N;
+    return true;
+}
+
+// Schlick's approximation of the Fresnel reflectance
+inline float schlick(float cosine, float ior) {
+    float r0 = (1.0f - ior) / (1.0f + ior);
+    r0 = r0 * r0;
+    return r0 + (1.0f - r0) * powf(1.0f - cosine, 5.0f);
+}
+
+// Uniform point in the unit ball
+inline vec3 sample_unit_ball(Rng& rng) {
+    while (true) {
+        vec3 p(2.0f * rng.next() - 1.0f, 2.0f * rng.next() - 1.0f, 2.0f * rng.next() - 1.0f);
+        if (p.squared_length() < 1.0f) return p;
+    }
+}
+
+// Sample the continuation of a path at a hit.
+// D is the incoming direction, N the geometric normal facing the incoming ray and front_face tells whether the ray
+// arrived from outside the primitive. Writes the new direction and the throughput weight, returns false if the
+// path is absorbed. If specular is given it is set to whether the sampled lobe is a reflection or refraction
+// without a density, that is anything but the cosine lobe of a diffuse surface.
+inline bool scatter(const Material& m, const vec3& D, const vec3& N, bool front_face, Rng& rng, vec3& out_dir, vec3& weight,
+                    bool* specular = nullptr) {
+    vec3 unit_d = unit_vector(D);
+    if (specular) *specular = m.type != MAT_DIFFUSE;
+    switch (m.type) {
+    case MAT_DIFFUSE: {
+        if (m.metallic > 0.0f && rng.next() < m.metallic) {
+            // The metallic part reflects like a glossy surface tinted by the albedo
+            if (specular) *specular = true;
+            out_dir = reflect(unit_d, N) + m.roughness * sample_unit_ball(rng);
+            weight = m.albedo;
+            return dot(out_dir, N) > 0.0f;
+        }
+        float u1 = rng.next();
+        float u2 = rng.next();
+        out_dir = sample_cosine_hemisphere(N, u1, u2);  // The cosine-weighted pdf cancels the cosine term
+        weight = m.albedo;
+        return true;
+    }
+    case MAT_MIRROR:
+        out_dir = reflect(unit_d, N);
+        weight = m.albedo;
+        return true;
+    case MAT_GLOSSY:
+        out_dir = reflect(unit_d, N) + m.roughness * sample_unit_ball(rng);
+        weight = m.albedo;
+        return dot(out_dir, N) > 0.0f;  // Lobe samples below the surface are absorbed
+    case MAT_DIELECTRIC: {
+        float eta = front_face ? 1.0f / m.ior : m.ior;
+        float cos_i = -dot(unit_d, N);
+        vec3 refracted;
+        bool can_refract = refract(unit_d, N, eta, refracted);
+        if (!can_refract || rng.next() < schlick(cos_i, m.ior)) out_dir = reflect(unit_d, N);
+        else out_dir = refracted;
+        weight = m.albedo;
+        return true;
+    }
+    }
+    return false;
+}
+
+#endif // MATERIAL_H
@@ -0,0 +1,288 @@
+#ifndef MESH_LOD_H
+#define MESH_LOD_H
+
+#include <vector>
+#include <array>
+#include <utility>
+#include <queue>
+#include <unordered_map>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cfloat>
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+#include "Triangle.h"
+#include "BVH.h"
+
+using namespace std;
+
+// Triangle meshes with precomputed levels of detail. Each level is a simplified copy of the mesh with its own BVH;
+// rays pick a level from their footprint where they enter the mesh, so distant meshes are traversed at a level
+// whose edges are about a footprint long instead of through sub-pixel triangles.
+
+// Define the mesh with its levels of detail
+struct MeshLOD {
+    vector<vector<Triangle>> levels;  // levels[0] is the full mesh, each next one has about a quarter of the triangles
+    vector<BVH> bvhs;                 // One BVH per level
+    vector<float> edge_lengths;       // Mean edge length per level, growing with the level
+    AABB bounds;                      // Bounds of level 0
+    float lod_scale = 1.0f;           // Multiplies the footprint before picking a level, larger values pick coarser levels
+};
+
+// Exact position key for welding the vertices of a triangle soup
+struct VertexKey {
+    uint32_t bits[3];
+    bool operator==(const VertexKey& o) const { return bits[0] == o.bits[0] && bits[1] == o.bits[1] && bits[2] == o.bits[2]; }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& k) const {
+        uint64_t h = k.bits[0] * 0x9E3779B97F4A7C15ull;
+        h ^= (h >> 29) ^ (k.bits[1] * 0xBF58476D1CE4E5B9ull);
+        h ^= (h >> 31) ^ (k.bits[2] * 0x94D049BB133111EBull);
+        return size_t(h ^ (h >> 32));
+    }
+};
+
+inline VertexKey vertex_key(const vec3& p) {
+    VertexKey k;
+    for (int a = 0; a < 3; a++) {
+        float f = p[a] == 0.0f ? 0.0f : p[a];  // -0 and +0 weld
+        memcpy(&k.bits[a], &f, sizeof(float));
+    }
+    return k;
+}
+
+// Candidate edge collapse, stale once either vertex has moved since it was queued
+struct CollapseEdge {
+    float length2;
+    int a, b;
+    int version_a, version_b;
+    bool operator>(const CollapseEdge& o) const { return length2 > o.length2; }
+};
+
+// Whether moving vertex from to p flips (or degenerates) one of the triangles around it, other than the ones
+// the collapse of edge (a, b) removes
+inline bool collapse_flips(const vector<vec3>& pos, const vector<array<int, 3>>& tris, const vector<char>& alive,
+                           const vector<int>& vert_tris, int from, int a, int b, const vec3& p) {
+    for (int t : vert_tris) {
+        if (!alive[t]) continue;
+        const array<int, 3>& tri = tris[t];
+        bool has_a = tri[0] == a || tri[1] == a || tri[2] == a;
+        bool has_b = tri[0] == b || tri[1] == b || tri[2] == b;
+        if (has_a && has_b) continue;
+        vec3 v[3], w[3];
+        for (int k = 0; k < 3; k++) {
+            v[k] = pos[tri[k]];
+            w[k] = tri[k] == from ? p : v[k];
+        }
+        vec3 before = cross(v[1] - v[0], v[2] - v[0]);
+        vec3 after = cross(w[1] - w[0], w[2] - w[0]);
+        if (dot(before, after) <= 0.0f) return true;
+    }
+    return false;
+}
+
+// Function to simplify a triangle soup to about target triangles by collapsing the shortest edges to their midpoints.
+// Vertices are welded by position first; collapses that would flip a triangle are skipped, so the result may stay
+// above target.
+inline void simplify_triangles(const vector<Triangle>& in, size_t target, vector<Triangle>& out) {
+    vector<vec3> pos;
+    vector<array<int, 3>> tris(in.size());
+    unordered_map<VertexKey, int, VertexKeyHash> welded;
+    for (size_t t = 0; t < in.size(); t++) {
+        const vec3* v[3] = {&in[t].v0, &in[t].v1, &in[t].v2};
+        for (int k = 0; k < 3; k++) {
+            auto it = welded.emplace(vertex_key(*v[k]), int(pos.size()));
+            if (it.second) pos.push_back(*v[k]);
+            tris[t][k] = it.first->second;
+        }
+    }
+
+    vector<vector<int>> vert_tris(pos.size());
+    vector<char> alive(tris.size(), 1);
+    size_t alive_count = 0;
+    for (size_t t = 0; t < tris.size(); t++) {
+        const array<int, 3>& tri = tris[t];
+        if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+            alive[t] = 0;
+            continue;
+        }
+        alive_count++;
+        for (int k = 0; k < 3; k++) vert_tris[tri[k]].push_back(int(t));
+    }
+
+    vector<int> version(pos.size(), 0);  // -1 once the vertex is collapsed away
+    priority_queue<CollapseEdge, vector<CollapseEdge>, greater<CollapseEdge>> heap;
+    auto push_edge = [&](int a, int b) {
+        heap.push({(pos[a] - pos[b]).squared_length(), a, b, version[a], version[b]});
+    };
+    for (size_t t = 0; t < tris.size(); t++) {
+        if (!alive[t]) continue;
+        for (int k = 0; k < 3; k++) {
+            int a = tris[t][k], b = tris[t][(k + 1) % 3];
+            push_edge(a < b ? a : b, a < b ? b : a);  // Interior edges are queued twice, the copy goes stale
+        }
+    }
+
+    while (alive_count > target && !heap.empty()) {
+        CollapseEdge e = heap.top();
+        heap.pop();
+        int a = e.a, b = e.b;
+        if (version[a] != e.version_a || version[b] != e.version_b) continue;
+        vec3 mid = 0.5f * (pos[a] + pos[b]);
+        if (collapse_flips(pos, tris, alive, vert_tris[a], a, a, b, mid) ||
+            collapse_flips(pos, tris, alive, vert_tris[b], b, a, b, mid)) continue;
+
+        // Collapse b into a
+        pos[a] = mid;
+        for (int t : vert_tris[b]) {
+            if (!alive[t]) continue;
+            array<int, 3>& tri = tris[t];
+            for (int k = 0; k < 3; k++) {
+                if (tri[k] == b) tri[k] = a;
+            }
+            if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+                alive[t] = 0;
+                alive_count--;
+            } else {
+                vert_tris[a].push_back(t);
+            }
+        }
+        vert_tris[b].clear();
+        vert_tris[b].shrink_to_fit();
+        version[b] = -1;
+        version[a]++;
+
+        // Drop dead triangles from a's list and queue its edges again with the new position
+        vector<int>& list = vert_tris[a];
+        size_t n = 0;
+        for (int t : list) {
+            if (alive[t]) list[n++] = t;
+        }
+        list.resize(n);
+        for (int t : list) {
+            for (int k = 0; k < 3; k++) {
+                int c = tris[t][k];
+                if (c != a) push_edge(a, c);
+            }
+        }
+    }
+
+    out.clear();
+    out.reserve(alive_count);
+    for (size_t t = 0; t < tris.size(); t++) {
+        if (alive[t]) out.push_back({pos[tris[t][0]], pos[tris[t][1]], pos[tris[t][2]]});
+    }
+}
+
+inline float mean_edge_length(const vector<Triangle>& triangles) {
+    double sum = 0.0;
+    for (const Triangle& tri : triangles) {
+        sum += (tri.v1 - tri.v0).length() + (tri.v2 - tri.v1).length() + (tri.v0 - tri.v2).length();
+    }
+    return triangles.empty() ? 0.0f : float(sum / (3.0 * triangles.size()));
+}
+
+// Function to build the levels of a mesh. Each level targets a quarter of the previous one's triangles, which
+// doubles the edge length; building stops at max_levels, below min_triangles or when simplification stalls.
+inline void build_mesh_lod(MeshLOD& mesh, const vector<Triangle>& triangles, int max_levels = 8,
+                           size_t min_triangles = 64) {
+    mesh.levels.assign(1, triangles);
+    mesh.bounds = AABB();
+    for (const Triangle& tri : triangles) {
+        grow(mesh.bounds, tri.v0);
+        grow(mesh.bounds, tri.v1);
+        grow(mesh.bounds, tri.v2);
+    }
+    while (int(mesh.levels.size()) < max_levels && mesh.levels.back().size() / 4 >= min_triangles) {
+        vector<Triangle> next;
+        simplify_triangles(mesh.levels.back(), mesh.levels.back().size() / 4, next);
+        if (next.size() * 10 > mesh.levels.back().size() * 9) break;  // Less than 10% removed
+        mesh.levels.push_back(move(next));
+    }
+    mesh.bvhs.resize(mesh.levels.size());
+    mesh.edge_lengths.resize(mesh.levels.size());
+    for (size_t l = 0; l < mesh.levels.size(); l++) {
+        build_triangle_bvh(mesh.bvhs[l], mesh.levels[l]);
+        mesh.edge_lengths[l] = mean_edge_length(mesh.levels[l]);
+    }
+}
+
+// Uniform number in [0, 1) from the bits of a ray, the same for every test of that ray. Neighbouring samples get
+// unrelated values, which dithers the choice between two levels into a blend. Paths draw it once from their camera
+// ray (see RayCone in Scene.h), so their shadow and bounce rays see the same blend.
+inline float lod_sample(const ray& r) {
+    uint32_t bits[6];
+    float f[6] = {r.O.x(), r.O.y(), r.O.z(), r.D.x(), r.D.y(), r.D.z()};
+    memcpy(bits, f, sizeof(bits));
+    uint64_t h = 0x243F6A8885A308D3ull;
+    for (int i = 0; i < 6; i++) {
+        h ^= bits[i];
+        h *= 0x9E3779B97F4A7C15ull;
+        h ^= h >> 32;
+    }
+    return float(uint32_t(h) >> 8) * (1.0f / 16777216.0f);
+}
+
+// Function to pick the level for a footprint of the given world width. Between two levels the coarser one is picked
+// with a probability that grows linearly in log width, u is the uniform number deciding.
+inline int select_lod(const MeshLOD& mesh, float width, float u) {
+    width *= mesh.lod_scale;
+    int last = int(mesh.levels.size()) - 1;
+    if (last <= 0 || width <= mesh.edge_lengths[0]) return 0;
+    int l = 0;
+    while (l < last && mesh.edge_lengths[l + 1] <= width) l++;
+    if (l == last) return last;
+    float frac = logf(width / mesh.edge_lengths[l]) / logf(mesh.edge_lengths[l + 1] / mesh.edge_lengths[l]);
+    return u < frac ? l + 1 : l;
+}
+
+// How a ray picks the level of a mesh: from its footprint, width wide at the origin and growing by spread per unit of
+// distance (see RayCone in Scene.h); both 0 test the full mesh. u decides between two levels, negative values take
+// it from the ray's bits. A level of 0 or more skips the choice, for rays leaving a hit on that mesh.
+struct LODQuery {
+    float width = 0.0f;
+    float spread = 0.0f;
+    float u = -1.0f;
+    int level = -1;
+};
+
+// Function to find the nearest hit of a ray with a mesh beyond t_min and before t, at the level query picks. If
+// hit_level is given the level tested is stored in it, if steps is given the BVH nodes visited are added to it, if
+// tests is given the triangles tested.
+inline bool intersect_mesh(const MeshLOD& mesh, const ray& r, const LODQuery& query, float t_min, float& t, vec3& N,
+                           int* hit_level = nullptr, int* steps = nullptr, int* tests = nullptr) {
+    if (mesh.levels.empty()) return false;
+    float t_near;
+    if (!hit_aabb(mesh.bounds, make_box_query(r), t, t_near)) return false;
+    int level = 0;
+    if (query.level >= 0) {
+        level = query.level < int(mesh.levels.size()) ? query.level : int(mesh.levels.size()) - 1;
+    } else if (query.spread > 0.0f || query.width > 0.0f) {
+        float width = query.width + query.spread * (t_near > 0.0f ? t_near : 0.0f) * r.direction().length();
+        level = select_lod(mesh, width, query.u >= 0.0f ? query.u : lod_sample(r));
+    }
+    if (hit_level) *hit_level = level;
+    const vector<Triangle>& triangles = mesh.levels[level];
+    RayShear shear = make_ray_shear(r.D);
+    int hit_prim = -1;
+    traverse_bvh(mesh.bvhs[level], r, t, [&](int prim, float& t_closest) {
+        if (tests) (*tests)++;
+        float t_tri;
+        if (hit_triangle_watertight(triangles[prim], r, shear, t_closest, t_tri) && t_tri > t_min &&
+            t_tri < t_closest) {
+            t_closest = t_tri;
+            hit_prim = prim;
+            return true;
+        }
+        return false;
+    }, steps);
+    if (hit_prim < 0) return false;
+    N = triangle_normal(triangles[hit_prim]);
+    return true;
+}
+
+#endif // MESH_LOD_H
@@ -0,0 +1,140 @@
+#ifndef MOTION_H
+#define MOTION_H
+
+#include <vector>
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+#include "BVH.h"
+#include "Sphere.h"
+#include "Triangle.h"
+
+using namespace std;
+
+// Motion blur. Moving primitives are given at shutter open (time 0) and shutter close (time 1) and move linearly in
+// between; a ray sees them where they are at its time. Their BVH has the topology of a BVH over the bounds swept
+// across the shutter and keeps every node's bounds at open and at close. A ray tests the node boxes interpolated to
+// its time, which contain the primitives at that time because every corner moves linearly.
+
+inline vec3 lerp(const vec3& a, const vec3& b, float time) {
+    return a + time * (b - a);
+}
+
+// Define the sphere whose center moves from center_open to center_close, the radius stays
+struct MovingSphere {
+    vec3 center_open;
+    vec3 center_close;
+    float radius;
+};
+
+// Define the triangle whose vertices move from open to close
+struct MovingTriangle {
+    Triangle open;
+    Triangle close;
+};
+
+inline Sphere sphere_at(const MovingSphere& s, float time) {
+    return Sphere{lerp(s.center_open, s.center_close, time), s.radius};
+}
+
+inline Triangle triangle_at(const MovingTriangle& tri, float time) {
+    return Triangle{lerp(tri.open.v0, tri.close.v0, time), lerp(tri.open.v1, tri.close.v1, time),
+                    lerp(tri.open.v2, tri.close.v2, time)};
+}
+
+inline AABB sphere_bounds(const Sphere& s) {
+    AABB box;
+    vec3 r(s.radius, s.radius, s.radius);
+    grow(box, s.center - r);
+    grow(box, s.center + r);
+    return box;
+}
+
+inline AABB triangle_bounds(const Triangle& tri) {
+    AABB box;
+    grow(box, tri.v0);
+    grow(box, tri.v1);
+    grow(box, tri.v2);
+    return box;
+}
+
+// Define the motion BVH
+struct MotionBVH {
+    BVH bvh;                    // Node bounds at shutter open
+    vector<AABB> bounds_delta;  // Node bounds at shutter close minus those at open, parallel to bvh.nodes
+};
+
+inline size_t motion_bvh_memory_bytes(const MotionBVH& m) {
+    return bvh_memory_bytes(m.bvh) + m.bounds_delta.size() * sizeof(AABB);
+}
+
+// Function to build a motion BVH from every primitive's bounds at shutter open and close. The SAH splits the swept
+// bounds, then every node's open and close bounds are refit from its primitives.
+inline void build_motion_bvh(MotionBVH& m, const vector<AABB>& open, const vector<AABB>& close,
+                             const BVHBuildOptions& opt = BVHBuildOptions()) {
+    vector<AABB> swept(open.size());
+    for (size_t i = 0; i < open.size(); i++) {
+        swept[i] = open[i];
+        grow(swept[i], close[i]);
+    }
+    build_bvh(m.bvh, swept, opt);
+    vector<AABB> close_bounds(m.bvh.nodes.size());
+    // Children are created after their parent, so a reverse sweep sees them first
+    for (int n = int(m.bvh.nodes.size()) - 1; n >= 0; n--) {
+        BVHNode& node = m.bvh.nodes[n];
+        AABB box_open, box_close;
+        if (node.count > 0) {
+            for (int i = 0; i < node.count; i++) {
+                int prim = m.bvh.prim_indices[node.left_first + i];
+                grow(box_open, open[prim]);
+                grow(box_close, close[prim]);
+            }
+        } else {
+            for (int c = node.left_first; c < node.left_first + 2; c++) {
+                grow(box_open, m.bvh.nodes[c].bounds);
+                grow(box_close, close_bounds[c]);
+            }
+        }
+        node.bounds = box_open;
+        close_bounds[n] = box_close;
+    }
+    m.bounds_delta.resize(close_bounds.size());
+    for (size_t n = 0; n < close_bounds.size(); n++) {
+        m.bounds_delta[n].bmin = close_bounds[n].bmin - m.bvh.nodes[n].bounds.bmin;
+        m.bounds_delta[n].bmax = close_bounds[n].bmax - m.bvh.nodes[n].bounds.bmax;
+    }
+}
+
+inline void build_moving_sphere_bvh(MotionBVH& m, const vector<MovingSphere>& spheres) {
+    vector<AABB> open(spheres.size()), close(spheres.size());
+    for (size_t i = 0; i < spheres.size(); i++) {
+        open[i] = sphere_bounds(sphere_at(spheres[i], 0.0f));
+        close[i] = sphere_bounds(sphere_at(spheres[i], 1.0f));
+    }
+    build_motion_bvh(m, open, close);
+}
+
+inline void build_moving_triangle_bvh(MotionBVH& m, const vector<MovingTriangle>& triangles) {
+    vector<AABB> open(triangles.size()), close(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        open[i] = triangle_bounds(triangles[i].open);
+        close[i] = triangle_bounds(triangles[i].close);
+    }
+    build_motion_bvh(m, open, close);
+}
+
+// traverse_bvh at the ray's time
+template <class HitPrim>
+inline bool traverse_motion_bvh(const MotionBVH& m, const ray& r, float& t_max, HitPrim&& hit_prim, int* steps = nullptr) {
+    float time = r.time;
+    return traverse_bvh_boxes(m.bvh, r, t_max, [&](int node) {
+        const AABB& a = m.bvh.nodes[node].bounds;
+        const AABB& d = m.bounds_delta[node];
+        AABB box;
+        box.bmin = a.bmin + time * d.bmin;
+        box.bmax = a.bmax + time * d.bmax;
+        return box;
+    }, hit_prim, steps);
+}
+
+#endif // MOTION_H
@@ -0,0 +1,145 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <type_traits>
+
+using namespace std;
+
+// Number of worker threads used by the parallel loops
+inline int worker_count() {
+    unsigned n = thread::hardware_concurrency();
+    return n > 0 ? int(n) : 1;
+}
+
+// Run body(begin, end) over [0, count) in chunks of grain items, handed out dynamically to the worker threads
+template <class Body>
+inline void parallel_for(int count, int grain, Body&& body) {
+    if (count <= 0) return;
+    if (grain < 1) grain = 1;
+    int chunks = (count + grain - 1) / grain;
+    int threads = worker_count() < chunks ? worker_count() : chunks;
+    if (threads <= 1) {
+        body(0, count);
+        return;
+    }
+
+    atomic<int> next(0);
+    auto work = [&]() {
+        int chunk;
+        while ((chunk = next.fetch_add(1)) < chunks) {
+            int begin = chunk * grain;
+            int end = begin + grain < count ? begin + grain : count;
+            body(begin, end);
+        }
+    };
+    vector<thread> pool;
+    for (int i = 1; i < threads; i++) pool.emplace_back(work);
+    work();  // The calling thread takes part as well
+    for (auto& t : pool) t.join();
+}
+
+// Run body(chunk) for every chunk in [0, chunks), for passes that keep per-chunk state such as histograms
+template <class Body>
+inline void parallel_for_chunks(int chunks, Body&& body) {
+    parallel_for(chunks, 1, [&](int begin, int end) {
+        for (int c = begin; c < end; c++) body(c);
+    });
+}
+
+// Define the thread pool: workers started once and reused by every run(), for callers that run many parallel
+// loops and should not start threads (and allocate their state) every time. One run() at a time.
+struct ThreadPool {
+    vector<thread> workers;
+    mutex lock;
+    condition_variable wake;  // Workers wait here for the next run
+    condition_variable done;  // run() waits here for the workers to finish
+    uint64_t generation = 0;  // Incremented by every run
+    int busy = 0;             // Workers still in the current run
+    bool stop = false;
+
+    // The current run: body(worker, begin, end) over chunks of grain items of [0, count)
+    void (*invoke)(void*, int, int, int) = nullptr;
+    void* body = nullptr;
+    atomic<int> next{0};
+    int count = 0;
+    int grain = 1;
+    int chunks = 0;
+
+    // threads includes the thread calling run(), so 1 starts no workers
+    explicit ThreadPool(int threads = worker_count()) {
+        for (int w = 1; w < threads; w++) workers.emplace_back([this, w]() { worker_loop(w); });
+    }
+
+    ~ThreadPool() {
+        {
+            lock_guard<mutex> guard(lock);
+            stop = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in a run, the caller included. Worker ids are below it, the caller is 0.
+    int size() const { return int(workers.size()) + 1; }
+
+    void work(int worker) {
+        int chunk;
+        while ((chunk = next.fetch_add(1)) < chunks) {
+            int begin = chunk * grain;
+            int end = begin + grain < count ? begin + grain : count;
+            invoke(body, worker, begin, end);
+        }
+    }
+
+    void worker_loop(int worker) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                unique_lock<mutex> guard(lock);
+                wake.wait(guard, [&]() { return stop || generation != seen; });
+                if (stop) return;
+                seen = generation;
+            }
+            work(worker);
+            lock_guard<mutex> guard(lock);
+            if (--busy == 0) done.notify_one();
+        }
+    }
+
+    // Run body(worker, begin, end) over [0, n) like parallel_for, on the pool's threads. Allocates nothing.
+    template <class Body>
+    void run(int n, int grain_size, Body&& b) {
+        if (n <= 0) return;
+        if (grain_size < 1) grain_size = 1;
+        if (workers.empty() || n <= grain_size) {
+            b(0, 0, n);
+            return;
+        }
+        typedef typename remove_reference<Body>::type BodyType;
+        {
+            lock_guard<mutex> guard(lock);
+            invoke = [](void* f, int worker, int begin, int end) { (*static_cast<BodyType*>(f))(worker, begin, end); };
+            body = (void*)&b;
+            count = n;
+            grain = grain_size;
+            chunks = (n + grain_size - 1) / grain_size;
+            next = 0;
+            busy = int(workers.size());
+            generation++;
+        }
+        wake.notify_all();
+        work(0);
+        unique_lock<mutex> guard(lock);
+        done.wait(guard, [&]() { return busy == 0; });
+    }
+};
+
+#endif // PARALLEL_H
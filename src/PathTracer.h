@@ -0,0 +1,209 @@
+#ifndef PATH_TRACER_H
+#define PATH_TRACER_H
+
+#include <cmath>
+#include <cfloat>
+#include "vec3.h"
+#include "ray.h"
+#include "Sphere.h"
+#include "Scene.h"
+#include "Material.h"
+#include "Random.h"
+#include "Image.h"
+#include "Trace.h"
+
+using namespace std;
+
+// How the path tracer finds the spherical lights
+enum LightSampling {
+    SAMPLE_BSDF,    // BSDF sampling only, paths hit the lights by chance (naive path tracing)
+    SAMPLE_LIGHTS,  // Next-event estimation only, lights hit after a diffuse bounce are ignored
+    SAMPLE_MIS      // Both, combined with the power heuristic
+};
+
+struct PathSettings : TraceSettings {
+    LightSampling sampling = SAMPLE_MIS;
+};
+
+// Emitted radiance of a spherical light. Far away it gives the same irradiance as a point light of the same
+// intensity, so shrinking the radius converges to the point light.
+inline vec3 light_radiance(const Light& light) {
+    return light.intensity / (float(M_PI) * light.radius * light.radius);
+}
+
+// 1 - cos of the half-angle of the cone a sphere subtends, sin2 = radius^2 / distance^2.
+// Written without the cancellation of 1 - sqrt(1 - sin2), which rounds to 0 for far away points.
+inline float one_minus_cos_cone(float sin2) {
+    return sin2 / (1.0f + sqrtf(1.0f - sin2));
+}
+
+// Solid angle pdf of sample_light towards the light from p, 0 if p is inside the light
+inline float light_cone_pdf(const Light& light, const vec3& p) {
+    float d2 = (light.position - p).squared_length();
+    float r2 = light.radius * light.radius;
+    if (d2 <= r2) return 0.0f;
+    return 1.0f / (2.0f * float(M_PI) * one_minus_cos_cone(r2 / d2));
+}
+
+// Pick a direction from p towards the light, uniform in the cone the sphere subtends.
+// Writes the unit direction, the distance to the light's surface and the solid angle pdf, which is 0 for point
+// lights as their direction is fixed. Returns false if p is inside the light.
+inline bool sample_light(const Light& light, const vec3& p, float u1, float u2, vec3& dir, float& dist, float& pdf) {
+    vec3 to_center = light.position - p;
+    float d2 = to_center.squared_length();
+    float d = sqrtf(d2);
+    if (light.radius <= 0.0f) {
+        dir = to_center / d;
+        dist = d;
+        pdf = 0.0f;
+        return d > 0.0f;
+    }
+    float r2 = light.radius * light.radius;
+    if (d2 <= r2) return false;
+
+    float cone = one_minus_cos_cone(r2 / d2);
+    float cos_theta = 1.0f - u1 * cone;
+    float sin_theta = sqrtf(fmaxf(0.0f, 1.0f - cos_theta * cos_theta));
+    float phi = 2.0f * float(M_PI) * u2;
+    vec3 w = to_center / d;
+    vec3 b1, b2;
+    make_basis(w, b1, b2);
+    dir = cos_theta * w + sin_theta * (cosf(phi) * b1 + sinf(phi) * b2);
+
+    // Nearest intersection of the sampled direction with the sphere
+    float b = d * cos_theta;
+    dist = b - sqrtf(fmaxf(0.0f, r2 - (d2 - b * b)));
+    pdf = 1.0f / (2.0f * float(M_PI) * cone);
+    return true;
+}
+
+// Function to find the nearest spherical light along a ray before t_max. Returns its index or -1.
+inline int hit_lights(const Scene& scene, const ray& r, float& t_max) {
+    int hit = -1;
+    for (size_t i = 0; i < scene.lights.size(); i++) {
+        const Light& light = scene.lights[i];
+        if (light.radius <= 0.0f) continue;
+        float t;
+        vec3 N;
+        if (hit_sphere(Sphere{light.position, light.radius}, r, t, N) && t > 0.0f && t < t_max) {
+            t_max = t;
+            hit = int(i);
+        }
+    }
+    return hit;
+}
+
+// Veach's power heuristic with beta = 2: weight of the strategy with pdf_a
+inline float power_heuristic(float pdf_a, float pdf_b) {
+    float a = pdf_a * pdf_a;
+    float b = pdf_b * pdf_b;
+    return a + b > 0.0f ? a / (a + b) : 0.0f;
+}
+
+// Next-event estimation at a diffuse hit, N its normal facing the ray: one shadow ray per light. Point lights can
+// only be found this way, spherical lights are skipped when only the BSDF is sampled.
+inline vec3 sample_direct(const Scene& scene, const HitRecord& rec, const vec3& N, const Material& m,
+                          const PathSettings& settings, Rng& rng, RayCounters& counters, const RayCone& cone = RayCone()) {
+    float diffuse = 1.0f - m.metallic;  // The metallic part has no density to sample lights for
+    if (diffuse <= 0.0f) return vec3(0, 0, 0);
+    vec3 brdf = diffuse * m.albedo / float(M_PI);
+    vec3 sum(0, 0, 0);
+    for (size_t i = 0; i < scene.lights.size(); i++) {
+        const Light& light = scene.lights[i];
+        if (light.radius > 0.0f && settings.sampling == SAMPLE_BSDF) continue;
+        float u1 = rng.next();
+        float u2 = rng.next();
+        vec3 dir;
+        float dist, pdf;
+        if (!sample_light(light, rec.p, u1, u2, dir, dist, pdf)) continue;
+        float cos_theta = dot(N, dir);
+        if (cos_theta <= 0.0f) continue;
+
+        // Another light in front of the sample blocks it, the sampled light itself is where the ray ends
+        counters.shadow_rays++;
+        ray shadow = spawn_ray(rec, dir);
+        float t_light = FLT_MAX;
+        int nearest = hit_lights(scene, shadow, t_light);
+        if ((nearest >= 0 && nearest != int(i) && t_light < dist) || occluded(scene, shadow, dist, cone)) continue;
+
+        if (pdf == 0.0f) {
+            sum += brdf * light.intensity * (cos_theta / (dist * dist));  // Point light
+        } else {
+            float w = settings.sampling == SAMPLE_MIS ? power_heuristic(pdf, diffuse * cos_theta / float(M_PI)) : 1.0f;
+            sum += brdf * light_radiance(light) * (cos_theta * w / pdf);
+        }
+    }
+    return sum;
+}
+
+// Function to estimate the radiance along a camera ray with a Monte Carlo path. max_depth counts path segments as
+// in trace_path; lights are only sampled from vertices the path could continue from, so every LightSampling mode
+// converges to the same image. Glossy, dielectric and metallic bounces are treated like mirrors: their lobes have no
+// density to weight against, so emission after them always counts in full. fp is the camera ray's footprint.
+template <class Footprint>
+inline vec3 path_radiance(const Scene& scene, const ray& camera_ray, const Footprint& camera_fp, const PathSettings& settings,
+                          Rng& rng, RayCounters& counters) {
+    vec3 radiance(0, 0, 0);
+    vec3 throughput(1, 1, 1);
+    ray r = camera_ray;
+    Footprint fp = camera_fp;
+    bool specular = true;   // No light sampling at the previous vertex (camera or non-diffuse bounce)
+    float bsdf_pdf = 0.0f;  // Solid angle pdf of the previous diffuse bounce
+    vec3 prev_p(0, 0, 0);
+    int max_depth = clamp_depth(settings.max_depth);
+
+    for (int depth = 0; depth < max_depth; depth++) {
+        counters.rays++;
+        PROFILE_COUNT(PROF_RAYS, 1);
+        counters.rays_per_depth[depth]++;
+        HitRecord rec;
+        RayCone cone = footprint_cone(fp, r);
+        bool hit = intersect_scene(scene, r, rec, FLT_MAX, cone);
+        float t_light = hit ? rec.t : FLT_MAX;
+        int light = hit_lights(scene, r, t_light);
+        if (light >= 0) {
+            float w = 1.0f;
+            if (!specular && settings.sampling == SAMPLE_LIGHTS) w = 0.0f;
+            if (!specular && settings.sampling == SAMPLE_MIS)
+                w = power_heuristic(bsdf_pdf, light_cone_pdf(scene.lights[light], prev_p));
+            radiance += throughput * light_radiance(scene.lights[light]) * w;
+            break;
+        }
+        if (!hit) {
+            radiance += throughput * sky_color(r);
+            break;
+        }
+        Material m = material_of(scene, rec.kind, rec.index);
+        m.albedo = surface_albedo(scene, rec, m, r, fp);
+        radiance += throughput * m.emission;  // Emissive surfaces are only found by BSDF sampling
+        if (depth + 1 >= max_depth) break;
+
+        bool front_face = dot(rec.N, r.direction()) < 0;
+        vec3 N = front_face ? rec.N : -rec.N;
+        if (m.type == MAT_DIFFUSE)
+            radiance += throughput * sample_direct(scene, rec, N, m, settings, rng, counters, cone_at_hit(cone, r, rec));
+
+        vec3 dir, weight;
+        if (!scatter(m, r.direction(), N, front_face, rng, dir, weight, &specular)) break;
+        // Cosine sampling of the diffuse part, dir is unit length
+        if (!specular) bsdf_pdf = (1.0f - m.metallic) * fmaxf(dot(N, dir), 0.0f) / float(M_PI);
+
+        throughput *= weight;
+        float survive = survival_probability(throughput, depth + 1, settings);
+        if (survive < 1.0f && rng.next() >= survive) break;
+        throughput /= survive;
+        prev_p = rec.p;
+        fp = footprint_scatter(fp, scene, r, rec, N, front_face, m, dir);
+        r = spawn_ray(rec, dir);
+    }
+    return radiance;
+}
+
+template <class Footprint = RayCone>
+inline RayCounters render_path_traced(const Scene& scene, const Camera& camera, const PathSettings& settings, Framebuffer& fb) {
+    return render_pixels<Footprint>(camera, settings, fb, [&](const ray& r, const Footprint& fp, Rng& rng, RayCounters& counters) {
+        return path_radiance(scene, r, fp, settings, rng, counters);
+    });
+}
+
+#endif // PATH_TRACER_H
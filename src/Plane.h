@@ -11,11 +11,11 @@ struct Plane {
 };
 
 // Function to check if a ray intersects with a plane
-bool hit_plane(const Plane& plane, const ray& r, float& t, vec3& N) {
+inline bool hit_plane(const Plane& plane, const ray& r, float& t, vec3& N) {
     float denom = dot(plane.normal, r.direction());  // Compute the dot product of the plane normal and the ray direction
-    if (abs(denom) > 0.0001) {  // Check if the ray is not parallel to the plane
+    if (denom != 0) {  // Check if the ray is not parallel to the plane
         t = dot(plane.point - r.origin(), plane.normal) / denom;  // Compute the intersection distance
-        if (t >= 0) {  // Check if the intersection is in front of the ray origin
+        if (t > 0) {  // Check if the intersection is in front of the ray origin, which is off the surface
             N = plane.normal;  // Set the normal at the intersection point
             return true;  // Return true if there is an intersection
         }
@@ -0,0 +1,210 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+// Scoped timers and counters for the hot paths, compiled in only when RT_PROFILE is defined (the RT_PROFILE CMake
+// option). Without it every macro expands to nothing.
+//
+// PROFILE_SCOPE("name")      times the enclosing scope and records it as an event of the Chrome trace
+// PROFILE_COUNT(counter, n)  adds n to one of the ProfileCounter totals
+//
+// A scope costs two clock reads and a buffer append, so scopes go around rows and stages, never single rays; per-ray
+// work is measured with counters, summed locally where a loop would add to them many times (see traverse_bvh_boxes).
+//
+// Every thread records into its own buffer, so the macros take no locks. write_chrome_trace() writes the events as
+// Chrome trace-event JSON (chrome://tracing, Perfetto) with the per-thread totals as counter events, and
+// print_profile() prints the totals.
+
+#ifdef RT_PROFILE
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <ostream>
+
+using namespace std;
+
+enum ProfileCounter {
+    PROF_RAYS,            // Path segments traced
+    PROF_SHADOW_RAYS,     // Shadow rays traced
+    PROF_NODES,           // BVH nodes visited
+    PROF_PRIMITIVES,      // Primitives tested against a ray
+    PROF_COUNTER_COUNT
+};
+
+inline const char* profile_counter_name(int c) {
+    static const char* names[PROF_COUNTER_COUNT] = {"rays", "shadow rays", "BVH nodes", "primitive tests"};
+    return names[c];
+}
+
+// One PROFILE_SCOPE entry, times in nanoseconds since the profile started
+struct ProfileEvent {
+    int stage;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Running total of one stage on one thread
+struct ProfileTotal {
+    uint64_t nanoseconds = 0;
+    uint64_t calls = 0;
+};
+
+// What one thread has recorded
+struct ProfileThread {
+    int id = 0;
+    vector<ProfileEvent> events;
+    vector<ProfileTotal> totals;  // Indexed by stage id
+    uint64_t counters[PROF_COUNTER_COUNT] = {};
+};
+
+// The stage names and every thread's buffer. Buffers outlive their threads, parallel_for starts new ones per call.
+struct Profile {
+    mutex lock;
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    vector<string> stages;
+    vector<unique_ptr<ProfileThread>> threads;
+};
+
+inline Profile& profile() {
+    static Profile p;
+    return p;
+}
+
+inline uint64_t profile_now() {
+    return uint64_t(chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - profile().start).count());
+}
+
+// Id of a stage name, the same for every call with the same name
+inline int profile_stage(const char* name) {
+    Profile& p = profile();
+    lock_guard<mutex> guard(p.lock);
+    for (size_t i = 0; i < p.stages.size(); i++) {
+        if (p.stages[i] == name) return int(i);
+    }
+    p.stages.push_back(name);
+    return int(p.stages.size()) - 1;
+}
+
+inline ProfileThread& profile_thread() {
+    thread_local ProfileThread* t = nullptr;
+    if (!t) {
+        Profile& p = profile();
+        lock_guard<mutex> guard(p.lock);
+        p.threads.emplace_back(new ProfileThread());
+        t = p.threads.back().get();
+        t->id = int(p.threads.size());
+    }
+    return *t;
+}
+
+// Times its scope into the stage's total and the trace
+struct ProfileScope {
+    int stage;
+    uint64_t begin;
+
+    explicit ProfileScope(int s) : stage(s), begin(profile_now()) {}
+    ~ProfileScope() {
+        uint64_t end = profile_now();
+        ProfileThread& t = profile_thread();
+        if (int(t.totals.size()) <= stage) t.totals.resize(stage + 1);
+        t.totals[stage].nanoseconds += end - begin;
+        t.totals[stage].calls++;
+        t.events.push_back({stage, begin, end});
+    }
+};
+
+// Escape a name for a JSON string
+inline string profile_json_string(const string& s) {
+    string out = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') out += '\\';
+        out += c;
+    }
+    return out + "\"";
+}
+
+// Function to write everything recorded so far as Chrome trace-event JSON. Returns false if the file cannot be
+// written.
+inline bool write_chrome_trace(const string& path) {
+    Profile& p = profile();
+    lock_guard<mutex> guard(p.lock);
+    ofstream file(path);
+    if (!file) return false;
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+    bool first = true;
+    char line[256];
+    for (const auto& t : p.threads) {
+        uint64_t last = 0;
+        for (const ProfileEvent& e : t->events) {
+            snprintf(line, sizeof(line),
+                     "%s{\"name\": %s, \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+                     first ? "" : ",\n", profile_json_string(p.stages[e.stage]).c_str(), t->id, e.begin * 1e-3,
+                     (e.end - e.begin) * 1e-3);
+            file << line;
+            first = false;
+            if (e.end > last) last = e.end;
+        }
+        // The thread's counters and stage totals, as counter events at its last event
+        file << (first ? "" : ",\n") << "{\"name\": \"thread " << t->id << " totals\", \"ph\": \"C\", \"pid\": 1, "
+             << "\"tid\": " << t->id << ", \"ts\": " << last * 1e-3 << ", \"args\": {";
+        first = false;
+        for (int c = 0; c < PROF_COUNTER_COUNT; c++) {
+            file << (c ? ", " : "") << profile_json_string(profile_counter_name(c)) << ": " << t->counters[c];
+        }
+        for (size_t s = 0; s < t->totals.size(); s++) {
+            if (t->totals[s].calls == 0) continue;
+            file << ", " << profile_json_string(p.stages[s] + " ms") << ": " << t->totals[s].nanoseconds * 1e-6;
+        }
+        file << "}}";
+    }
+    file << "\n]}\n";
+    return bool(file);
+}
+
+// Function to print the stage times and counters summed over all threads
+inline void print_profile(ostream& os) {
+    Profile& p = profile();
+    lock_guard<mutex> guard(p.lock);
+    vector<ProfileTotal> totals(p.stages.size());
+    uint64_t counters[PROF_COUNTER_COUNT] = {};
+    for (const auto& t : p.threads) {
+        for (size_t s = 0; s < t->totals.size(); s++) {
+            totals[s].nanoseconds += t->totals[s].nanoseconds;
+            totals[s].calls += t->totals[s].calls;
+        }
+        for (int c = 0; c < PROF_COUNTER_COUNT; c++) counters[c] += t->counters[c];
+    }
+    char line[256];
+    os << "profile over " << p.threads.size() << " threads:\n";
+    for (size_t s = 0; s < totals.size(); s++) {
+        snprintf(line, sizeof(line), "  %-24s %10.2f ms in %llu calls\n", p.stages[s].c_str(),
+                 totals[s].nanoseconds * 1e-6, (unsigned long long)totals[s].calls);
+        os << line;
+    }
+    for (int c = 0; c < PROF_COUNTER_COUNT; c++) {
+        snprintf(line, sizeof(line), "  %-24s %12llu\n", profile_counter_name(c), (unsigned long long)counters[c]);
+        os << line;
+    }
+}
+
+#define PROFILE_CONCAT2(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT2(a, b)
+#define PROFILE_SCOPE(name)                                                          \
+    static const int PROFILE_CONCAT(profile_stage_, __LINE__) = profile_stage(name); \
+    ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(PROFILE_CONCAT(profile_stage_, __LINE__))
+#define PROFILE_COUNT(counter, n) (profile_thread().counters[counter] += uint64_t(n))
+
+#else
+
+// The count is still evaluated, so locals kept only for it are not unused; without side effects it compiles away
+#define PROFILE_SCOPE(name)
+#define PROFILE_COUNT(counter, n) ((void)(n))
+
+#endif // RT_PROFILE
+
+#endif // PROFILE_H
@@ -0,0 +1,51 @@
+#ifndef RANDOM_H
+#define RANDOM_H
+
+#include <cstdint>
+#include <cmath>
+#include "vec3.h"
+
+// Small per-thread random number generator (PCG32), a drop-in for drand48() inside parallel loops
+struct Rng {
+    uint64_t state;
+
+    explicit Rng(uint64_t seed = 1, uint64_t stream = 0) {
+        state = 0;
+        next_uint();
+        state += seed + (stream << 32) + stream * 0x9E3779B97F4A7C15ull;
+        next_uint();
+    }
+
+    inline uint32_t next_uint() {
+        uint64_t old = state;
+        state = old * 6364136223846793005ull + 1442695040888963407ull;
+        uint32_t xorshifted = uint32_t(((old >> 18u) ^ old) >> 27u);
+        uint32_t rot = uint32_t(old >> 59u);
+        return (xorshifted >> rot) | (xorshifted << ((32 - rot) & 31));
+    }
+
+    // Uniform float in [0, 1)
+    inline float next() {
+        return float(next_uint() >> 8) * (1.0f / 16777216.0f);
+    }
+};
+
+// Build an orthonormal basis around the unit vector n (Duff et al. 2017)
+inline void make_basis(const vec3& n, vec3& b1, vec3& b2) {
+    float sign = copysignf(1.0f, n.z());
+    float a = -1.0f / (sign + n.z());
+    float b = n.x() * n.y() * a;
+    b1 = vec3(1.0f + sign * n.x() * n.x() * a, sign * b, -sign * n.x());
+    b2 = vec3(b, sign + n.y() * n.y() * a, -n.y());
+}
+
+// Cosine-weighted direction on the hemisphere around the unit normal N (pdf = cos / pi)
+inline vec3 sample_cosine_hemisphere(const vec3& N, float u1, float u2) {
+    float r = sqrtf(u1);
+    float phi = 2.0f * float(M_PI) * u2;
+    vec3 b1, b2;
+    make_basis(N, b1, b2);
+    return r * cosf(phi) * b1 + r * sinf(phi) * b2 + sqrtf(1.0f - u1 > 0.0f ? 1.0f - u1 : 0.0f) * N;
+}
+
+#endif // RANDOM_H
@@ -0,0 +1,145 @@
+#ifndef RAY_DIFFERENTIAL_H
+#define RAY_DIFFERENTIAL_H
+
+#include <cmath>
+#include "vec3.h"
+#include "ray.h"
+#include "Scene.h"
+#include "Material.h"
+
+using namespace std;
+
+// Pixel footprints carried along the tracing path. trace_path, path_radiance and the renderers take the footprint
+// type as a template parameter:
+//   NoFootprint      nothing is tracked and textures are sampled at their finest level, at no cost
+//   RayCone          isotropic cone, two floats (Scene.h)
+//   RayDifferential  ray differentials (Igehy 1999), exact through mirror reflection and refraction
+// Every type provides footprint_width, the world-space width of the footprint on the surface at a hit,
+// footprint_scatter, the footprint of the bounce ray leaving that hit, and footprint_cone, the cone that picks mesh
+// levels of detail.
+
+struct NoFootprint {};
+
+// Derivatives of a ray's origin and direction with respect to the image x and y in pixels. The direction
+// derivatives belong to the ray's direction as stored, which need not be unit length. The mesh level choice is
+// carried along as in RayCone.
+struct RayDifferential {
+    vec3 dOdx = vec3(0, 0, 0);
+    vec3 dOdy = vec3(0, 0, 0);
+    vec3 dDdx = vec3(0, 0, 0);
+    vec3 dDdy = vec3(0, 0, 0);
+    float lod_u = -1.0f;
+    int lod_mesh = -1;
+    int lod_level = 0;
+};
+
+// Without a footprint meshes are traced at full resolution
+inline RayCone footprint_cone(const NoFootprint&, const ray&) {
+    return RayCone();
+}
+
+inline const RayCone& footprint_cone(const RayCone& cone, const ray&) {
+    return cone;
+}
+
+inline float footprint_width(const NoFootprint&, const ray&, const HitRecord&) {
+    return 0.0f;
+}
+
+inline NoFootprint footprint_scatter(const NoFootprint& fp, const Scene&, const ray&, const HitRecord&, const vec3&,
+                                     bool, const Material&, const vec3&) {
+    return fp;
+}
+
+// The cone keeps its spread through every bounce
+inline RayCone footprint_scatter(const RayCone& cone, const Scene&, const ray& r, const HitRecord& rec, const vec3&,
+                                 bool, const Material&, const vec3&) {
+    return cone_at_hit(cone, r, rec);
+}
+
+// Function to transfer the origin differential to the hit point, the surface's tangent plane: dP = dO + t dD + dt D
+// with dt chosen to keep dP in the plane. Grazing hits are limited to a stretch of 10, like the cone's 1 / cos.
+inline vec3 transfer_differential(const vec3& dO, const vec3& dD, const ray& r, const HitRecord& rec) {
+    vec3 dp = dO + rec.t * dD;
+    const vec3& D = r.direction();
+    float dn = dot(D, rec.N);
+    float limit = 0.1f * D.length();
+    if (fabsf(dn) < limit) dn = dn < 0.0f ? -limit : limit;
+    return dp - (dot(dp, rec.N) / dn) * D;
+}
+
+// Derivative of the outward normal along the surface for the point derivative dP, zero for flat primitives
+inline vec3 normal_differential(const Scene& scene, const HitRecord& rec, const vec3& dP) {
+    if (rec.kind == PRIM_SPHERE) return dP / scene.spheres[rec.index].radius;
+    if (rec.kind == PRIM_MOVING_SPHERE) return dP / scene.moving_spheres[rec.index].radius;
+    return vec3(0, 0, 0);
+}
+
+// Isotropic cone of a differential: the larger of the two origin and direction derivatives
+inline RayCone footprint_cone(const RayDifferential& d, const ray& r) {
+    RayCone cone;
+    float wx = d.dOdx.length(), wy = d.dOdy.length();
+    float sx = d.dDdx.length(), sy = d.dDdy.length();
+    cone.width = wx > wy ? wx : wy;
+    cone.spread = (sx > sy ? sx : sy) / r.direction().length();
+    cone.lod_u = d.lod_u;
+    cone.lod_mesh = d.lod_mesh;
+    cone.lod_level = d.lod_level;
+    return cone;
+}
+
+inline float footprint_width(const RayDifferential& d, const ray& r, const HitRecord& rec) {
+    float wx = transfer_differential(d.dOdx, d.dDdx, r, rec).length();
+    float wy = transfer_differential(d.dOdy, d.dDdy, r, rec).length();
+    return wx > wy ? wx : wy;
+}
+
+// Derivative of the unit vector D / |D| for the derivative dD of D
+inline vec3 unit_differential(const vec3& D, const vec3& dD) {
+    float len = D.length();
+    vec3 n = D / len;
+    return (dD - dot(n, dD) * n) / len;
+}
+
+// Function to propagate one differential (dO, dD) through the bounce at rec. N faces the incoming ray. Rays leaving
+// on the incoming side use the mirror reflection derivative, also for glossy and diffuse lobes where it is an
+// approximation; rays through the surface use the refraction derivative.
+inline void scatter_differential(vec3& dO, vec3& dD, const Scene& scene, const ray& r, const HitRecord& rec,
+                                 const vec3& N, bool front_face, const Material& m, const vec3& dir) {
+    vec3 dP = transfer_differential(dO, dD, r, rec);
+    vec3 dN = normal_differential(scene, rec, dP);
+    if (dot(N, rec.N) < 0.0f) dN = -dN;
+    vec3 d = unit_vector(r.direction());
+    vec3 dd = unit_differential(r.direction(), dD);
+    float dn = dot(d, N);
+    float ddn = dot(dd, N) + dot(d, dN);  // Derivative of d . N
+    float len = dir.length();
+    vec3 out;
+    if (dot(dir, N) >= 0.0f) {
+        // R = d - 2 (d . N) N
+        out = dd - 2.0f * (dn * dN + ddn * N);
+    } else {
+        // T = eta d - mu N with mu = eta (d . N) - T . N
+        float eta = front_face ? 1.0f / m.ior : m.ior;
+        vec3 T = dir / len;
+        float tn = dot(T, N);
+        float mu = eta * dn - tn;
+        float dmu = (eta - eta * eta * dn / (tn < -1e-6f ? tn : -1e-6f)) * ddn;
+        out = eta * dd - (mu * dN + dmu * N);
+    }
+    dO = dP;
+    dD = len * out;
+}
+
+inline RayDifferential footprint_scatter(const RayDifferential& diff, const Scene& scene, const ray& r,
+                                         const HitRecord& rec, const vec3& N, bool front_face, const Material& m,
+                                         const vec3& dir) {
+    RayDifferential next = diff;
+    scatter_differential(next.dOdx, next.dDdx, scene, r, rec, N, front_face, m, dir);
+    scatter_differential(next.dOdy, next.dDdy, scene, r, rec, N, front_face, m, dir);
+    next.lod_mesh = rec.kind == PRIM_MESH ? rec.index : -1;
+    next.lod_level = rec.kind == PRIM_MESH ? rec.level : 0;
+    return next;
+}
+
+#endif // RAY_DIFFERENTIAL_H
@@ -0,0 +1,67 @@
+#ifndef RENDER_CONTEXT_H
+#define RENDER_CONTEXT_H
+
+#include <vector>
+#include <cstdint>
+#include "vec3.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+using namespace std;
+
+// Rendering as a library call for processes that render many frames. The context owns the scene with its BVHs, the
+// framebuffer, the thread pool and every thread's camera ray batch, all sized up front, so render() allocates
+// nothing once the first frame at a given size and sample count is done. The frames are those of render_recursive.
+struct RenderContext {
+    Scene scene;
+    Framebuffer frame;           // Last rendered frame, linear color
+    ThreadPool pool;
+    vector<CameraRays> rays;     // Camera ray batch of every pool thread
+    vector<RayCounters> counts;  // Rays traced by every pool thread in the last frame
+
+    RenderContext(const Scene& s, int width, int height, int threads = worker_count())
+        : scene(s), pool(threads), rays(pool.size()), counts(pool.size()) {
+        build_scene_bvh(scene);
+        resize(width, height);
+    }
+
+    // Function to change the frame size, which allocates
+    void resize(int width, int height) {
+        frame = Framebuffer(width, height);
+    }
+
+    // Function to render a frame seen by camera, whose pixel size is taken from the context. out, if given, receives
+    // the frame as 8-bit RGB, rows top to bottom as in a PPM file (width * height * 3 bytes).
+    RayCounters render(const Camera& camera, const TraceSettings& settings, uint8_t* out = nullptr) {
+        Camera cam = camera;
+        cam.width = frame.width;
+        cam.height = frame.height;
+        int batch = frame.width * settings.samples_per_pixel;
+        for (size_t w = 0; w < rays.size(); w++) {
+            rays[w].resize(batch);  // Grows only the first time a larger batch is asked for
+            counts[w] = RayCounters();
+        }
+        pool.run(frame.height, 1, [&](int worker, int begin, int end) {
+            for (int j = begin; j < end; j++) {
+                render_row<RayCone>(cam, settings, j, rays[worker], frame,
+                                    [&](const ray& r, const RayCone& cone, Rng& rng, RayCounters& counters) {
+                                        return trace_path(scene, r, cone, settings, rng, counters);
+                                    },
+                                    counts[worker]);
+            }
+        });
+        if (out) {
+            for (size_t p = 0; p < frame.pixels.size(); p++) {
+                for (int c = 0; c < 3; c++) out[3 * p + c] = uint8_t(to_byte(frame.pixels[p][c]));
+            }
+        }
+        RayCounters total;
+        for (const RayCounters& c : counts) total.add(c);
+        return total;
+    }
+};
+
+#endif // RENDER_CONTEXT_H
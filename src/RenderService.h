@@ -0,0 +1,430 @@
+#ifndef RENDER_SERVICE_H
+#define RENDER_SERVICE_H
+
+#include <vector>
+#include <string>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <sstream>
+#include <cstdint>
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "vec3.h"
+#include "Scene.h"
+#include "SceneFile.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Trace.h"
+#include "TileCache.h"
+
+using namespace std;
+
+// Render jobs of the render service (src/service/render_service.cpp): their one-line text form, the cache that
+// keeps scenes and their BVHs resident between jobs, tile rendering and the queue that hands tiles to the workers.
+//
+// Protocol over a stream socket, one request per line:
+//   render <id> <scene path> <from x y z> <at x y z> <up x y z> <vfov> <width> <height> <spp> <x0> <y0> <x1> <y1>
+// renders pixels [x0, x1) x [y0, y1) of the width x height image, rows counted from the top. The replies are
+//   tile <id> <x> <y> <w> <h>     followed by w * h * 3 bytes of RGB, rows top to bottom, as tiles complete
+//   done <id> <rays> <ms> <cached tiles>   after the job's last tile
+//   error <id> <message>          if the job cannot be run
+//   stats
+// replies with the tile cache's counts (see TileCacheStats):
+//   stats <lookups> <memory hits> <disk hits> <hit rate> <bytes saved> <bytes in memory>
+
+const int SERVICE_TILE_SIZE = 32;
+
+// Pixel rectangle [x0, x1) x [y0, y1), rows counted from the top
+struct TileRect {
+    int x0, y0, x1, y1;
+};
+
+// Define a render job as a client submits it
+struct RenderJob {
+    string id;  // Chosen by the client, names the job in the replies
+    string scene_path;
+    vec3 from, at, up;
+    float vfov = 50.0f;
+    int width = 0;  // Size of the whole image
+    int height = 0;
+    int spp = 1;
+    TileRect region = {0, 0, 0, 0};  // Part of the image to render
+};
+
+inline string format_job(const RenderJob& job) {
+    ostringstream os;
+    os.precision(9);  // Enough digits to round-trip a float
+    os << "render " << job.id << " " << job.scene_path << " " << job.from << " " << job.at << " " << job.up << " "
+       << job.vfov << " " << job.width << " " << job.height << " " << job.spp << " " << job.region.x0 << " "
+       << job.region.y0 << " " << job.region.x1 << " " << job.region.y1;
+    return os.str();
+}
+
+// Function to parse a job line. Returns false with error set if it is malformed or its numbers are out of range.
+inline bool parse_job(const string& line, RenderJob& job, string& error) {
+    istringstream in(line);
+    string command;
+    TileRect& r = job.region;
+    if (!(in >> command >> job.id) || command != "render") {
+        error = "expected render <id> ...";
+        return false;
+    }
+    if (!(in >> job.scene_path >> job.from >> job.at >> job.up >> job.vfov >> job.width >> job.height >> job.spp >>
+          r.x0 >> r.y0 >> r.x1 >> r.y1)) {
+        error = "malformed job";
+        return false;
+    }
+    if (job.width <= 0 || job.height <= 0 || job.spp < 1 || r.x0 < 0 || r.y0 < 0 || r.x1 > job.width ||
+        r.y1 > job.height || r.x0 >= r.x1 || r.y0 >= r.y1) {
+        error = "image size, samples or region out of range";
+        return false;
+    }
+    return true;
+}
+
+// Function to split a region into tiles of at most size x size pixels, in rows from the top left
+inline vector<TileRect> split_tiles(const TileRect& region, int size) {
+    vector<TileRect> tiles;
+    for (int y = region.y0; y < region.y1; y += size) {
+        for (int x = region.x0; x < region.x1; x += size) {
+            tiles.push_back({x, y, min(x + size, region.x1), min(y + size, region.y1)});
+        }
+    }
+    return tiles;
+}
+
+// Function to render a tile of the image camera sees into rgb (8-bit, rows top to bottom). rays and row are
+// scratch space that keeps its size between tiles. Every pixel row of the tile is a span of render_span, so tiles
+// come out the same whichever worker renders them.
+inline RayCounters render_tile(const Scene& scene, const Camera& camera, const TraceSettings& settings,
+                               const TileRect& tile, CameraRays& rays, vector<vec3>& row, vector<uint8_t>& rgb) {
+    RayCounters counters;
+    int w = tile.x1 - tile.x0;
+    rays.resize(w * settings.samples_per_pixel);
+    row.resize(w);
+    rgb.resize(size_t(w) * (tile.y1 - tile.y0) * 3);
+    auto radiance = [&](const ray& r, const RayCone& cone, Rng& rng, RayCounters& c) {
+        return trace_path(scene, r, cone, settings, rng, c);
+    };
+    for (int y = tile.y0; y < tile.y1; y++) {
+        render_span<RayCone>(camera, settings, camera.height - 1 - y, tile.x0, tile.x1, rays, row.data(), radiance,
+                             counters);
+        uint8_t* out = &rgb[size_t(y - tile.y0) * w * 3];
+        for (int i = 0; i < w; i++) {
+            for (int c = 0; c < 3; c++) out[3 * i + c] = uint8_t(to_byte(row[i][c]));
+        }
+    }
+    return counters;
+}
+
+// A loaded scene file
+struct CachedScene {
+    shared_ptr<const Scene> scene;
+    uint64_t content_hash = 0;  // Of the file's bytes, the scene's part of the tile keys
+    int64_t modified = 0;       // Modification time in nanoseconds and size the file had when it was loaded
+    int64_t size = 0;
+};
+
+// Define the scene cache: every scene file is loaded and its BVHs built on first use, then shared by all jobs. A
+// file that has changed since is loaded again.
+struct SceneCache {
+    mutex lock;
+    map<string, CachedScene> scenes;
+
+    // Function to get a scene, loading it if needed. Returns false with error set if it cannot be loaded.
+    bool get(const string& path, CachedScene& out, string& error) {
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0) {
+            error = "cannot open " + path;
+            return false;
+        }
+        int64_t modified = int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        {
+            lock_guard<mutex> guard(lock);
+            auto it = scenes.find(path);
+            if (it != scenes.end() && it->second.modified == modified && it->second.size == int64_t(st.st_size)) {
+                out = it->second;
+                return true;
+            }
+        }
+        // Loaded without the lock so other jobs keep going
+        CachedScene cached;
+        cached.modified = modified;
+        cached.size = int64_t(st.st_size);
+        // Parsed from the bytes that are hashed, so a file rewritten meanwhile cannot be cached under the old key
+        ifstream file(path, ios::in | ios::binary);
+        if (!file) {
+            error = "cannot open " + path;
+            return false;
+        }
+        string bytes((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+        ContentHash hash;
+        hash.add(bytes);
+        cached.content_hash = hash.value;
+        shared_ptr<Scene> scene(new Scene());
+        istringstream in(bytes);
+        if (!load_scene(in, path, *scene, error)) return false;
+        build_scene_bvh(*scene);
+        cached.scene = scene;
+        lock_guard<mutex> guard(lock);
+        scenes[path] = cached;
+        out = cached;
+        return true;
+    }
+};
+
+// Define a client connection. Replies from the workers are written whole under write_lock; once a write fails the
+// client is closed and its remaining tiles are dropped.
+struct ServiceClient {
+    int fd;
+    mutex write_lock;
+    atomic<bool> closed{false};
+
+    explicit ServiceClient(int socket) : fd(socket) {}
+    ~ServiceClient() { close(fd); }
+
+    bool send_all(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) {
+                closed = true;
+                return false;
+            }
+            data += n;
+            size -= size_t(n);
+        }
+        return true;
+    }
+
+    bool send_line(const string& line) {
+        string out = line + "\n";
+        lock_guard<mutex> guard(write_lock);
+        return !closed && send_all(out.data(), out.size());
+    }
+
+    bool send_tile(const string& id, const TileRect& tile, const vector<uint8_t>& rgb) {
+        string header = "tile " + id + " " + to_string(tile.x0) + " " + to_string(tile.y0) + " " +
+                        to_string(tile.x1 - tile.x0) + " " + to_string(tile.y1 - tile.y0) + "\n";
+        lock_guard<mutex> guard(write_lock);
+        return !closed && send_all(header.data(), header.size()) &&
+               send_all(reinterpret_cast<const char*>(rgb.data()), rgb.size());
+    }
+};
+
+// Function to compute the cache key of a tile: a hash of everything its pixels depend on
+inline uint64_t tile_key(uint64_t scene_hash, const RenderJob& job, const TraceSettings& settings,
+                         const TileRect& tile) {
+    ContentHash h;
+    h.add(TILE_CACHE_VERSION);
+    h.add(scene_hash);
+    for (const vec3* v : {&job.from, &job.at, &job.up}) {
+        for (int c = 0; c < 3; c++) h.add((*v)[c]);
+    }
+    h.add(job.vfov);
+    h.add(job.width);
+    h.add(job.height);
+    h.add(settings.samples_per_pixel);
+    h.add(settings.max_depth);
+    h.add(int(settings.diffuse_bounces));
+    h.add(settings.roulette_depth);
+    h.add(settings.seed);
+    h.add(tile.x0);
+    h.add(tile.y0);
+    h.add(tile.x1);
+    h.add(tile.y1);
+    return h.value;
+}
+
+// A job accepted by the service
+struct ActiveJob {
+    RenderJob job;
+    shared_ptr<const Scene> scene;
+    shared_ptr<ServiceClient> client;
+    TileCache* cache = nullptr;
+    Camera camera;
+    TraceSettings settings;
+    vector<TileRect> tiles;        // The tiles to render, those the cache had were sent already
+    vector<uint64_t> keys;         // Their cache keys
+    int cached_tiles = 0;
+    int next_tile = 0;             // Next tile to hand out, guarded by the queue's lock
+    atomic<int> remaining{0};      // Tiles not finished yet
+    atomic<uint64_t> rays{0};
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+};
+
+// Function to send a job's done line
+inline void send_job_done(ActiveJob& job) {
+    char line[128];
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - job.start).count();
+    snprintf(line, sizeof(line), " %llu %.3f %d", (unsigned long long)job.rays.load(), ms, job.cached_tiles);
+    job.client->send_line("done " + job.job.id + line);
+}
+
+// Function to set up a job's camera, settings and tiles. The tiles found in cache (if given) are sent to the client
+// right away and only the others are left to render.
+inline shared_ptr<ActiveJob> make_active_job(const RenderJob& job, const CachedScene& scene,
+                                             shared_ptr<ServiceClient> client, TileCache* cache) {
+    shared_ptr<ActiveJob> active(new ActiveJob());
+    active->job = job;
+    active->scene = scene.scene;
+    active->client = client;
+    active->cache = cache;
+    active->camera = look_at_camera(job.from, job.at, job.up, job.vfov, job.width, job.height);
+    active->settings.samples_per_pixel = job.spp;
+    vector<uint8_t> rgb;
+    for (const TileRect& tile : split_tiles(job.region, SERVICE_TILE_SIZE)) {
+        uint64_t key = tile_key(scene.content_hash, job, active->settings, tile);
+        size_t bytes = size_t(tile.x1 - tile.x0) * (tile.y1 - tile.y0) * 3;
+        if (cache && cache->find(key, bytes, rgb)) {
+            client->send_tile(job.id, tile, rgb);
+            active->cached_tiles++;
+            continue;
+        }
+        active->tiles.push_back(tile);
+        active->keys.push_back(key);
+    }
+    active->remaining = int(active->tiles.size());
+    return active;
+}
+
+// Define the tile queue. Jobs take turns: a worker gets one tile of the job at the front, which then moves to the
+// back, so a large job does not hold up the small ones submitted after it and every job streams tiles from the start.
+struct TileQueue {
+    mutex lock;
+    condition_variable ready;
+    deque<shared_ptr<ActiveJob>> jobs;  // Jobs with tiles left to hand out
+    bool stop = false;
+
+    void submit(const shared_ptr<ActiveJob>& job) {
+        {
+            lock_guard<mutex> guard(lock);
+            jobs.push_back(job);
+        }
+        ready.notify_all();
+    }
+
+    // Function to wait for the next tile. Jobs of closed clients are dropped. Returns false once shut down.
+    bool next(shared_ptr<ActiveJob>& job, int& tile) {
+        unique_lock<mutex> guard(lock);
+        while (true) {
+            while (!jobs.empty() && jobs.front()->client->closed) jobs.pop_front();
+            if (stop) return false;
+            if (!jobs.empty()) break;
+            ready.wait(guard);
+        }
+        job = jobs.front();
+        jobs.pop_front();
+        tile = job->next_tile++;
+        if (job->next_tile < int(job->tiles.size())) jobs.push_back(job);
+        return true;
+    }
+
+    void shutdown() {
+        {
+            lock_guard<mutex> guard(lock);
+            stop = true;
+        }
+        ready.notify_all();
+    }
+};
+
+// Function to open a listening Unix domain socket at path, replacing a stale socket file. Returns -1 on failure.
+inline int listen_unix(const string& path) {
+    sockaddr_un addr = {};
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    unlink(path.c_str());
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Function to connect to the Unix domain socket at path. Returns -1 on failure.
+inline int connect_unix(const string& path) {
+    sockaddr_un addr = {};
+    if (path.size() >= sizeof(addr.sun_path)) return -1;
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path.c_str());
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Buffered reads of the protocol's text lines and binary tiles from a socket
+struct SocketReader {
+    int fd;
+    vector<char> buffer = vector<char>(65536);
+    size_t begin = 0;
+    size_t end = 0;
+
+    explicit SocketReader(int socket) : fd(socket) {}
+
+    // Refill the buffer, false at the end of the stream
+    bool fill() {
+        if (begin == end) begin = end = 0;
+        if (end == buffer.size()) {
+            if (begin == 0) buffer.resize(buffer.size() * 2);
+            memmove(buffer.data(), buffer.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+        }
+        ssize_t n;
+        do {
+            n = recv(fd, buffer.data() + end, buffer.size() - end, 0);
+        } while (n < 0 && errno == EINTR);
+        if (n <= 0) return false;
+        end += size_t(n);
+        return true;
+    }
+
+    // Function to take a line that has been received in full, without reading from the socket
+    bool buffered_line(string& line) {
+        char* nl = (char*)memchr(buffer.data() + begin, '\n', end - begin);
+        if (!nl) return false;
+        line.assign(buffer.data() + begin, nl);
+        begin = size_t(nl - buffer.data()) + 1;
+        return true;
+    }
+
+    // Function to read a line without its newline. Returns false at the end of the stream.
+    bool read_line(string& line) {
+        while (!buffered_line(line)) {
+            if (!fill()) return false;
+        }
+        return true;
+    }
+
+    // Function to read exactly size bytes. Returns false if the stream ends first.
+    bool read_bytes(char* out, size_t size) {
+        while (size > 0) {
+            if (begin == end && !fill()) return false;
+            size_t n = min(size, end - begin);
+            memcpy(out, buffer.data() + begin, n);
+            begin += n;
+            out += n;
+            size -= n;
+        }
+        return true;
+    }
+};
+
+#endif // RENDER_SERVICE_H
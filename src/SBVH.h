@@ -0,0 +1,310 @@
+#ifndef SBVH_H
+#define SBVH_H
+
+#include "vec3.h"
+#include "AABB.h"
+#include "BVH.h"
+#include "Triangle.h"
+#include <vector>
+#include <cfloat>
+
+using namespace std;
+
+// Split BVH builder (Stich et al., "Spatial Splits in Bounding Volume Hierarchies", 2009).
+// Besides object splits it considers spatial splits that clip triangles at the split plane and reference them
+// from both children. The result is a regular BVH, leaves may simply reference the same triangle more than once.
+
+// Options for the split BVH builder
+struct SBVHBuildOptions : BVHBuildOptions {
+    float overlap_alpha = 1e-5f;   // Spatial splits are only tried where child overlap exceeds this fraction of the root area
+    float max_duplication = 0.5f;  // Memory budget: at most this many extra references per input triangle
+};
+
+// A triangle reference with the bounds of the part of the triangle it covers
+struct SBVHRef {
+    AABB box;
+    int prim;
+};
+
+// Best split found for one node
+struct SBVHSplit {
+    float cost = FLT_MAX;  // SAH cost without the constant traversal term, in units of node area
+    int axis = -1;
+    float pos = 0.0f;
+    AABB left, right;      // Child bounds implied by the split
+};
+
+// Clip the part of a triangle inside ref.box against the plane axis = pos
+inline void split_reference(const Triangle& tri, const SBVHRef& ref, int axis, float pos, SBVHRef& left, SBVHRef& right) {
+    left.prim = right.prim = ref.prim;
+    left.box = right.box = AABB();
+    const vec3* v[3] = {&tri.v0, &tri.v1, &tri.v2};
+    for (int i = 0; i < 3; i++) {
+        const vec3& a = *v[i];
+        const vec3& b = *v[(i + 1) % 3];
+        float pa = a[axis];
+        float pb = b[axis];
+        if (pa <= pos) grow(left.box, a);
+        if (pa >= pos) grow(right.box, a);
+        if ((pa < pos && pb > pos) || (pa > pos && pb < pos)) {
+            // The edge crosses the plane, the crossing point bounds both sides
+            vec3 p = a + ((pos - pa) / (pb - pa)) * (b - a);
+            p[axis] = pos;
+            grow(left.box, p);
+            grow(right.box, p);
+        }
+    }
+    left.box = intersection(left.box, ref.box);
+    right.box = intersection(right.box, ref.box);
+}
+
+// Binned SAH object split over reference centroids
+inline SBVHSplit find_object_split(const vector<SBVHRef>& refs, int bins) {
+    const int MAX_BINS = 64;
+    SBVHSplit best;
+    AABB cbounds;
+    for (const auto& ref : refs) grow(cbounds, centroid(ref.box));
+
+    for (int axis = 0; axis < 3; axis++) {
+        float cmin = cbounds.bmin[axis];
+        float extent = cbounds.bmax[axis] - cmin;
+        if (extent <= 0.0f) continue;
+
+        AABB bin_bounds[MAX_BINS];
+        int bin_count[MAX_BINS] = {0};
+        float scale = bins / extent;
+        for (const auto& ref : refs) {
+            int b = int((centroid(ref.box)[axis] - cmin) * scale);
+            if (b > bins - 1) b = bins - 1;
+            bin_count[b]++;
+            grow(bin_bounds[b], ref.box);
+        }
+
+        AABB right_bounds[MAX_BINS];
+        int right_count[MAX_BINS];
+        AABB acc;
+        int count = 0;
+        for (int b = bins - 1; b > 0; b--) {
+            grow(acc, bin_bounds[b]);
+            count += bin_count[b];
+            right_bounds[b] = acc;
+            right_count[b] = count;
+        }
+
+        acc = AABB();
+        count = 0;
+        for (int b = 0; b < bins - 1; b++) {
+            grow(acc, bin_bounds[b]);
+            count += bin_count[b];
+            if (count == 0 || right_count[b + 1] == 0) continue;
+            float cost = surface_area(acc) * count + surface_area(right_bounds[b + 1]) * right_count[b + 1];
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.pos = cmin + (b + 1) / scale;
+                best.left = acc;
+                best.right = right_bounds[b + 1];
+            }
+        }
+    }
+    return best;
+}
+
+// Binned SAH spatial split: references are chopped into every bin they overlap
+inline SBVHSplit find_spatial_split(const vector<SBVHRef>& refs, const vector<Triangle>& triangles, const AABB& bounds, int bins) {
+    const int MAX_BINS = 64;
+    SBVHSplit best;
+    for (int axis = 0; axis < 3; axis++) {
+        float lo = bounds.bmin[axis];
+        float extent = bounds.bmax[axis] - lo;
+        if (extent <= 0.0f) continue;
+
+        AABB bin_bounds[MAX_BINS];
+        int entries[MAX_BINS] = {0};  // References starting in each bin
+        int exits[MAX_BINS] = {0};    // References ending in each bin
+        float bin_size = extent / bins;
+        for (const auto& ref : refs) {
+            int b0 = int((ref.box.bmin[axis] - lo) / bin_size);
+            int b1 = int((ref.box.bmax[axis] - lo) / bin_size);
+            b0 = b0 < 0 ? 0 : (b0 > bins - 1 ? bins - 1 : b0);
+            b1 = b1 < b0 ? b0 : (b1 > bins - 1 ? bins - 1 : b1);
+            entries[b0]++;
+            exits[b1]++;
+            SBVHRef rest = ref;
+            for (int b = b0; b < b1; b++) {
+                SBVHRef left, right;
+                split_reference(triangles[ref.prim], rest, axis, lo + (b + 1) * bin_size, left, right);
+                grow(bin_bounds[b], left.box);
+                rest = right;
+            }
+            grow(bin_bounds[b1], rest.box);
+        }
+
+        AABB right_bounds[MAX_BINS];
+        int right_count[MAX_BINS];
+        AABB acc;
+        int count = 0;
+        for (int b = bins - 1; b > 0; b--) {
+            grow(acc, bin_bounds[b]);
+            count += exits[b];
+            right_bounds[b] = acc;
+            right_count[b] = count;
+        }
+
+        acc = AABB();
+        count = 0;
+        for (int b = 0; b < bins - 1; b++) {
+            grow(acc, bin_bounds[b]);
+            count += entries[b];
+            if (count == 0 || right_count[b + 1] == 0) continue;
+            float cost = surface_area(acc) * count + surface_area(right_bounds[b + 1]) * right_count[b + 1];
+            if (cost < best.cost) {
+                best.cost = cost;
+                best.axis = axis;
+                best.pos = lo + (b + 1) * bin_size;
+                best.left = acc;
+                best.right = right_bounds[b + 1];
+            }
+        }
+    }
+    return best;
+}
+
+// Distribute references for a spatial split. Straddling references are split or, when cheaper or over budget,
+// kept whole on one side ("reference unsplitting").
+inline void partition_spatial(const vector<SBVHRef>& refs, const vector<Triangle>& triangles, const SBVHSplit& split,
+                              size_t& total_refs, size_t ref_budget, vector<SBVHRef>& left, vector<SBVHRef>& right) {
+    int axis = split.axis;
+    vector<const SBVHRef*> straddling;
+    for (const auto& ref : refs) {
+        if (ref.box.bmax[axis] <= split.pos) {
+            left.push_back(ref);
+        } else if (ref.box.bmin[axis] >= split.pos) {
+            right.push_back(ref);
+        } else {
+            straddling.push_back(&ref);
+        }
+    }
+
+    // Straddlers start out counted on both sides, as in the binning
+    float nl = float(left.size() + straddling.size());
+    float nr = float(right.size() + straddling.size());
+    AABB est_left = split.left, est_right = split.right;
+    for (const SBVHRef* ref : straddling) {
+        SBVHRef l, r;
+        split_reference(triangles[ref->prim], *ref, axis, split.pos, l, r);
+        AABB left_grown = est_left, right_grown = est_right;
+        grow(left_grown, ref->box);
+        grow(right_grown, ref->box);
+        float cost_split = surface_area(est_left) * nl + surface_area(est_right) * nr;
+        float cost_left = surface_area(left_grown) * nl + surface_area(est_right) * (nr - 1);
+        float cost_right = surface_area(est_left) * (nl - 1) + surface_area(right_grown) * nr;
+        bool can_split = total_refs < ref_budget && !is_empty_box(l.box) && !is_empty_box(r.box);
+
+        if (can_split && cost_split <= cost_left && cost_split <= cost_right) {
+            left.push_back(l);
+            right.push_back(r);
+            total_refs++;
+        } else if (cost_left <= cost_right) {
+            left.push_back(*ref);
+            est_left = left_grown;
+            nr -= 1;
+        } else {
+            right.push_back(*ref);
+            est_right = right_grown;
+            nl -= 1;
+        }
+    }
+}
+
+// Build a split BVH over a triangle array
+inline void build_triangle_sbvh(BVH& bvh, const vector<Triangle>& triangles, const SBVHBuildOptions& opt = SBVHBuildOptions()) {
+    int n = int(triangles.size());
+    int bins = opt.sah_bins < 2 ? 2 : (opt.sah_bins > 64 ? 64 : opt.sah_bins);
+    bvh.nodes.clear();
+    bvh.prim_indices.clear();
+    bvh.prim_indices.reserve(n);
+    bvh.nodes.push_back(BVHNode());
+
+    struct Task {
+        int node;
+        int depth;
+        vector<SBVHRef> refs;
+    };
+    vector<Task> stack(1);
+    stack[0].node = 0;
+    stack[0].depth = 1;
+    stack[0].refs.resize(n);
+    AABB root_bounds;
+    for (int i = 0; i < n; i++) {
+        SBVHRef& ref = stack[0].refs[i];
+        ref.prim = i;
+        grow(ref.box, triangles[i].v0);
+        grow(ref.box, triangles[i].v1);
+        grow(ref.box, triangles[i].v2);
+        grow(root_bounds, ref.box);
+    }
+    float root_area = surface_area(root_bounds);
+    size_t total_refs = n;
+    size_t ref_budget = n + size_t(n * opt.max_duplication);
+
+    while (!stack.empty()) {
+        Task task = move(stack.back());
+        stack.pop_back();
+        vector<SBVHRef>& refs = task.refs;
+
+        AABB bounds;
+        for (const auto& ref : refs) grow(bounds, ref.box);
+        BVHNode& node = bvh.nodes[task.node];
+        node.bounds = bounds;
+
+        int count = int(refs.size());
+        vector<SBVHRef> left, right;
+        if (count > 1 && task.depth < BVH_MAX_DEPTH) {
+            SBVHSplit object = find_object_split(refs, bins);
+            SBVHSplit spatial;
+            AABB overlap = object.axis >= 0 ? intersection(object.left, object.right) : bounds;
+            if (total_refs < ref_budget && surface_area(overlap) > opt.overlap_alpha * root_area) {
+                spatial = find_spatial_split(refs, triangles, bounds, bins);
+            }
+
+            float area = surface_area(bounds);
+            float best_cost = spatial.cost < object.cost ? spatial.cost : object.cost;
+            float split_cost = opt.traversal_cost + (area > 0.0f ? best_cost / area : 0.0f);
+            bool want_split = best_cost < FLT_MAX && (split_cost < float(count) || count > opt.max_leaf_size);
+
+            if (want_split && spatial.cost < object.cost) {
+                partition_spatial(refs, triangles, spatial, total_refs, ref_budget, left, right);
+            } else if (want_split) {
+                for (const auto& ref : refs) {
+                    if (centroid(ref.box)[object.axis] < object.pos) left.push_back(ref);
+                    else right.push_back(ref);
+                }
+            }
+            if ((left.empty() || right.empty()) && count > opt.max_leaf_size) {
+                // No usable split (coincident references), split the list in half
+                left.assign(refs.begin(), refs.begin() + count / 2);
+                right.assign(refs.begin() + count / 2, refs.end());
+            }
+        }
+
+        if (left.empty() || right.empty()) {
+            node.left_first = int(bvh.prim_indices.size());
+            node.count = count;
+            for (const auto& ref : refs) bvh.prim_indices.push_back(ref.prim);
+            continue;
+        }
+
+        int child = int(bvh.nodes.size());
+        node.left_first = child;
+        node.count = 0;
+        bvh.nodes.push_back(BVHNode());
+        bvh.nodes.push_back(BVHNode());
+        refs.clear();
+        refs.shrink_to_fit();
+        stack.push_back({child, task.depth + 1, move(left)});
+        stack.push_back({child + 1, task.depth + 1, move(right)});
+    }
+}
+
+#endif // SBVH_H
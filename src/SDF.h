@@ -0,0 +1,243 @@
+#ifndef SDF_H
+#define SDF_H
+
+#include <vector>
+#include <cmath>
+#include <cfloat>
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+
+using namespace std;
+
+// Procedural objects given by signed distance functions, rendered by sphere tracing (Hart 1996) with
+// over-relaxation (Keinert et al. 2014). An object is a small expression of shapes combined by smooth unions and
+// is enclosed in an analytic box, which clips the march and is what the scene's BVH holds.
+
+enum SDFNodeKind {
+    SDF_SPHERE,
+    SDF_ROUNDED_BOX,
+    SDF_TORUS,
+    SDF_SMOOTH_UNION
+};
+
+// One node of an object's expression in postfix order: shapes push their distance, a smooth union replaces the last
+// two distances by their blend
+struct SDFNode {
+    int kind;
+    vec3 center;          // Shapes: center
+    vec3 size;            // Rounded box: half extents before rounding. Torus: (ring radius, tube radius, 0) around y
+    float radius = 0.0f;  // Sphere: radius. Rounded box: rounding radius. Smooth union: blend width, 0 is a plain union
+};
+
+const int SDF_MAX_STACK = 16;  // Most distances an expression may have pending at once
+
+// Define the SDF object. Shapes left without a union at the end are combined by a plain union.
+struct SDFObject {
+    vector<SDFNode> nodes;
+    AABB bounds;     // Encloses the surface, kept up to date by the add functions
+    int pending = 0;  // Distances left on the stack after the last node
+};
+
+const float SDF_RELAXATION = 1.2f;    // Over-relaxation factor of sphere_trace, 1 is plain sphere tracing
+const int SDF_MAX_STEPS = 256;        // Distance evaluations before a march gives up as a miss
+const float SDF_HIT_EPSILON = 1e-4f;  // Hit threshold, grows with the distance marched like a pixel footprint
+
+// Distance functions of the shapes around the origin (Quilez), exact inside and outside
+inline float sdf_sphere_distance(const vec3& p, float radius) {
+    return p.length() - radius;
+}
+
+inline float sdf_rounded_box_distance(const vec3& p, const vec3& half, float rounding) {
+    float qx = fabsf(p.x()) - half.x(), qy = fabsf(p.y()) - half.y(), qz = fabsf(p.z()) - half.z();
+    float ox = qx > 0.0f ? qx : 0.0f, oy = qy > 0.0f ? qy : 0.0f, oz = qz > 0.0f ? qz : 0.0f;
+    float inside = fmaxf(qx, fmaxf(qy, qz));
+    return sqrtf(ox * ox + oy * oy + oz * oz) + (inside < 0.0f ? inside : 0.0f) - rounding;
+}
+
+inline float sdf_torus_distance(const vec3& p, float ring, float tube) {
+    float q = sqrtf(p.x() * p.x() + p.z() * p.z()) - ring;
+    return sqrtf(q * q + p.y() * p.y()) - tube;
+}
+
+// Polynomial smooth minimum, below min(a, b) by at most k / 4 where a and b are within k of each other
+inline float smooth_min(float a, float b, float k) {
+    if (k <= 0.0f) return a < b ? a : b;
+    float h = 0.5f + 0.5f * (b - a) / k;
+    h = h < 0.0f ? 0.0f : (h > 1.0f ? 1.0f : h);
+    return b + h * (a - b) - k * h * (1.0f - h);
+}
+
+// Function to evaluate the signed distance of obj at p, negative inside
+inline float sdf_distance(const SDFObject& obj, const vec3& p) {
+    float stack[SDF_MAX_STACK];
+    int sp = 0;
+    for (const SDFNode& n : obj.nodes) {
+        switch (n.kind) {
+        case SDF_SPHERE:
+            stack[sp++] = sdf_sphere_distance(p - n.center, n.radius);
+            break;
+        case SDF_ROUNDED_BOX:
+            stack[sp++] = sdf_rounded_box_distance(p - n.center, n.size, n.radius);
+            break;
+        case SDF_TORUS:
+            stack[sp++] = sdf_torus_distance(p - n.center, n.size.x(), n.size.y());
+            break;
+        case SDF_SMOOTH_UNION:
+            sp--;
+            stack[sp - 1] = smooth_min(stack[sp - 1], stack[sp], n.radius);
+            break;
+        }
+    }
+    float d = FLT_MAX;
+    for (int i = 0; i < sp; i++) d = stack[i] < d ? stack[i] : d;
+    return d;
+}
+
+// Bounds of one shape
+inline AABB sdf_shape_bounds(const SDFNode& n) {
+    vec3 half;
+    if (n.kind == SDF_SPHERE) half = vec3(n.radius, n.radius, n.radius);
+    else if (n.kind == SDF_ROUNDED_BOX) half = n.size + vec3(n.radius, n.radius, n.radius);
+    else half = vec3(n.size.x() + n.size.y(), n.size.y(), n.size.x() + n.size.y());
+    AABB box;
+    grow(box, n.center - half);
+    grow(box, n.center + half);
+    return box;
+}
+
+// Function to recompute the bounds of obj by running its expression on boxes. A smooth union reaches k / 4 beyond
+// its two operands.
+inline void update_sdf_bounds(SDFObject& obj) {
+    AABB stack[SDF_MAX_STACK];
+    int sp = 0;
+    for (const SDFNode& n : obj.nodes) {
+        if (n.kind != SDF_SMOOTH_UNION) {
+            stack[sp++] = sdf_shape_bounds(n);
+            continue;
+        }
+        sp--;
+        grow(stack[sp - 1], stack[sp]);
+        vec3 reach(0.25f * n.radius, 0.25f * n.radius, 0.25f * n.radius);
+        stack[sp - 1].bmin -= reach;
+        stack[sp - 1].bmax += reach;
+    }
+    obj.bounds = AABB();
+    for (int i = 0; i < sp; i++) grow(obj.bounds, stack[i]);
+}
+
+// Functions to append a shape to obj. They return false if the expression is already SDF_MAX_STACK deep.
+inline bool add_sdf_shape(SDFObject& obj, const SDFNode& node) {
+    if (obj.pending == SDF_MAX_STACK) return false;
+    obj.nodes.push_back(node);
+    obj.pending++;
+    update_sdf_bounds(obj);
+    return true;
+}
+
+inline bool add_sdf_sphere(SDFObject& obj, const vec3& center, float radius) {
+    return add_sdf_shape(obj, {SDF_SPHERE, center, vec3(0, 0, 0), radius});
+}
+
+inline bool add_sdf_rounded_box(SDFObject& obj, const vec3& center, const vec3& half, float rounding) {
+    return add_sdf_shape(obj, {SDF_ROUNDED_BOX, center, half, rounding});
+}
+
+inline bool add_sdf_torus(SDFObject& obj, const vec3& center, float ring, float tube) {
+    return add_sdf_shape(obj, {SDF_TORUS, center, vec3(ring, tube, 0), 0.0f});
+}
+
+// Function to blend the last two pending shapes or unions of obj over the width k. Returns false with fewer than two.
+inline bool add_sdf_smooth_union(SDFObject& obj, float k) {
+    if (obj.pending < 2) return false;
+    obj.nodes.push_back({SDF_SMOOTH_UNION, vec3(0, 0, 0), vec3(0, 0, 0), k});
+    obj.pending--;
+    update_sdf_bounds(obj);
+    return true;
+}
+
+// Outward normal at p from the tetrahedron of central differences with step h
+inline vec3 sdf_normal(const SDFObject& obj, const vec3& p, float h) {
+    const vec3 k0(1, -1, -1), k1(-1, -1, 1), k2(-1, 1, -1), k3(1, 1, 1);
+    vec3 g = sdf_distance(obj, p + h * k0) * k0 + sdf_distance(obj, p + h * k1) * k1 +
+             sdf_distance(obj, p + h * k2) * k2 + sdf_distance(obj, p + h * k3) * k3;
+    float len = g.length();
+    return len > 0.0f ? g / len : vec3(0, 1, 0);
+}
+
+// Function to march the ray through obj from parameter t_begin to t_end and return the first hit in t.
+// With relaxation above 1 every step is that much longer than the distance; when the next distance shows the
+// unbounding spheres of the two points no longer overlap, or the step overshoots t_end, the march returns to the last
+// point, takes the plain step and stays plain from there. entering says the first point is where the ray enters the
+// object's bounds, so it is outside and a distance near 0 there is a hit. Otherwise the first point is the ray's
+// origin: its sign picks the side the ray marches on, so rays from inside find their exit, and a ray starting on
+// the surface (a secondary ray) must move away from it before it can hit.
+// If steps is given the distance evaluations are added to it.
+inline bool sphere_trace(const SDFObject& obj, const ray& r, float t_begin, float t_end, bool entering, float& t,
+                         int* steps = nullptr, float relaxation = SDF_RELAXATION) {
+    float len = r.direction().length();
+    vec3 dir = r.direction() / len;
+    float s = t_begin * len, s_end = t_end * len;  // Distances along the unit direction
+    float sign = 0.0f, omega = 1.0f, prev = 0.0f, step = 0.0f;
+    bool armed = false;  // Whether hits count, false while leaving the surface the ray started on
+    bool hit = false;
+    int count = 0;
+    while (count < SDF_MAX_STEPS) {
+        if (s > s_end) {
+            if (omega <= 1.0f) break;
+            s += prev - step;
+            step = prev;
+            omega = 1.0f;
+            if (s > s_end) break;
+        }
+        vec3 p = r.origin() + s * dir;
+        float d = sdf_distance(obj, p);
+        count++;
+        float threshold = SDF_HIT_EPSILON * (1.0f + s);
+        if (sign == 0.0f) {
+            if (entering || fabsf(d) >= threshold) {
+                sign = d < 0.0f && !entering ? -1.0f : 1.0f;
+                armed = true;
+                omega = relaxation;
+            } else {
+                sign = dot(sdf_normal(obj, p, threshold), dir) < 0.0f ? -1.0f : 1.0f;
+            }
+        }
+        d *= sign;
+        if (omega > 1.0f && d + prev < step) {
+            s += prev - step;
+            step = prev;
+            omega = 1.0f;
+            continue;
+        }
+        if (armed && d < threshold) {
+            t = s / len;
+            hit = true;
+            break;
+        }
+        if (!armed && d >= 2.0f * threshold) {
+            armed = true;
+            omega = relaxation;
+        }
+        prev = d;
+        step = omega * (d > threshold ? d : threshold);
+        s += step;
+    }
+    if (steps) *steps += count;
+    return hit;
+}
+
+// Function to find the nearest hit of a ray with obj beyond t_min and before t, marching only inside its bounds.
+// N is the outward normal.
+inline bool intersect_sdf(const SDFObject& obj, const ray& r, float t_min, float& t, vec3& N, int* steps = nullptr,
+                          float relaxation = SDF_RELAXATION) {
+    float t_near, t_far, t_hit;
+    if (!clip_aabb(obj.bounds, make_box_query(r), t, t_near, t_far)) return false;
+    bool entering = t_near > t_min;
+    if (!sphere_trace(obj, r, entering ? t_near : t_min, t_far, entering, t_hit, steps, relaxation)) return false;
+    t = t_hit;
+    N = sdf_normal(obj, r.point_at_parameter(t_hit), SDF_HIT_EPSILON * (1.0f + t_hit * r.direction().length()));
+    return true;
+}
+
+#endif // SDF_H
@@ -0,0 +1,657 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <vector>
+#include <cfloat>
+#include <memory>
+#include "vec3.h"
+#include "ray.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Cube.h"
+#include "Plane.h"
+#include "BVH.h"
+#include "MeshLOD.h"
+#include "SDF.h"
+#include "Heightfield.h"
+#include "Motion.h"
+#include "Material.h"
+#include "Texture.h"
+#include "Profile.h"
+
+using namespace std;
+
+// Define the Light structure
+struct Light {
+    vec3 position;         // Position of the light source
+    vec3 intensity;        // Intensity of the light source
+    float radius = 0.0f;   // Spherical area light of this radius for the path tracer, 0 is a point light
+};
+
+// Kinds of primitives a scene holds, in the order color() tests them
+enum PrimitiveKind {
+    PRIM_SPHERE,
+    PRIM_TRIANGLE,
+    PRIM_CUBE,
+    PRIM_PLANE,
+    PRIM_MESH,
+    PRIM_SDF,
+    PRIM_HEIGHTFIELD,
+    PRIM_MOVING_SPHERE,
+    PRIM_MOVING_TRIANGLE,
+    PRIM_KIND_COUNT
+};
+
+// Texture coordinates of a triangle's vertices
+struct TriangleUV {
+    float u[3];
+    float v[3];
+};
+
+// Planar texture mapping: u = dot(p - plane.point, u_axis) and likewise v, longer axes repeat the texture faster
+struct PlaneUV {
+    vec3 u_axis;
+    vec3 v_axis;
+};
+
+// Define the scene: every primitive list plus the acceleration structure over the triangles
+struct Scene {
+    vector<Light> lights;
+    vector<Sphere> spheres;
+    vector<Triangle> triangles;
+    vector<Cube> cubes;
+    vector<Plane> planes;
+    BVH triangle_bvh;  // Filled by build_scene_bvh, triangles are tested one by one while it is empty
+    vector<MeshLOD> meshes;  // Dense meshes with levels of detail, hits report the mesh index
+    vector<SDFObject> sdfs;  // Sphere traced procedural objects
+    BVH sdf_bvh;             // Over the bounds of the SDF objects, filled by build_scene_bvh like triangle_bvh
+    vector<Heightfield> heightfields;  // Terrains, hits report the heightfield index
+    vector<MovingSphere> moving_spheres;      // Motion blurred primitives, seen where they are at the ray's time
+    vector<MovingTriangle> moving_triangles;
+    MotionBVH moving_sphere_bvh;              // Filled by build_scene_bvh like triangle_bvh
+    MotionBVH moving_triangle_bvh;
+
+    // Material ids parallel to each primitive list, indexed by PrimitiveKind. They live outside the primitive
+    // structs so the intersection loops stream the same data as before. Primitives without an id use material 0.
+    MaterialTable materials;
+    vector<MaterialId> material_ids[PRIM_KIND_COUNT];
+
+    // Texturing. Triangles without uvs get (0, 0), (1, 0), (0, 1); planes without a mapping get unit axes.
+    shared_ptr<TextureCache> textures;
+    vector<TriangleUV> triangle_uvs;
+    vector<PlaneUV> plane_uvs;
+};
+
+// Define the record of the nearest hit along a ray
+struct HitRecord {
+    float t;    // Ray parameter of the hit
+    vec3 p;     // Hit point
+    vec3 N;     // Geometric normal as returned by the primitive's hit function
+    int kind;   // PrimitiveKind of the primitive that was hit
+    int index;  // Index of the primitive in its list
+    vec3 error; // Bound on the rounding error of p per axis, see offset_ray_origin
+    float time; // Time of the ray, rays spawned from the hit keep it
+    int level;  // Level of detail a mesh was hit at
+};
+
+// Footprint of a ray for texture filtering, the isotropic reduction of a ray differential (Igehy 1999):
+// the footprint is width wide at the ray origin and grows by spread per unit of distance. It also picks
+// the level of detail of meshes, with a uniform number drawn once per path. Rays leaving a mesh hit test that mesh
+// at the level it was hit at, whatever their own footprint picks, so they cannot hit another level's surface.
+struct RayCone {
+    float width = 0.0f;
+    float spread = 0.0f;
+    float lod_u = -1.0f;  // Decides between two levels, negative takes it from each ray (lod_sample)
+    int lod_mesh = -1;    // Mesh the ray leaves, if any, and the level it was hit at
+    int lod_level = 0;
+};
+
+// Work intersect_scene did for one ray, what the traversal heatmap shows
+struct TraversalStats {
+    int nodes = 0;       // BVH nodes and heightfield pyramid blocks visited
+    int primitives = 0;  // Primitives tested, SDF distance evaluations included
+};
+
+// Material id of the primitive that was hit
+inline MaterialId material_id(const Scene& scene, int kind, int index) {
+    const vector<MaterialId>& ids = scene.material_ids[kind];
+    return index < int(ids.size()) ? ids[index] : MaterialId(0);
+}
+
+inline Material material_of(const Scene& scene, int kind, int index) {
+    return scene.materials.get(material_id(scene, kind, index));
+}
+
+// Assign a material to one primitive, giving the primitives before it the default material if they have none
+inline void set_material(Scene& scene, PrimitiveKind kind, int index, MaterialId id) {
+    vector<MaterialId>& ids = scene.material_ids[kind];
+    if (index >= int(ids.size())) ids.resize(index + 1, 0);
+    ids[index] = id;
+}
+
+inline void build_scene_bvh(Scene& scene) {
+    build_triangle_bvh(scene.triangle_bvh, scene.triangles);
+    vector<AABB> sdf_bounds(scene.sdfs.size());
+    for (size_t i = 0; i < scene.sdfs.size(); i++) sdf_bounds[i] = scene.sdfs[i].bounds;
+    build_bvh(scene.sdf_bvh, sdf_bounds);
+    build_moving_sphere_bvh(scene.moving_sphere_bvh, scene.moving_spheres);
+    build_moving_triangle_bvh(scene.moving_triangle_bvh, scene.moving_triangles);
+}
+
+// Level query of the cone for mesh i
+inline LODQuery lod_query(const RayCone& cone, int mesh) {
+    LODQuery q;
+    q.width = cone.width;
+    q.spread = cone.spread;
+    q.u = cone.lod_u;
+    if (mesh == cone.lod_mesh) q.level = cone.lod_level;
+    return q;
+}
+
+inline vec3 abs_components(const vec3& v) {
+    return vec3(fabsf(v.x()), fabsf(v.y()), fabsf(v.z()));
+}
+
+// Function to fill in the hit point of rec from its t and a bound on the point's rounding error. Where the surface
+// is known in closed form the point is projected back onto it, which removes the error t carries along the ray, and
+// the bound is that of the projection. Mesh and heightfield points keep the error of t from the triangle test, and
+// SDF points are only as close to the surface as the march's hit threshold.
+inline void finish_hit(const Scene& scene, const ray& r, HitRecord& rec) {
+    vec3 p = r.point_at_parameter(rec.t);
+    switch (rec.kind) {
+    case PRIM_SPHERE: {
+        const Sphere& sphere = scene.spheres[rec.index];
+        vec3 d = p - sphere.center;
+        d *= sphere.radius / d.length();
+        p = sphere.center + d;
+        rec.error = rounding_gamma(5) * (abs_components(sphere.center) + abs_components(d));
+        break;
+    }
+    case PRIM_TRIANGLE: {
+        const Triangle& tri = scene.triangles[rec.index];
+        p -= dot(p - tri.v0, rec.N) * rec.N;
+        rec.error = rounding_gamma(7) * (abs_components(p) + abs_components(tri.v0));
+        break;
+    }
+    case PRIM_PLANE: {
+        const Plane& plane = scene.planes[rec.index];
+        p -= (dot(p - plane.point, plane.normal) / dot(plane.normal, plane.normal)) * plane.normal;
+        rec.error = rounding_gamma(7) * (abs_components(p) + abs_components(plane.point));
+        break;
+    }
+    case PRIM_MOVING_SPHERE: {
+        Sphere sphere = sphere_at(scene.moving_spheres[rec.index], r.time);
+        vec3 d = p - sphere.center;
+        d *= sphere.radius / d.length();
+        p = sphere.center + d;
+        rec.error = rounding_gamma(5) * (abs_components(sphere.center) + abs_components(d));
+        break;
+    }
+    case PRIM_MOVING_TRIANGLE: {
+        vec3 v0 = triangle_at(scene.moving_triangles[rec.index], r.time).v0;
+        p -= dot(p - v0, rec.N) * rec.N;
+        rec.error = rounding_gamma(7) * (abs_components(p) + abs_components(v0));
+        break;
+    }
+    case PRIM_CUBE: {
+        // The face is exact, the other two coordinates keep the error of t
+        const Cube& cube = scene.cubes[rec.index];
+        rec.error = rounding_gamma(7) * (abs_components(r.O) + abs_components(rec.t * r.D));
+        for (int a = 0; a < 3; a++) {
+            if (rec.N[a] == 0.0f) continue;
+            p[a] = cube.center[a] + rec.N[a] * (0.5f * cube.side_length);
+            rec.error[a] = rounding_gamma(2) * fabsf(p[a]);
+        }
+        break;
+    }
+    case PRIM_SDF: {
+        float threshold = SDF_HIT_EPSILON * (1.0f + rec.t * r.D.length());
+        rec.error = vec3(threshold, threshold, threshold);
+        break;
+    }
+    default:
+        rec.error = rounding_gamma(16) * (abs_components(r.O) + abs_components(rec.t * r.D));
+        break;
+    }
+    rec.p = p;
+    rec.time = r.time;
+}
+
+// Function to move a hit point off its surface for a ray leaving in direction w: along the normal by the point's
+// error bound projected on it, to the side of w, then one float further out per axis so rounding the sum cannot
+// bring it back (Pharr, Jakob and Humphreys). Rays from the result need no epsilon on t to miss the surface.
+inline vec3 offset_ray_origin(const vec3& p, const vec3& error, const vec3& N, const vec3& w) {
+    vec3 n = unit_vector(N);
+    float d = dot(abs_components(n), error);
+    vec3 offset = dot(w, n) < 0.0f ? -d * n : d * n;
+    vec3 o = p + offset;
+    for (int a = 0; a < 3; a++) {
+        if (offset[a] > 0.0f) o[a] = nextafterf(o[a], FLT_MAX);
+        else if (offset[a] < 0.0f) o[a] = nextafterf(o[a], -FLT_MAX);
+    }
+    return o;
+}
+
+// Secondary ray leaving the hit in direction dir
+inline ray spawn_ray(const HitRecord& rec, const vec3& dir) {
+    return ray(offset_ray_origin(rec.p, rec.error, rec.N, dir), dir, rec.time);
+}
+
+// Shadow ray from the hit that reaches target at t = 1
+inline ray spawn_ray_to(const HitRecord& rec, const vec3& target) {
+    vec3 o = offset_ray_origin(rec.p, rec.error, rec.N, target - rec.p);
+    return ray(o, target - o, rec.time);
+}
+
+// Function to find the nearest intersection of a ray with the scene. cone selects the meshes' levels of detail,
+// the default tests their full resolution. If stats is given the work done is added to it.
+inline bool intersect_scene(const Scene& scene, const ray& r, HitRecord& rec, float t_max = FLT_MAX,
+                            const RayCone& cone = RayCone(), TraversalStats* stats = nullptr) {
+    PROFILE_COUNT(PROF_PRIMITIVES, scene.spheres.size() + scene.cubes.size() + scene.planes.size() +
+                                   (scene.triangle_bvh.nodes.empty() ? scene.triangles.size() : 0));
+    int* nodes = stats ? &stats->nodes : nullptr;
+    int* tests = stats ? &stats->primitives : nullptr;
+    if (stats) {
+        // The primitives without a BVH are all tested
+        stats->primitives += int(scene.spheres.size() + scene.cubes.size() + scene.planes.size());
+        if (scene.triangle_bvh.nodes.empty()) stats->primitives += int(scene.triangles.size());
+        if (scene.moving_sphere_bvh.bvh.nodes.empty()) stats->primitives += int(scene.moving_spheres.size());
+        if (scene.moving_triangle_bvh.bvh.nodes.empty()) stats->primitives += int(scene.moving_triangles.size());
+    }
+    float t_min = t_max;  // Distance of the nearest hit so far
+    vec3 N;
+    RayShear shear = make_ray_shear(r.D);
+
+    for (size_t i = 0; i < scene.spheres.size(); i++) {
+        float t;
+        if (hit_sphere(scene.spheres[i], r, t, N) && t > 0.0f && t < t_min) {
+            t_min = t;
+            rec.N = N;
+            rec.kind = PRIM_SPHERE;
+            rec.index = int(i);
+        }
+    }
+
+    if (!scene.triangle_bvh.nodes.empty()) {
+        float t_tri = t_min;
+        int hit_index = -1;
+        traverse_bvh(scene.triangle_bvh, r, t_tri, [&](int prim, float& t_closest) {
+            if (tests) (*tests)++;
+            float t;
+            if (hit_triangle_watertight(scene.triangles[prim], r, shear, t_closest, t) && t < t_closest) {
+                t_closest = t;
+                hit_index = prim;
+                return true;
+            }
+            return false;
+        }, nodes);
+        if (hit_index >= 0) {
+            t_min = t_tri;
+            rec.N = triangle_normal(scene.triangles[hit_index]);
+            rec.kind = PRIM_TRIANGLE;
+            rec.index = hit_index;
+        }
+    } else {
+        int hit_index = -1;
+        for (size_t i = 0; i < scene.triangles.size(); i++) {
+            float t;
+            if (hit_triangle_watertight(scene.triangles[i], r, shear, t_min, t) && t < t_min) {
+                t_min = t;
+                hit_index = int(i);
+            }
+        }
+        if (hit_index >= 0) {
+            rec.N = triangle_normal(scene.triangles[hit_index]);
+            rec.kind = PRIM_TRIANGLE;
+            rec.index = hit_index;
+        }
+    }
+
+    for (size_t i = 0; i < scene.cubes.size(); i++) {
+        float t;
+        if (hit_cube(scene.cubes[i], r, t, N) && t > 0.0f && t < t_min) {
+            t_min = t;
+            rec.N = N;
+            rec.kind = PRIM_CUBE;
+            rec.index = int(i);
+        }
+    }
+
+    for (size_t i = 0; i < scene.planes.size(); i++) {
+        float t;
+        if (hit_plane(scene.planes[i], r, t, N) && t > 0.0f && t < t_min) {
+            t_min = t;
+            rec.N = N;
+            rec.kind = PRIM_PLANE;
+            rec.index = int(i);
+        }
+    }
+
+    for (size_t i = 0; i < scene.meshes.size(); i++) {
+        float t = t_min;
+        int level;
+        if (intersect_mesh(scene.meshes[i], r, lod_query(cone, int(i)), 0.0f, t, N, &level, nodes, tests)) {
+            t_min = t;
+            rec.N = N;
+            rec.kind = PRIM_MESH;
+            rec.index = int(i);
+            rec.level = level;
+        }
+    }
+
+    // SDF objects are marched only where the ray is inside their bounds, the BVH skips the others
+    if (!scene.sdf_bvh.nodes.empty()) {
+        float t_sdf = t_min;
+        int hit_index = -1;
+        traverse_bvh(scene.sdf_bvh, r, t_sdf, [&](int prim, float& t_closest) {
+            float t = t_closest;
+            if (intersect_sdf(scene.sdfs[prim], r, 0.0f, t, N, tests)) {
+                t_closest = t;
+                rec.N = N;
+                hit_index = prim;
+                return true;
+            }
+            return false;
+        }, nodes);
+        if (hit_index >= 0) {
+            t_min = t_sdf;
+            rec.kind = PRIM_SDF;
+            rec.index = hit_index;
+        }
+    } else {
+        for (size_t i = 0; i < scene.sdfs.size(); i++) {
+            float t = t_min;
+            if (intersect_sdf(scene.sdfs[i], r, 0.0f, t, N, tests)) {
+                t_min = t;
+                rec.N = N;
+                rec.kind = PRIM_SDF;
+                rec.index = int(i);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < scene.heightfields.size(); i++) {
+        float t = t_min;
+        if (intersect_heightfield(scene.heightfields[i], r, 0.0f, t, N, nodes)) {
+            t_min = t;
+            rec.N = N;
+            rec.kind = PRIM_HEIGHTFIELD;
+            rec.index = int(i);
+        }
+    }
+
+    // Moving primitives at the ray's time
+    if (!scene.moving_sphere_bvh.bvh.nodes.empty()) {
+        float t_moving = t_min;
+        int hit_index = -1;
+        traverse_motion_bvh(scene.moving_sphere_bvh, r, t_moving, [&](int prim, float& t_closest) {
+            if (tests) (*tests)++;
+            float t;
+            if (hit_sphere(sphere_at(scene.moving_spheres[prim], r.time), r, t, N) && t > 0.0f && t < t_closest) {
+                t_closest = t;
+                rec.N = N;
+                hit_index = prim;
+                return true;
+            }
+            return false;
+        }, nodes);
+        if (hit_index >= 0) {
+            t_min = t_moving;
+            rec.kind = PRIM_MOVING_SPHERE;
+            rec.index = hit_index;
+        }
+    } else {
+        for (size_t i = 0; i < scene.moving_spheres.size(); i++) {
+            float t;
+            if (hit_sphere(sphere_at(scene.moving_spheres[i], r.time), r, t, N) && t > 0.0f && t < t_min) {
+                t_min = t;
+                rec.N = N;
+                rec.kind = PRIM_MOVING_SPHERE;
+                rec.index = int(i);
+            }
+        }
+    }
+
+    if (!scene.moving_triangle_bvh.bvh.nodes.empty()) {
+        float t_moving = t_min;
+        int hit_index = -1;
+        traverse_motion_bvh(scene.moving_triangle_bvh, r, t_moving, [&](int prim, float& t_closest) {
+            if (tests) (*tests)++;
+            float t;
+            if (hit_triangle_watertight(triangle_at(scene.moving_triangles[prim], r.time), r, shear, t_closest, t) &&
+                t < t_closest) {
+                t_closest = t;
+                hit_index = prim;
+                return true;
+            }
+            return false;
+        }, nodes);
+        if (hit_index >= 0) {
+            t_min = t_moving;
+            rec.N = triangle_normal(triangle_at(scene.moving_triangles[hit_index], r.time));
+            rec.kind = PRIM_MOVING_TRIANGLE;
+            rec.index = hit_index;
+        }
+    } else {
+        int hit_index = -1;
+        for (size_t i = 0; i < scene.moving_triangles.size(); i++) {
+            float t;
+            if (hit_triangle_watertight(triangle_at(scene.moving_triangles[i], r.time), r, shear, t_min, t) &&
+                t < t_min) {
+                t_min = t;
+                hit_index = int(i);
+            }
+        }
+        if (hit_index >= 0) {
+            rec.N = triangle_normal(triangle_at(scene.moving_triangles[hit_index], r.time));
+            rec.kind = PRIM_MOVING_TRIANGLE;
+            rec.index = hit_index;
+        }
+    }
+
+    if (t_min >= t_max) return false;
+    rec.t = t_min;
+    finish_hit(scene, r, rec);
+    return true;
+}
+
+// Function to check whether anything blocks the ray before t_max (shadow rays). cone should be the one cone_at_hit
+// gives for the hit the ray leaves, so meshes are tested with the path's level choice and the mesh that was hit at
+// the level it was hit at.
+inline bool occluded(const Scene& scene, const ray& r, float t_max, const RayCone& cone = RayCone()) {
+    PROFILE_COUNT(PROF_SHADOW_RAYS, 1);
+    PROFILE_COUNT(PROF_PRIMITIVES, scene.spheres.size());
+    float t;
+    vec3 N;
+    RayShear shear = make_ray_shear(r.D);
+    for (const auto& sphere : scene.spheres) {
+        if (hit_sphere(sphere, r, t, N) && t > 0.0f && t < t_max) return true;
+    }
+
+    if (!scene.triangle_bvh.nodes.empty()) {
+        float t_tri = t_max;
+        bool blocked = false;
+        traverse_bvh(scene.triangle_bvh, r, t_tri, [&](int prim, float& t_closest) {
+            if (hit_triangle_watertight(scene.triangles[prim], r, shear, t_closest, t) && t < t_closest) {
+                blocked = true;
+                t_closest = -1.0f;  // Any hit will do, this makes every remaining box test fail
+                return true;
+            }
+            return false;
+        });
+        if (blocked) return true;
+    } else {
+        PROFILE_COUNT(PROF_PRIMITIVES, scene.triangles.size());
+        for (const auto& tri : scene.triangles) {
+            if (hit_triangle_watertight(tri, r, shear, t_max, t) && t < t_max) return true;
+        }
+    }
+
+    PROFILE_COUNT(PROF_PRIMITIVES, scene.cubes.size() + scene.planes.size());
+    for (const auto& cube : scene.cubes) {
+        if (hit_cube(cube, r, t, N) && t > 0.0f && t < t_max) return true;
+    }
+    for (const auto& plane : scene.planes) {
+        if (hit_plane(plane, r, t, N) && t > 0.0f && t < t_max) return true;
+    }
+    for (size_t i = 0; i < scene.meshes.size(); i++) {
+        t = t_max;
+        if (intersect_mesh(scene.meshes[i], r, lod_query(cone, int(i)), 0.0f, t, N)) return true;
+    }
+
+    if (!scene.sdf_bvh.nodes.empty()) {
+        float t_sdf = t_max;
+        bool blocked = false;
+        traverse_bvh(scene.sdf_bvh, r, t_sdf, [&](int prim, float& t_closest) {
+            t = t_closest;
+            if (intersect_sdf(scene.sdfs[prim], r, 0.0f, t, N)) {
+                blocked = true;
+                t_closest = -1.0f;
+                return true;
+            }
+            return false;
+        });
+        if (blocked) return true;
+    } else {
+        for (const auto& sdf : scene.sdfs) {
+            t = t_max;
+            if (intersect_sdf(sdf, r, 0.0f, t, N)) return true;
+        }
+    }
+    for (const auto& hf : scene.heightfields) {
+        t = t_max;
+        if (intersect_heightfield(hf, r, 0.0f, t, N, nullptr, true)) return true;
+    }
+
+    if (!scene.moving_sphere_bvh.bvh.nodes.empty()) {
+        float t_moving = t_max;
+        bool blocked = false;
+        traverse_motion_bvh(scene.moving_sphere_bvh, r, t_moving, [&](int prim, float& t_closest) {
+            if (hit_sphere(sphere_at(scene.moving_spheres[prim], r.time), r, t, N) && t > 0.0f && t < t_closest) {
+                blocked = true;
+                t_closest = -1.0f;
+                return true;
+            }
+            return false;
+        });
+        if (blocked) return true;
+    } else {
+        for (const auto& sphere : scene.moving_spheres) {
+            if (hit_sphere(sphere_at(sphere, r.time), r, t, N) && t > 0.0f && t < t_max) return true;
+        }
+    }
+
+    if (!scene.moving_triangle_bvh.bvh.nodes.empty()) {
+        float t_moving = t_max;
+        bool blocked = false;
+        traverse_motion_bvh(scene.moving_triangle_bvh, r, t_moving, [&](int prim, float& t_closest) {
+            if (hit_triangle_watertight(triangle_at(scene.moving_triangles[prim], r.time), r, shear, t_closest, t) &&
+                t < t_closest) {
+                blocked = true;
+                t_closest = -1.0f;
+                return true;
+            }
+            return false;
+        });
+        if (blocked) return true;
+    } else {
+        for (const auto& tri : scene.moving_triangles) {
+            if (hit_triangle_watertight(triangle_at(tri, r.time), r, shear, t_max, t) && t < t_max) return true;
+        }
+    }
+    return false;
+}
+
+// Background color: white to light blue gradient along the ray's y direction
+inline vec3 sky_color(const ray& r) {
+    vec3 unit_direction = unit_vector(r.direction());
+    float t = 0.5 * (unit_direction.y() + 1.0);
+    return (1.0 - t) * vec3(1, 1, 1) + t * vec3(0.5, 0.7, 1.0);
+}
+
+// Cone of a camera ray with direction D, from the direction differentials dDdx and dDdy between neighbouring
+// pixels: the spread is the larger angle between D and its neighbours
+inline RayCone camera_cone(const vec3& D, const vec3& dDdx, const vec3& dDdy) {
+    float len = D.length();
+    vec3 n = D / len;
+    float sx = (dDdx - dot(dDdx, n) * n).length();
+    float sy = (dDdy - dot(dDdy, n) * n).length();
+    RayCone cone;
+    cone.spread = (sx > sy ? sx : sy) / len;
+    return cone;
+}
+
+// Cone continuing from a hit at distance t along r, the spread and level choice are kept
+inline RayCone cone_at_hit(const RayCone& cone, const ray& r, float t) {
+    RayCone next = cone;
+    next.width = cone.width + cone.spread * t * r.direction().length();
+    return next;
+}
+
+// Cone of the shadow and bounce rays leaving the hit rec, which keep a mesh that was hit at its level
+inline RayCone cone_at_hit(const RayCone& cone, const ray& r, const HitRecord& rec) {
+    RayCone next = cone_at_hit(cone, r, rec.t);
+    next.lod_mesh = rec.kind == PRIM_MESH ? rec.index : -1;
+    next.lod_level = rec.kind == PRIM_MESH ? rec.level : 0;
+    return next;
+}
+
+// Function to compute the texture coordinates of a hit and how many texture units one world unit spans there.
+// Returns false for primitives without a texture mapping: spheres, cubes, meshes, SDF objects, heightfields and
+// moving primitives.
+inline bool surface_uv(const Scene& scene, const HitRecord& rec, float& u, float& v, float& uv_per_world) {
+    if (rec.kind == PRIM_PLANE) {
+        const Plane& plane = scene.planes[rec.index];
+        vec3 u_axis, v_axis;
+        if (rec.index < int(scene.plane_uvs.size())) {
+            u_axis = scene.plane_uvs[rec.index].u_axis;
+            v_axis = scene.plane_uvs[rec.index].v_axis;
+        } else {
+            make_basis(unit_vector(plane.normal), u_axis, v_axis);
+        }
+        vec3 d = rec.p - plane.point;
+        u = dot(d, u_axis);
+        v = dot(d, v_axis);
+        float lu = u_axis.length(), lv = v_axis.length();
+        uv_per_world = lu > lv ? lu : lv;
+        return true;
+    }
+    if (rec.kind == PRIM_TRIANGLE) {
+        const Triangle& tri = scene.triangles[rec.index];
+        TriangleUV uv = {{0, 1, 0}, {0, 0, 1}};
+        if (rec.index < int(scene.triangle_uvs.size())) uv = scene.triangle_uvs[rec.index];
+        // Barycentric coordinates of the hit point
+        vec3 e1 = tri.v1 - tri.v0, e2 = tri.v2 - tri.v0, d = rec.p - tri.v0;
+        float d11 = dot(e1, e1), d12 = dot(e1, e2), d22 = dot(e2, e2);
+        float d1 = dot(d, e1), d2 = dot(d, e2);
+        float denom = d11 * d22 - d12 * d12;
+        if (denom <= 0.0f) return false;
+        float b1 = (d22 * d1 - d12 * d2) / denom;
+        float b2 = (d11 * d2 - d12 * d1) / denom;
+        float b0 = 1.0f - b1 - b2;
+        u = b0 * uv.u[0] + b1 * uv.u[1] + b2 * uv.u[2];
+        v = b0 * uv.v[0] + b1 * uv.v[1] + b2 * uv.v[2];
+        float uv_area = fabsf((uv.u[1] - uv.u[0]) * (uv.v[2] - uv.v[0]) - (uv.u[2] - uv.u[0]) * (uv.v[1] - uv.v[0]));
+        uv_per_world = sqrtf(uv_area / sqrtf(denom));  // sqrt(denom) is twice the world area, as uv_area is for uvs
+        return true;
+    }
+    return false;
+}
+
+// World-space width of the cone's footprint on the surface at a hit, grazing hits stretch it by 1 / cos
+inline float footprint_width(const RayCone& cone, const ray& r, const HitRecord& rec) {
+    float cos_theta = fabsf(dot(rec.N, unit_vector(r.direction())));
+    return cone_at_hit(cone, r, rec.t).width / (cos_theta > 0.1f ? cos_theta : 0.1f);
+}
+
+// Albedo at a hit: the material's albedo times its texture, filtered over the ray's footprint. Footprint is one of
+// the footprint types of RayDifferential.h.
+template <class Footprint>
+inline vec3 surface_albedo(const Scene& scene, const HitRecord& rec, const Material& m, const ray& r, const Footprint& fp) {
+    if (m.texture < 0 || !scene.textures) return m.albedo;
+    float u, v, uv_per_world;
+    if (!surface_uv(scene, rec, u, v, uv_per_world)) return m.albedo;
+    return m.albedo * scene.textures->sample(m.texture, u, v, footprint_width(fp, r, rec) * uv_per_world);
+}
+
+#endif // SCENE_H
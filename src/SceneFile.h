@@ -0,0 +1,127 @@
+#ifndef SCENE_FILE_H
+#define SCENE_FILE_H
+
+#include <vector>
+#include <string>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include "vec3.h"
+#include "Scene.h"
+#include "Material.h"
+
+using namespace std;
+
+// Scene description files, for scenes that are not built in code. One item per line, '#' starts a comment:
+//   material <name> diffuse|mirror|glossy|glass <r g b> [roughness, or index of refraction for glass]
+//   sphere <x y z> <radius> [material]
+//   triangle <x y z> <x y z> <x y z> [material]
+//   cube <x y z> <side length> [material]
+//   plane <x y z> <normal x y z> [material]
+//   light <x y z> <r g b>
+// Materials must be defined before they are used; primitives without one get material 0, white diffuse.
+
+inline bool read_vec3(istream& in, vec3& v) {
+    float x, y, z;
+    if (!(in >> x >> y >> z)) return false;
+    v = vec3(x, y, z);
+    return true;
+}
+
+// Function to read a scene description from in, the BVHs are left to build_scene_bvh. Returns false with error set
+// to the line at fault, prefixed by path, if it is malformed.
+inline bool load_scene(istream& file, const string& path, Scene& scene, string& error) {
+    scene = Scene();
+    map<string, MaterialId> materials;
+    string line;
+    int number = 0;
+    while (getline(file, line)) {
+        number++;
+        size_t comment = line.find('#');
+        if (comment != string::npos) line.resize(comment);
+        istringstream in(line);
+        string item;
+        if (!(in >> item)) continue;
+
+        bool ok = true;
+        PrimitiveKind kind = PRIM_KIND_COUNT;
+        if (item == "material") {
+            string name, type;
+            vec3 albedo;
+            Material m;
+            ok = bool(in >> name >> type) && read_vec3(in, albedo);
+            m.albedo = albedo;
+            if (type == "mirror") {
+                m.type = MAT_MIRROR;
+            } else if (type == "glossy") {
+                m.type = MAT_GLOSSY;
+                in >> m.roughness;
+            } else if (type == "glass") {
+                m.type = MAT_DIELECTRIC;
+                in >> m.ior;
+            } else if (type != "diffuse") {
+                ok = false;
+            }
+            if (ok) materials[name] = scene.materials.add(m);
+        } else if (item == "sphere") {
+            Sphere s;
+            ok = read_vec3(in, s.center) && bool(in >> s.radius);
+            scene.spheres.push_back(s);
+            kind = PRIM_SPHERE;
+        } else if (item == "triangle") {
+            Triangle tri;
+            ok = read_vec3(in, tri.v0) && read_vec3(in, tri.v1) && read_vec3(in, tri.v2);
+            scene.triangles.push_back(tri);
+            kind = PRIM_TRIANGLE;
+        } else if (item == "cube") {
+            Cube cube;
+            ok = read_vec3(in, cube.center) && bool(in >> cube.side_length);
+            scene.cubes.push_back(cube);
+            kind = PRIM_CUBE;
+        } else if (item == "plane") {
+            Plane plane;
+            ok = read_vec3(in, plane.point) && read_vec3(in, plane.normal);
+            plane.normal = unit_vector(plane.normal);
+            scene.planes.push_back(plane);
+            kind = PRIM_PLANE;
+        } else if (item == "light") {
+            Light light;
+            ok = read_vec3(in, light.position) && read_vec3(in, light.intensity);
+            scene.lights.push_back(light);
+        } else {
+            ok = false;
+        }
+
+        // The optional material name after a primitive
+        string name;
+        if (ok && kind != PRIM_KIND_COUNT && in >> name) {
+            auto it = materials.find(name);
+            ok = it != materials.end();
+            if (ok) {
+                int index = 0;
+                if (kind == PRIM_SPHERE) index = int(scene.spheres.size()) - 1;
+                if (kind == PRIM_TRIANGLE) index = int(scene.triangles.size()) - 1;
+                if (kind == PRIM_CUBE) index = int(scene.cubes.size()) - 1;
+                if (kind == PRIM_PLANE) index = int(scene.planes.size()) - 1;
+                set_material(scene, kind, index, it->second);
+            }
+        }
+        if (!ok) {
+            error = path + ":" + to_string(number) + ": cannot read \"" + line + "\"";
+            return false;
+        }
+    }
+    return true;
+}
+
+// Function to load a scene file. Returns false with error set if the file is missing or malformed.
+inline bool load_scene(const string& path, Scene& scene, string& error) {
+    ifstream file(path);
+    if (!file) {
+        error = "cannot open " + path;
+        return false;
+    }
+    return load_scene(file, path, scene, error);
+}
+
+#endif // SCENE_FILE_H
@@ -0,0 +1,184 @@
+#ifndef SHADING_MODES_H
+#define SHADING_MODES_H
+
+#include <vector>
+#include <string>
+#include "vec3.h"
+#include "ray.h"
+#include "Scene.h"
+#include "Material.h"
+#include "Random.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+using namespace std;
+
+// The scenes of the first homework (the skybox, dusk, normal, shading, colorful light, plane and multiple programs)
+// as shading modes of the shared engine. Each mode is a Scene plus the way its pixels are colored, rendered with the
+// homework's viewport and one ray per pixel through the pixel's lower left corner.
+
+// How a mode colors its pixels
+enum ShadingMode {
+    SHADE_FLAT,       // Hits in flat_color, misses in a vertical sky gradient
+    SHADE_NORMAL,     // Hits colored by their normal, 0.5 * (N + 1)
+    SHADE_LIT,        // trace_path with direct lighting only, like bonus.cpp
+    SHADE_NO_SHADOWS  // Emission plus diffuse light from every light, none of them blocked
+};
+
+// Define a shading variant: the scene, how it is shaded and the image size it was rendered at
+struct ShadingVariant {
+    string name;
+    Scene scene;
+    ShadingMode shading = SHADE_LIT;
+    vec3 flat_color;
+    float normal_t = -1;  // SHADE_NORMAL: ray parameter a sphere's normal is taken at instead of the hit, if not negative
+    vec3 sky_bottom = vec3(1, 1, 1);
+    vec3 sky_top = vec3(0.5, 0.7, 1.0);
+    int width = 200;
+    int height = 100;
+};
+
+// Function to compute the color of a ray in the variant's shading mode
+inline vec3 shade_variant(const ShadingVariant& sv, const ray& r, Rng& rng, RayCounters& counters) {
+    if (sv.shading == SHADE_LIT) {
+        TraceSettings settings;
+        settings.samples_per_pixel = 1;
+        settings.diffuse_bounces = false;
+        return trace_path(sv.scene, r, settings, rng, counters);
+    }
+    counters.rays++;
+    HitRecord rec;
+    if (intersect_scene(sv.scene, r, rec)) {
+        if (sv.shading == SHADE_FLAT) return sv.flat_color;
+        if (sv.shading == SHADE_NO_SHADOWS) {
+            Material m = material_of(sv.scene, rec.kind, rec.index);
+            vec3 N = face_forward(rec.N, r);
+            vec3 col = m.emission;
+            for (const Light& light : sv.scene.lights) {
+                col += m.albedo * light.intensity * max(dot(N, unit_vector(light.position - rec.p)), 0.0f);
+            }
+            return col;
+        }
+        vec3 N = unit_vector(rec.N);
+        if (sv.normal_t >= 0 && rec.kind == PRIM_SPHERE) {
+            N = unit_vector(r.point_at_parameter(sv.normal_t) - sv.scene.spheres[rec.index].center);
+        }
+        return 0.5f * vec3(N.x() + 1, N.y() + 1, N.z() + 1);
+    }
+    vec3 unit_direction = unit_vector(r.direction());
+    float t = 0.5f * (unit_direction.y() + 1.0f);
+    return (1.0f - t) * sv.sky_bottom + t * sv.sky_top;
+}
+
+// Function to render a variant into fb, whose size it takes: rows in parallel, the camera rays of a row generated in
+// one batch
+inline RayCounters render_variant(const ShadingVariant& sv, Framebuffer& fb) {
+    Camera camera = viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), fb.width, fb.height);
+    RayCounters total;
+    mutex total_mutex;
+    parallel_for(fb.height, 4, [&](int begin, int end) {
+        RayCounters counters;
+        CameraRays rays;
+        rays.resize(fb.width);
+        for (int j = begin; j < end; j++) {
+            Rng rng(uint64_t(j), 1);
+            for (int i = 0; i < fb.width; i++) {
+                rays.s[i] = float(i) / float(fb.width);
+                rays.t[i] = float(j) / float(fb.height);
+            }
+            camera.generate(rays, 0, rays.size, rng);
+            for (int i = 0; i < fb.width; i++) fb.at(i, j) = shade_variant(sv, rays.get(i), rng, counters);
+        }
+        lock_guard<mutex> lock(total_mutex);
+        total.add(counters);
+    });
+    return total;
+}
+
+// The lights of the colorful light, plane and multiple programs
+const vector<Light> HW1_LIGHTS = {
+    {vec3(-1, 1, 0), vec3(1, 0, 1)},  // Purple light
+    {vec3(2, 1, 0), vec3(1, 1, 0)}    // Yellow light
+};
+
+// Function to build every shading variant, with the BVHs built
+inline vector<ShadingVariant> make_shading_variants() {
+    vector<ShadingVariant> variants;
+    ShadingVariant sv;
+
+    // Red sphere before the blue sky
+    sv = ShadingVariant();
+    sv.name = "skybox";
+    sv.scene.spheres = {{vec3(0, 0, -1), 0.5f}};
+    sv.shading = SHADE_FLAT;
+    sv.flat_color = vec3(1, 0, 0);
+    variants.push_back(sv);
+
+    // Red sphere before an orange sky
+    sv.name = "dusk";
+    sv.sky_bottom = vec3(1.0, 0.55, 0.0);
+    sv.sky_top = vec3(1.0, 0.84, 0.27);
+    variants.push_back(sv);
+
+    // The sphere colored by its normals, which the normal program takes at ray parameter 0.5 rather than at the hit
+    sv = ShadingVariant();
+    sv.name = "normal";
+    sv.scene.spheres = {{vec3(0, 0, -1), 0.5f}};
+    sv.shading = SHADE_NORMAL;
+    sv.normal_t = 0.5f;
+    variants.push_back(sv);
+
+    // The sphere lit by one white light
+    sv = ShadingVariant();
+    sv.name = "shading";
+    sv.scene.spheres = {{vec3(0, 0, -1), 0.5f}};
+    sv.scene.lights = {{vec3(1, 1, 0), vec3(1, 1, 1)}};
+    variants.push_back(sv);
+
+    // The sphere under the purple and yellow lights
+    sv.name = "colorful";
+    sv.scene.lights = HW1_LIGHTS;
+    variants.push_back(sv);
+
+    // The sphere resting on a plane that glows grey, without shadows
+    sv = ShadingVariant();
+    sv.name = "plane";
+    sv.shading = SHADE_NO_SHADOWS;
+    sv.scene.lights = HW1_LIGHTS;
+    sv.scene.spheres = {{vec3(0, 0, -1), 0.5f}};
+    sv.scene.planes = {{vec3(0, -0.5, -1), vec3(0, 1, 0)}};
+    Material plane;
+    plane.emission = vec3(0.8, 0.8, 0.8);
+    sv.scene.material_ids[PRIM_PLANE] = {sv.scene.materials.add(plane)};
+    variants.push_back(sv);
+
+    // A small sphere, a triangle and a cube, without shadows
+    sv = ShadingVariant();
+    sv.name = "multiple";
+    sv.shading = SHADE_NO_SHADOWS;
+    sv.width = 800;
+    sv.height = 400;
+    sv.scene.lights = HW1_LIGHTS;
+    sv.scene.spheres = {{vec3(0, 0, -1), 0.2f}};
+    sv.scene.triangles = {{vec3(0.5, -0.25, -1), vec3(1.5, -0.25, -1), vec3(1, 0.25, -1)}};
+    sv.scene.cubes = {{vec3(-1, 0, -1.25), 0.5f}};
+    variants.push_back(sv);
+
+    for (ShadingVariant& v : variants) build_scene_bvh(v.scene);
+    return variants;
+}
+
+// Function to look up a variant by name. Returns false if there is none.
+inline bool find_shading_variant(const vector<ShadingVariant>& variants, const string& name, ShadingVariant& sv) {
+    for (const ShadingVariant& v : variants) {
+        if (v.name == name) {
+            sv = v;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif // SHADING_MODES_H
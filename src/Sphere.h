@@ -9,7 +9,8 @@ struct Sphere {
     float radius;
 };
 
-bool hit_sphere(const Sphere& sphere, const ray& r, float& t, vec3& N) {
+// t_min: if the near root lies before it (ray starting inside the sphere) the far root is returned instead
+inline bool hit_sphere(const Sphere& sphere, const ray& r, float& t, vec3& N, float t_min = 0.0f) {
     vec3 oc = r.origin() - sphere.center;
     float a = dot(r.direction(), r.direction());
     float b = 2.0 * dot(oc, r.direction());
@@ -19,6 +20,7 @@ bool hit_sphere(const Sphere& sphere, const ray& r, float& t, vec3& N) {
         return false;
     } else {
         t = (-b - sqrt(discriminant)) / (2.0 * a);
+        if (t < t_min) t = (-b + sqrt(discriminant)) / (2.0 * a);
         N = unit_vector(r.point_at_parameter(t) - sphere.center);
         return true;
     }
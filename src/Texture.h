@@ -0,0 +1,323 @@
+#ifndef TEXTURE_H
+#define TEXTURE_H
+
+#include <vector>
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include "vec3.h"
+#include "Image.h"
+
+using namespace std;
+
+// Image textures that do not have to fit in memory. A texture is converted once into a tiled file holding its
+// whole mip chain; rendering then pulls in only the tiles it touches through a TextureCache, which keeps the most
+// recently used tiles under a fixed memory budget.
+//
+// Tiled file layout: TiledTextureHeader, then every mip level from the finest, each as tiles_x * tiles_y tiles in
+// row-major order. A tile is tile_size * tile_size 8-bit RGB texels; tiles on the right and bottom edges are padded
+// so all tiles have the same size and can be addressed directly.
+
+const char TILED_TEXTURE_MAGIC[4] = {'T', 'T', 'X', '1'};
+const int DEFAULT_TILE_SIZE = 64;
+const int TEXTURE_CACHE_SHARDS = 16;  // Independently locked parts of the cache, so threads rarely wait
+
+struct TiledTextureHeader {
+    char magic[4];
+    int32_t width;
+    int32_t height;
+    int32_t tile_size;
+    int32_t levels;
+};
+
+// Size of mip level l of a width x height image
+inline int mip_size(int size, int level) {
+    int s = size >> level;
+    return s > 0 ? s : 1;
+}
+
+inline int mip_level_count(int width, int height) {
+    int levels = 1;
+    while (mip_size(width, levels - 1) > 1 || mip_size(height, levels - 1) > 1) levels++;
+    return levels;
+}
+
+// Write an 8-bit RGB image as a tiled texture with its mip chain (2x2 box filter). Returns false if the file cannot
+// be written.
+inline bool write_tiled_texture(const string& path, int width, int height, const vector<uint8_t>& rgb,
+                                int tile_size = DEFAULT_TILE_SIZE) {
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) return false;
+    TiledTextureHeader header;
+    memcpy(header.magic, TILED_TEXTURE_MAGIC, 4);
+    header.width = width;
+    header.height = height;
+    header.tile_size = tile_size;
+    header.levels = mip_level_count(width, height);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+
+    vector<uint8_t> level = rgb;
+    vector<uint8_t> tile(size_t(tile_size) * tile_size * 3);
+    for (int l = 0; l < header.levels && ok; l++) {
+        int w = mip_size(width, l), h = mip_size(height, l);
+        if (l > 0) {
+            // Average 2x2 blocks of the previous level, clamping at its edges
+            int pw = mip_size(width, l - 1), ph = mip_size(height, l - 1);
+            vector<uint8_t> next(size_t(w) * h * 3);
+            for (int y = 0; y < h; y++) {
+                for (int x = 0; x < w; x++) {
+                    for (int c = 0; c < 3; c++) {
+                        int sum = 0;
+                        for (int k = 0; k < 4; k++) {
+                            int sx = 2 * x + (k & 1), sy = 2 * y + (k >> 1);
+                            sx = sx < pw ? sx : pw - 1;
+                            sy = sy < ph ? sy : ph - 1;
+                            sum += level[(size_t(sy) * pw + sx) * 3 + c];
+                        }
+                        next[(size_t(y) * w + x) * 3 + c] = uint8_t((sum + 2) / 4);
+                    }
+                }
+            }
+            level.swap(next);
+        }
+        int tiles_x = (w + tile_size - 1) / tile_size, tiles_y = (h + tile_size - 1) / tile_size;
+        for (int ty = 0; ty < tiles_y && ok; ty++) {
+            for (int tx = 0; tx < tiles_x && ok; tx++) {
+                for (int y = 0; y < tile_size; y++) {
+                    for (int x = 0; x < tile_size; x++) {
+                        int sx = tx * tile_size + x, sy = ty * tile_size + y;
+                        sx = sx < w ? sx : w - 1;
+                        sy = sy < h ? sy : h - 1;
+                        memcpy(&tile[(size_t(y) * tile_size + x) * 3], &level[(size_t(sy) * w + sx) * 3], 3);
+                    }
+                }
+                ok = fwrite(tile.data(), 1, tile.size(), file) == tile.size();
+            }
+        }
+    }
+    return fclose(file) == 0 && ok;
+}
+
+// Convert a PPM image into a tiled texture file
+inline bool convert_ppm_texture(const string& ppm_path, const string& texture_path, int tile_size = DEFAULT_TILE_SIZE) {
+    int width, height;
+    vector<uint8_t> rgb;
+    if (!read_ppm(ppm_path, width, height, rgb)) return false;
+    return write_tiled_texture(texture_path, width, height, rgb, tile_size);
+}
+
+// Counters of a TextureCache since it was created or its stats were reset
+struct TextureCacheStats {
+    uint64_t lookups = 0;         // Tile requests
+    uint64_t hits = 0;            // Requests served from memory
+    uint64_t misses = 0;          // Requests that read the tile from disk
+    uint64_t evictions = 0;       // Tiles dropped to stay within the budget
+    uint64_t bytes_read = 0;      // Texture I/O volume
+    uint64_t resident_bytes = 0;  // Tile memory currently held
+
+    inline double hit_rate() const { return lookups ? double(hits) / lookups : 0.0; }
+};
+
+// Define the texture cache: the open tiled textures and an LRU set of their tiles bounded by budget_bytes
+struct TextureCache {
+    struct Texture {
+        string path;
+        FILE* file = nullptr;
+        mutex file_mutex;             // One reader at a time per file
+        int width = 0, height = 0;
+        int tile_size = 0;
+        int levels = 0;
+        vector<long> level_offset;    // File offset of each level's first tile
+        vector<int> tiles_x;          // Tiles per row of each level
+    };
+
+    typedef vector<uint8_t> Tile;
+    typedef list<pair<uint64_t, shared_ptr<const Tile>>> TileList;
+
+    struct Shard {
+        mutex lock;
+        TileList lru;  // Most recently used first
+        unordered_map<uint64_t, TileList::iterator> index;
+        size_t bytes = 0;
+    };
+
+    size_t budget_bytes;
+    bool mipmapping = true;  // false samples level 0 only, to compare against
+    vector<unique_ptr<Texture>> textures;
+    Shard shards[TEXTURE_CACHE_SHARDS];
+    atomic<uint64_t> lookups{0}, hits{0}, misses{0}, evictions{0}, bytes_read{0};
+
+    explicit TextureCache(size_t budget = size_t(64) << 20) : budget_bytes(budget) {}
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    ~TextureCache() {
+        for (auto& t : textures) fclose(t->file);
+    }
+
+    // Open a tiled texture file. Only the header is read. Returns the texture id, or -1 if the file is unusable.
+    int open(const string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) return -1;
+        TiledTextureHeader header;
+        if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TILED_TEXTURE_MAGIC, 4) != 0 ||
+            header.width <= 0 || header.height <= 0 || header.tile_size <= 0 ||
+            header.levels != mip_level_count(header.width, header.height)) {
+            fclose(file);
+            return -1;
+        }
+        unique_ptr<Texture> t(new Texture());
+        t->path = path;
+        t->file = file;
+        t->width = header.width;
+        t->height = header.height;
+        t->tile_size = header.tile_size;
+        t->levels = header.levels;
+        long offset = long(sizeof(header));
+        long tile_bytes = long(header.tile_size) * header.tile_size * 3;
+        for (int l = 0; l < header.levels; l++) {
+            int tx = (mip_size(header.width, l) + header.tile_size - 1) / header.tile_size;
+            int ty = (mip_size(header.height, l) + header.tile_size - 1) / header.tile_size;
+            t->level_offset.push_back(offset);
+            t->tiles_x.push_back(tx);
+            offset += tile_bytes * tx * ty;
+        }
+        textures.push_back(move(t));
+        return int(textures.size()) - 1;
+    }
+
+    // Tile (tx, ty) of a mip level, read from disk and possibly evicting others if it is not resident
+    shared_ptr<const Tile> tile(int texture, int level, int tx, int ty) {
+        uint64_t key = (uint64_t(texture) << 48) | (uint64_t(level) << 40) | (uint64_t(ty) << 20) | uint64_t(tx);
+        Shard& shard = shards[(key * 0x9E3779B97F4A7C15ull) >> 60];
+        lookups.fetch_add(1, memory_order_relaxed);
+        {
+            lock_guard<mutex> guard(shard.lock);
+            auto it = shard.index.find(key);
+            if (it != shard.index.end()) {
+                shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+                hits.fetch_add(1, memory_order_relaxed);
+                return it->second->second;
+            }
+        }
+
+        // Miss: read the tile without holding the shard, another thread may load the same tile meanwhile
+        Texture& t = *textures[texture];
+        size_t size = size_t(t.tile_size) * t.tile_size * 3;
+        shared_ptr<Tile> data = make_shared<Tile>(size);
+        {
+            lock_guard<mutex> guard(t.file_mutex);
+            long offset = t.level_offset[level] + long(size) * (long(ty) * t.tiles_x[level] + tx);
+            if (fseek(t.file, offset, SEEK_SET) != 0 || fread(data->data(), 1, size, t.file) != size) {
+                fill(data->begin(), data->end(), uint8_t(0));  // Truncated file: black rather than garbage
+            }
+        }
+        misses.fetch_add(1, memory_order_relaxed);
+        bytes_read.fetch_add(size, memory_order_relaxed);
+
+        lock_guard<mutex> guard(shard.lock);
+        auto it = shard.index.find(key);
+        if (it != shard.index.end()) return it->second->second;
+        shard.lru.emplace_front(key, data);
+        shard.index[key] = shard.lru.begin();
+        shard.bytes += size;
+        size_t shard_budget = budget_bytes / TEXTURE_CACHE_SHARDS;
+        while (shard.bytes > shard_budget && shard.lru.size() > 1) {
+            shard.bytes -= shard.lru.back().second->size();
+            shard.index.erase(shard.lru.back().first);
+            shard.lru.pop_back();
+            evictions.fetch_add(1, memory_order_relaxed);
+        }
+        return data;
+    }
+
+    // Bilinear lookup in one mip level, texture coordinates repeat outside [0, 1)
+    vec3 sample_level(int texture, int level, float u, float v) {
+        const Texture& t = *textures[texture];
+        int w = mip_size(t.width, level), h = mip_size(t.height, level);
+        float x = u * w - 0.5f, y = v * h - 0.5f;
+        float fx = floorf(x), fy = floorf(y);
+        int x0 = int(fx), y0 = int(fy);
+        float ax = x - fx, ay = y - fy;
+
+        // The four texels usually share a tile, fetch each distinct tile once
+        int last_tx = -1, last_ty = -1;
+        shared_ptr<const Tile> last;
+        float c[4][3];
+        for (int k = 0; k < 4; k++) {
+            int px = (x0 + (k & 1)) % w, py = (y0 + (k >> 1)) % h;
+            if (px < 0) px += w;
+            if (py < 0) py += h;
+            int tx = px / t.tile_size, ty = py / t.tile_size;
+            if (tx != last_tx || ty != last_ty) {
+                last = tile(texture, level, tx, ty);
+                last_tx = tx;
+                last_ty = ty;
+            }
+            const uint8_t* texel = &(*last)[(size_t(py % t.tile_size) * t.tile_size + px % t.tile_size) * 3];
+            for (int ch = 0; ch < 3; ch++) c[k][ch] = texel[ch] * (1.0f / 255.0f);
+        }
+        vec3 result;
+        for (int ch = 0; ch < 3; ch++) {
+            float top = c[0][ch] + ax * (c[1][ch] - c[0][ch]);
+            float bottom = c[2][ch] + ax * (c[3][ch] - c[2][ch]);
+            result[ch] = top + ay * (bottom - top);
+        }
+        return result;
+    }
+
+    // Trilinear lookup. footprint is the width of the area to filter in texture coordinates (1 = whole texture).
+    vec3 sample(int texture, float u, float v, float footprint) {
+        if (!mipmapping) return sample_level(texture, 0, u, v);
+        const Texture& t = *textures[texture];
+        float texels = footprint * float(t.width > t.height ? t.width : t.height);
+        float lod = texels > 1.0f ? log2f(texels) : 0.0f;
+        if (lod >= float(t.levels - 1)) return sample_level(texture, t.levels - 1, u, v);
+        int level = int(lod);
+        float blend = lod - float(level);
+        vec3 fine = sample_level(texture, level, u, v);
+        if (blend <= 0.0f) return fine;
+        return fine + blend * (sample_level(texture, level + 1, u, v) - fine);
+    }
+
+    TextureCacheStats stats() {
+        TextureCacheStats s;
+        s.lookups = lookups.load();
+        s.hits = hits.load();
+        s.misses = misses.load();
+        s.evictions = evictions.load();
+        s.bytes_read = bytes_read.load();
+        for (auto& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            s.resident_bytes += shard.bytes;
+        }
+        return s;
+    }
+
+    void reset_stats() {
+        lookups = 0;
+        hits = 0;
+        misses = 0;
+        evictions = 0;
+        bytes_read = 0;
+    }
+
+    // Drop every resident tile, the next lookups start from a cold cache
+    void clear() {
+        for (auto& shard : shards) {
+            lock_guard<mutex> guard(shard.lock);
+            shard.lru.clear();
+            shard.index.clear();
+            shard.bytes = 0;
+        }
+    }
+};
+
+#endif // TEXTURE_H
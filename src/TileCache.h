@@ -0,0 +1,150 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <vector>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <functional>
+
+using namespace std;
+
+// Content-addressed cache of finished tiles, in memory and optionally on disk. A tile is stored under a hash of
+// everything its pixels depend on (scene content, camera, settings, image size and tile rectangle, see
+// render_service's tile_key), so repeated requests are served without rendering and anything that changes the
+// pixels changes the key. Memory holds the most recently used tiles up to a byte budget, the disk one file per tile.
+
+// Bumped whenever the renderer's output changes, so tiles cached by an older renderer are not served
+const uint64_t TILE_CACHE_VERSION = 1;
+
+// 64-bit FNV-1a, fed field by field
+struct ContentHash {
+    uint64_t value = 14695981039346656037ull;
+
+    void add(const void* data, size_t size) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        for (size_t i = 0; i < size; i++) {
+            value ^= p[i];
+            value *= 1099511628211ull;
+        }
+    }
+    void add(float v) { add(&v, sizeof(v)); }
+    void add(int v) { add(&v, sizeof(v)); }
+    void add(uint64_t v) { add(&v, sizeof(v)); }
+    void add(const string& s) {
+        add(uint64_t(s.size()));
+        add(s.data(), s.size());
+    }
+};
+
+// Hit and byte counts since the cache was created
+struct TileCacheStats {
+    uint64_t lookups = 0;
+    uint64_t memory_hits = 0;
+    uint64_t disk_hits = 0;
+    uint64_t bytes_saved = 0;    // Tile bytes served from the cache instead of rendered
+    uint64_t memory_bytes = 0;   // Held in memory now
+    uint64_t stores = 0;
+
+    double hit_rate() const { return lookups ? double(memory_hits + disk_hits) / lookups : 0.0; }
+};
+
+// Define the tile cache. Tiles are opaque byte strings; thread safe.
+struct TileCache {
+    typedef list<pair<uint64_t, vector<uint8_t>>> LruList;  // Most recently used first
+
+    mutex lock;
+    LruList lru;
+    unordered_map<uint64_t, LruList::iterator> index;
+    size_t memory_budget;
+    string directory;  // Empty keeps the tiles in memory only
+    TileCacheStats stats;
+    atomic<uint64_t> temp_counter{0};
+
+    explicit TileCache(size_t budget = size_t(256) << 20, const string& dir = "")
+        : memory_budget(budget), directory(dir) {}
+
+    string tile_path(uint64_t key) const {
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.tile", (unsigned long long)key);
+        return directory + name;
+    }
+
+    // Function to look a tile of size bytes up, in memory first, then on disk. Returns false if it is in neither, or
+    // only with another size (a truncated file), which does not count as a hit.
+    bool find(uint64_t key, size_t size, vector<uint8_t>& data) {
+        {
+            lock_guard<mutex> guard(lock);
+            stats.lookups++;
+            auto it = index.find(key);
+            if (it != index.end() && it->second->second.size() == size) {
+                lru.splice(lru.begin(), lru, it->second);
+                data = it->second->second;
+                stats.memory_hits++;
+                stats.bytes_saved += data.size();
+                return true;
+            }
+        }
+        if (directory.empty() || !read_tile_file(tile_path(key), data) || data.size() != size) return false;
+        lock_guard<mutex> guard(lock);
+        stats.disk_hits++;
+        stats.bytes_saved += data.size();
+        insert_locked(key, data);
+        return true;
+    }
+
+    // Function to store a finished tile in memory and on disk
+    void store(uint64_t key, const vector<uint8_t>& data) {
+        if (!directory.empty()) {
+            // Written under a temporary name and renamed, so a reader never sees half a file
+            char suffix[64];
+            snprintf(suffix, sizeof(suffix), ".%zx.%llu", hash<thread::id>()(this_thread::get_id()),
+                     (unsigned long long)temp_counter++);
+            string path = tile_path(key), temp = path + suffix;
+            ofstream file(temp, ios::out | ios::binary);
+            file.write(reinterpret_cast<const char*>(data.data()), data.size());
+            file.close();
+            if (!file || rename(temp.c_str(), path.c_str()) != 0) remove(temp.c_str());
+        }
+        lock_guard<mutex> guard(lock);
+        stats.stores++;
+        insert_locked(key, data);
+    }
+
+    TileCacheStats get_stats() {
+        lock_guard<mutex> guard(lock);
+        return stats;
+    }
+
+    void insert_locked(uint64_t key, const vector<uint8_t>& data) {
+        if (data.size() > memory_budget || index.count(key)) return;
+        lru.emplace_front(key, data);
+        index[key] = lru.begin();
+        stats.memory_bytes += data.size();
+        while (stats.memory_bytes > memory_budget) {
+            stats.memory_bytes -= lru.back().second.size();
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+
+    static bool read_tile_file(const string& path, vector<uint8_t>& data) {
+        ifstream file(path, ios::in | ios::binary | ios::ate);
+        if (!file) return false;
+        streamoff size = file.tellg();
+        if (size <= 0) return false;
+        data.resize(size_t(size));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(data.data()), size);
+        return bool(file);
+    }
+};
+
+#endif // TILE_CACHE_H
@@ -0,0 +1,258 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <vector>
+#include <mutex>
+#include <cstdint>
+#include <cfloat>
+#include "vec3.h"
+#include "ray.h"
+#include "Scene.h"
+#include "Material.h"
+#include "Random.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Camera.h"
+#include "RayDifferential.h"
+
+using namespace std;
+
+const int TRACE_MAX_DEPTH = 64;  // Upper bound for TraceSettings::max_depth
+
+// Settings shared by the per-pixel recursive renderer and the wavefront renderer
+struct TraceSettings {
+    int samples_per_pixel = 4;     // Number of samples per pixel for anti-aliasing
+    int max_depth = 8;             // Hard cap on path segments per sample, 1 means primary rays only
+    bool diffuse_bounces = true;   // Continue paths off diffuse surfaces; false gives Whitted-style direct lighting only
+    int roulette_depth = 3;        // Paths this deep are terminated by Russian roulette
+    uint64_t seed = 0;             // Random streams of a pass, passes with different seeds are independent
+};
+
+// Number of rays traced, split into path segments per depth and shadow rays
+struct RayCounters {
+    uint64_t rays = 0;
+    uint64_t shadow_rays = 0;
+    uint64_t rays_per_depth[TRACE_MAX_DEPTH] = {};
+
+    void add(const RayCounters& other) {
+        rays += other.rays;
+        shadow_rays += other.shadow_rays;
+        for (int d = 0; d < TRACE_MAX_DEPTH; d++) rays_per_depth[d] += other.rays_per_depth[d];
+    }
+};
+
+inline int clamp_depth(int depth) {
+    return depth < 1 ? 1 : (depth > TRACE_MAX_DEPTH ? TRACE_MAX_DEPTH : depth);
+}
+
+// Orient the geometric normal against the incoming ray (planes and triangles are two-sided)
+inline vec3 face_forward(const vec3& N, const ray& r) {
+    return dot(N, r.direction()) > 0 ? -N : N;
+}
+
+// Diffuse lighting from every light that is visible from the hit, N is its normal facing the ray and cone the
+// footprint there
+inline vec3 direct_light(const Scene& scene, const HitRecord& rec, const vec3& N, RayCounters& counters,
+                         const RayCone& cone = RayCone()) {
+    vec3 hit_color(0, 0, 0);
+    for (const auto& light : scene.lights) {
+        vec3 to_light = light.position - rec.p;
+        float diffuse = dot(N, unit_vector(to_light));  // Diffuse lighting component
+        if (diffuse <= 0.0f) continue;
+        counters.shadow_rays++;
+        if (occluded(scene, spawn_ray_to(rec, light.position), 1.0f, cone)) continue;
+        hit_color += light.intensity * diffuse;  // Accumulate the light contribution
+    }
+    return hit_color;
+}
+
+// Russian roulette: probability that a path with this throughput continues at this depth.
+// Survivors divide their throughput by it so the estimate stays unbiased.
+inline float survival_probability(const vec3& throughput, int depth, const TraceSettings& settings) {
+    if (depth < settings.roulette_depth) return 1.0f;
+    float q = throughput.x() > throughput.y() ? throughput.x() : throughput.y();
+    q = q > throughput.z() ? q : throughput.z();
+    return q < 0.05f ? 0.05f : (q > 0.95f ? 0.95f : q);
+}
+
+// Function to compute the color of a path recursively. Diffuse surfaces take direct light, every material may
+// continue the path through scatter() until the depth cap or Russian roulette ends it.
+// throughput is the product of the weights along the path so far and only steers the roulette, fp the ray's
+// footprint for texture filtering (NoFootprint, RayCone or RayDifferential).
+template <class Footprint>
+inline vec3 trace_path(const Scene& scene, const ray& r, const Footprint& fp, int depth, const vec3& throughput,
+                       const TraceSettings& settings, Rng& rng, RayCounters& counters) {
+    counters.rays++;
+    PROFILE_COUNT(PROF_RAYS, 1);
+    counters.rays_per_depth[depth]++;
+    HitRecord rec;
+    RayCone cone = footprint_cone(fp, r);
+    if (!intersect_scene(scene, r, rec, FLT_MAX, cone)) return sky_color(r);
+
+    Material m = material_of(scene, rec.kind, rec.index);
+    m.albedo = surface_albedo(scene, rec, m, r, fp);
+    bool front_face = dot(rec.N, r.direction()) < 0;
+    vec3 N = front_face ? rec.N : -rec.N;
+
+    vec3 col = m.emission;
+    if (m.type == MAT_DIFFUSE) {
+        col += (1.0f - m.metallic) * m.albedo * direct_light(scene, rec, N, counters, cone_at_hit(cone, r, rec));
+        if (!settings.diffuse_bounces && m.metallic <= 0.0f) return col;
+    }
+    if (depth + 1 >= clamp_depth(settings.max_depth)) return col;
+
+    vec3 dir, weight;
+    bool specular;
+    if (!scatter(m, r.direction(), N, front_face, rng, dir, weight, &specular)) return col;
+    if (!specular && !settings.diffuse_bounces) return col;
+    float survive = survival_probability(throughput * weight, depth + 1, settings);
+    if (survive < 1.0f && rng.next() >= survive) return col;
+    weight /= survive;
+    Footprint next = footprint_scatter(fp, scene, r, rec, N, front_face, m, dir);
+    return col + weight * trace_path(scene, spawn_ray(rec, dir), next, depth + 1, throughput * weight, settings, rng, counters);
+}
+
+template <class Footprint>
+inline vec3 trace_path(const Scene& scene, const ray& r, const Footprint& fp, const TraceSettings& settings, Rng& rng,
+                       RayCounters& counters) {
+    return trace_path(scene, r, fp, 0, vec3(1, 1, 1), settings, rng, counters);
+}
+
+// Without a footprint textures are sampled at their finest level
+inline vec3 trace_path(const Scene& scene, const ray& r, const TraceSettings& settings, Rng& rng, RayCounters& counters) {
+    return trace_path(scene, r, NoFootprint(), settings, rng, counters);
+}
+
+// Function to render pixels [i0, i1) of row j (counted from the bottom) into out[0, i1 - i0): the span's camera rays
+// are generated in one batch into rays, which must hold (i1 - i0) * samples_per_pixel rays, then
+// radiance(r, fp, rng, counters) estimates one sample each with fp the ray's Footprint. Every pixel has its own
+// random stream, so a pixel comes out the same in whichever span, tile or process it is rendered; only the lens and
+// shutter samples of a batch share the stream of the span. cam gives the image size.
+template <class Footprint, class Radiance>
+inline void render_span(const Camera& cam, const TraceSettings& settings, int j, int i0, int i1, CameraRays& rays,
+                        vec3* out, Radiance&& radiance, RayCounters& counters) {
+    int spp = settings.samples_per_pixel;
+    int n = (i1 - i0) * spp;
+    uint64_t row_start = uint64_t(j) * uint64_t(cam.width);
+    {
+        PROFILE_SCOPE("camera rays");
+        for (int i = i0; i < i1; i++) {
+            Rng rng(row_start + i, 1 + settings.seed);
+            for (int s = 0; s < spp; s++) {
+                rays.s[(i - i0) * spp + s] = float(i + rng.next()) / float(cam.width);
+                rays.t[(i - i0) * spp + s] = float(j + rng.next()) / float(cam.height);
+            }
+        }
+        Rng span_rng((1ull << 62) + row_start + i0, 1 + settings.seed);  // Apart from every pixel's stream
+        cam.generate(rays, 0, n, span_rng);
+    }
+    PROFILE_SCOPE("trace row");
+    for (int i = 0; i < i1 - i0; i++) {
+        // The pixel's stream after its film samples
+        Rng rng(row_start + i0 + i, 1 + settings.seed);
+        for (int s = 0; s < 2 * spp; s++) rng.next_uint();
+        vec3 col(0, 0, 0);
+        for (int s = 0; s < spp; s++) {
+            Footprint fp;
+            camera_footprint(cam, rays, i * spp + s, fp);
+            col += radiance(rays.get(i * spp + s), fp, rng, counters);
+        }
+        out[i] = col / float(spp);
+    }
+}
+
+// Function to render row j of fb (see render_span), cam must have fb's size
+template <class Footprint, class Radiance>
+inline void render_row(const Camera& cam, const TraceSettings& settings, int j, CameraRays& rays, Framebuffer& fb,
+                       Radiance&& radiance, RayCounters& counters) {
+    render_span<Footprint>(cam, settings, j, 0, fb.width, rays, &fb.at(0, j), radiance, counters);
+}
+
+// Render the image one row at a time (see render_row), rows in parallel. The camera's pixel size is taken from fb.
+template <class Footprint, class Radiance>
+inline RayCounters render_pixels(const Camera& camera, const TraceSettings& settings, Framebuffer& fb, Radiance&& radiance) {
+    RayCounters total;
+    mutex total_mutex;
+    Camera cam = camera;
+    cam.width = fb.width;
+    cam.height = fb.height;
+    parallel_for(fb.height, 1, [&](int begin, int end) {
+        RayCounters counters;
+        CameraRays rays;
+        rays.resize(fb.width * settings.samples_per_pixel);
+        for (int j = begin; j < end; j++) render_row<Footprint>(cam, settings, j, rays, fb, radiance, counters);
+        lock_guard<mutex> lock(total_mutex);
+        total.add(counters);
+    });
+    return total;
+}
+
+template <class Footprint = RayCone>
+inline RayCounters render_recursive(const Scene& scene, const Camera& camera, const TraceSettings& settings, Framebuffer& fb) {
+    return render_pixels<Footprint>(camera, settings, fb, [&](const ray& r, const Footprint& fp, Rng& rng, RayCounters& counters) {
+        return trace_path(scene, r, fp, settings, rng, counters);
+    });
+}
+
+// Per-pixel features of the primary hit, the guides of the denoiser
+struct FeatureBuffers {
+    int width = 0;
+    int height = 0;
+    vector<vec3> albedo;  // Material albedo, the sky color for pixels that see the sky
+    vector<vec3> normal;  // Normal facing the camera, zero for sky pixels
+    vector<float> depth;  // Distance to the camera, FLT_MAX for sky pixels
+
+    void resize(int w, int h) {
+        width = w;
+        height = h;
+        albedo.assign(size_t(w) * h, vec3(0, 0, 0));
+        normal.assign(size_t(w) * h, vec3(0, 0, 0));
+        depth.assign(size_t(w) * h, FLT_MAX);
+    }
+};
+
+// Trace one ray through every pixel center and record what it hits, rows stored top to bottom like Framebuffer.
+// Thin lens cameras sample the lens once per pixel.
+inline void render_features(const Scene& scene, const Camera& camera, FeatureBuffers& features) {
+    Camera cam = camera;
+    cam.width = features.width;
+    cam.height = features.height;
+    parallel_for(features.height, 1, [&](int begin, int end) {
+        CameraRays rays;
+        rays.resize(features.width);
+        for (int j = begin; j < end; j++) {
+            Rng rng(uint64_t(j), 0);
+            for (int i = 0; i < features.width; i++) {
+                rays.s[i] = (i + 0.5f) / float(features.width);
+                rays.t[i] = (j + 0.5f) / float(features.height);
+            }
+            cam.generate(rays, 0, rays.size, rng);
+            size_t row = size_t(features.height - 1 - j) * features.width;
+            for (int i = 0; i < features.width; i++) {
+                ray r = rays.get(i);
+                HitRecord rec;
+                if (!intersect_scene(scene, r, rec, FLT_MAX, rays.cone(i))) {
+                    features.albedo[row + i] = sky_color(r);
+                    features.normal[row + i] = vec3(0, 0, 0);
+                    features.depth[row + i] = FLT_MAX;
+                    continue;
+                }
+                features.albedo[row + i] = surface_albedo(scene, rec, material_of(scene, rec.kind, rec.index), r, rays.cone(i));
+                features.normal[row + i] = face_forward(rec.N, r);
+                features.depth[row + i] = rec.t * r.direction().length();
+            }
+        }
+    });
+}
+
+// Print how many path segments were traced at each depth
+inline void print_depth_counts(ostream& os, const RayCounters& counters) {
+    for (int d = 0; d < TRACE_MAX_DEPTH; d++) {
+        if (counters.rays_per_depth[d] == 0) continue;
+        os << "  depth " << d << ": " << counters.rays_per_depth[d] << " rays ("
+           << 100.0 * counters.rays_per_depth[d] / (counters.rays ? counters.rays : 1) << "%)\n";
+    }
+    os << "  shadow rays: " << counters.shadow_rays << "\n";
+}
+
+#endif // TRACE_H
@@ -1,6 +1,8 @@
 #ifndef TRIANGLE_H
 #define TRIANGLE_H
 
+#include <cmath>
+#include <cfloat>
 #include "vec3.h"
 #include "ray.h"
 
@@ -10,7 +12,7 @@ struct Triangle {
 };
 
 // Function to check if a ray intersects with a triangle
-bool hit_triangle(const Triangle& tri, const ray& r, float& t, vec3& N) {
+inline bool hit_triangle(const Triangle& tri, const ray& r, float& t, vec3& N) {
     const float EPSILON = 0.0000001;  // Small value for floating-point comparisons
     vec3 edge1 = tri.v1 - tri.v0;  // Compute the first edge of the triangle
     vec3 edge2 = tri.v2 - tri.v0;  // Compute the second edge of the triangle
@@ -36,4 +38,98 @@ bool hit_triangle(const Triangle& tri, const ray& r, float& t, vec3& N) {
     }
 }
 
+// Bound on the relative error of n floating-point roundings, gamma_n in Higham's notation
+inline float rounding_gamma(int n) {
+    const float e = 0.5f * FLT_EPSILON;
+    return n * e / (1.0f - n * e);
+}
+
+// Per-ray setup of the watertight triangle test: the axes permuted so z is the direction's largest component, and
+// the shear that maps the direction onto +z
+struct RayShear {
+    int kx, ky, kz;
+    float sx, sy, sz;
+};
+
+inline RayShear make_ray_shear(const vec3& D) {
+    RayShear s;
+    float ax = fabsf(D.x()), ay = fabsf(D.y()), az = fabsf(D.z());
+    s.kz = ax > ay ? (ax > az ? 0 : 2) : (ay > az ? 1 : 2);
+    s.kx = (s.kz + 1) % 3;
+    s.ky = (s.kx + 1) % 3;
+    if (D[s.kz] < 0.0f) { int tmp = s.kx; s.kx = s.ky; s.ky = tmp; }  // Keep the winding
+    s.sx = D[s.kx] / D[s.kz];
+    s.sy = D[s.ky] / D[s.kz];
+    s.sz = 1.0f / D[s.kz];
+    return s;
+}
+
+// Largest magnitude of three values
+inline float max_abs3(float a, float b, float c) {
+    a = fabsf(a);
+    b = fabsf(b);
+    c = fabsf(c);
+    float m = a > b ? a : b;
+    return m > c ? m : c;
+}
+
+// Function to check if a ray hits a triangle before t_max without cracks (Woop, Benthin and Wald 2013): the vertices
+// are moved into the ray's sheared space, where the ray is the +z axis through the origin, and the hit is decided by
+// the signs of three 2D edge functions. Neighbouring triangles evaluate the same function on a shared edge, so a ray
+// through the edge hits at least one of them; edge functions that round to 0 are redone in double. The hit is kept
+// only beyond the bound on the rounding error of t (Pharr, Jakob and Humphreys), so no epsilon is needed. Hits behind
+// the origin or beyond t_max are rejected before the division and the error bound, and the normal is left to
+// triangle_normal so traversal computes it once, for the closest hit.
+inline bool hit_triangle_watertight(const Triangle& tri, const ray& r, const RayShear& s, float t_max, float& t) {
+    vec3 A = tri.v0 - r.O, B = tri.v1 - r.O, C = tri.v2 - r.O;
+    float ax = A[s.kx] - s.sx * A[s.kz], ay = A[s.ky] - s.sy * A[s.kz];
+    float bx = B[s.kx] - s.sx * B[s.kz], by = B[s.ky] - s.sy * B[s.kz];
+    float cx = C[s.kx] - s.sx * C[s.kz], cy = C[s.ky] - s.sy * C[s.kz];
+    float u = cx * by - cy * bx;
+    float v = ax * cy - ay * cx;
+    float w = bx * ay - by * ax;
+    if (u == 0.0f || v == 0.0f || w == 0.0f) {
+        u = float(double(cx) * by - double(cy) * bx);
+        v = float(double(ax) * cy - double(ay) * cx);
+        w = float(double(bx) * ay - double(by) * ax);
+    }
+    if ((u < 0.0f || v < 0.0f || w < 0.0f) && (u > 0.0f || v > 0.0f || w > 0.0f)) return false;
+    float det = u + v + w;
+    if (det == 0.0f) return false;
+
+    // Scaled distance, compared against 0 and t_max * det before dividing
+    float az = s.sz * A[s.kz], bz = s.sz * B[s.kz], cz = s.sz * C[s.kz];
+    float t_scaled = u * az + v * bz + w * cz;
+    if (det < 0.0f ? (t_scaled >= 0.0f || t_scaled < t_max * det) : (t_scaled <= 0.0f || t_scaled > t_max * det))
+        return false;
+
+    // Error bound of the hit from the roundings above, scaled by det like t_scaled. The sheared x and y are in world
+    // units like the unscaled z they were sheared by, the scaled z is in units of t.
+    float max_z = max_abs3(az, bz, cz);
+    float max_world_z = max_abs3(A[s.kz], B[s.kz], C[s.kz]);
+    float max_x = max_abs3(ax, bx, cx);
+    float max_y = max_abs3(ay, by, cy);
+    float max_e = max_abs3(u, v, w);
+    float delta_z = rounding_gamma(3) * max_z;
+    float delta_x = rounding_gamma(5) * (max_x + max_world_z);
+    float delta_y = rounding_gamma(5) * (max_y + max_world_z);
+    float delta_e = 2.0f * (rounding_gamma(2) * max_x * max_y + delta_y * max_x + delta_x * max_y);
+    float delta_scaled = 3.0f * (rounding_gamma(3) * max_e * max_z + delta_e * max_z + delta_z * max_e);
+    if (fabsf(t_scaled) <= delta_scaled) return false;
+
+    t = t_scaled * (1.0f / det);
+    return true;
+}
+
+// Unit normal of a triangle, wound like its vertices
+inline vec3 triangle_normal(const Triangle& tri) {
+    return unit_vector(cross(tri.v1 - tri.v0, tri.v2 - tri.v0));
+}
+
+inline bool hit_triangle_watertight(const Triangle& tri, const ray& r, float& t, vec3& N) {
+    if (!hit_triangle_watertight(tri, r, make_ray_shear(r.D), FLT_MAX, t)) return false;
+    N = triangle_normal(tri);
+    return true;
+}
+
 #endif // TRIANGLE_H
\ No newline at end of file
@@ -0,0 +1,423 @@
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include <vector>
+#include <cstdint>
+#include <cfloat>
+#include "vec3.h"
+#include "ray.h"
+#include "Scene.h"
+#include "Random.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Material.h"
+#include "Trace.h"
+#include "Camera.h"
+
+using namespace std;
+
+// Wavefront (stream) renderer. Instead of following one path at a time through color(), every path of a wave
+// advances one bounce per iteration through separate batched stages:
+//   generate -> intersect -> sort/compact -> shade -> shadow -> accumulate -> compact bounce rays -> intersect ...
+// All queues are structures of arrays so every stage streams through memory linearly.
+// It computes the same estimate as trace_path in Trace.h, with rays sorted by material between stages.
+
+const int WAVEFRONT_GRAIN = 4096;                   // Items per parallel chunk
+const int WAVEFRONT_SORT_KEYS = MATERIAL_TYPE_COUNT * 8; // Material type x direction octant
+
+// Define the SoA ray queue
+struct RayQueue {
+    vector<float> ox, oy, oz;  // Origins
+    vector<float> dx, dy, dz;  // Directions
+    vector<float> tr, tg, tb;  // Path throughput
+    vector<float> cw, cs;      // Ray cone width and spread for texture filtering
+    vector<float> lod_u;       // Ray cone's mesh level choice
+    vector<int> lod_mesh, lod_level;
+    vector<float> time;        // Shutter time
+    vector<int> path;          // Path (pixel sample) each ray belongs to, relative to the wave
+    int size = 0;
+
+    void reserve(int n) {
+        for (auto* v : {&ox, &oy, &oz, &dx, &dy, &dz, &tr, &tg, &tb, &cw, &cs, &lod_u, &time}) v->resize(n);
+        for (auto* v : {&lod_mesh, &lod_level, &path}) v->resize(n);
+    }
+    inline ray get(int i) const { return ray(vec3(ox[i], oy[i], oz[i]), vec3(dx[i], dy[i], dz[i]), time[i]); }
+    inline vec3 throughput(int i) const { return vec3(tr[i], tg[i], tb[i]); }
+    inline RayCone cone(int i) const {
+        RayCone c;
+        c.width = cw[i];
+        c.spread = cs[i];
+        c.lod_u = lod_u[i];
+        c.lod_mesh = lod_mesh[i];
+        c.lod_level = lod_level[i];
+        return c;
+    }
+    inline void set(int i, const ray& r, const vec3& throughput, const RayCone& cone, int p) {
+        ox[i] = r.O.x(); oy[i] = r.O.y(); oz[i] = r.O.z();
+        dx[i] = r.D.x(); dy[i] = r.D.y(); dz[i] = r.D.z();
+        tr[i] = throughput.x(); tg[i] = throughput.y(); tb[i] = throughput.z();
+        cw[i] = cone.width; cs[i] = cone.spread;
+        lod_u[i] = cone.lod_u; lod_mesh[i] = cone.lod_mesh; lod_level[i] = cone.lod_level;
+        time[i] = r.time;
+        path[i] = p;
+    }
+    inline void copy_from(const RayQueue& src, int from, int to) {
+        ox[to] = src.ox[from]; oy[to] = src.oy[from]; oz[to] = src.oz[from];
+        dx[to] = src.dx[from]; dy[to] = src.dy[from]; dz[to] = src.dz[from];
+        tr[to] = src.tr[from]; tg[to] = src.tg[from]; tb[to] = src.tb[from];
+        cw[to] = src.cw[from]; cs[to] = src.cs[from];
+        lod_u[to] = src.lod_u[from]; lod_mesh[to] = src.lod_mesh[from]; lod_level[to] = src.lod_level[from];
+        time[to] = src.time[from];
+        path[to] = src.path[from];
+    }
+};
+
+// Define the SoA hit queue, parallel to a RayQueue
+struct HitQueue {
+    vector<float> t;           // Hit distance
+    vector<float> nx, ny, nz;  // Geometric normal
+    vector<int> kind;          // PrimitiveKind, -1 for a miss
+    vector<int> index;         // Primitive index within its kind
+    vector<int> level;         // Level of detail of mesh hits
+    vector<MaterialId> material;
+
+    void reserve(int n) {
+        for (auto* v : {&t, &nx, &ny, &nz}) v->resize(n);
+        kind.resize(n);
+        index.resize(n);
+        level.resize(n);
+        material.resize(n);
+    }
+};
+
+// Define the SoA shadow ray queue, one slot per hit and light
+struct ShadowQueue {
+    vector<float> ox, oy, oz;  // Hit point
+    vector<float> dx, dy, dz;  // Unnormalized direction, the light sits at t = 1
+    vector<float> cr, cg, cb;  // Contribution if the light is visible, 0 if the slot is unused
+    vector<float> cw, cs;      // Ray cone at the hit point, picks the meshes' levels of detail like the shading ray
+    vector<float> lod_u;
+    vector<int> lod_mesh, lod_level;
+    vector<float> time;        // Shutter time of the shading ray
+    vector<unsigned char> visible;
+
+    void reserve(int n) {
+        for (auto* v : {&ox, &oy, &oz, &dx, &dy, &dz, &cr, &cg, &cb, &cw, &cs, &lod_u, &time}) v->resize(n);
+        lod_mesh.resize(n);
+        lod_level.resize(n);
+        visible.resize(n);
+    }
+};
+
+// Everything the stages work on, kept between waves so buffers are only allocated once
+struct WavefrontState {
+    CameraRays camera_rays;  // Camera rays of the wave, copied into rays
+    RayQueue rays;           // Rays of the current bounce
+    HitQueue hits;           // Their hits
+    RayQueue sorted;         // Rays that hit something, sorted by sort key
+    HitQueue sorted_hits;    // Their hits
+    MaterialTable materials; // Materials of the sorted hits, gathered from the scene's table
+    RayQueue next;           // Bounce rays, one slot per sorted hit
+    vector<unsigned char> alive;
+    ShadowQueue shadows;
+    vector<float> radiance;  // Accumulated radiance, 3 floats per path of the wave
+    vector<int> histogram;   // Per-chunk counts for sorting and compaction
+    int first_path = 0;      // Image path index of the wave's first path, seeds the random numbers
+    RayCounters counters;
+
+    void reserve(int paths, int lights) {
+        if (int(radiance.size()) >= 3 * paths && int(shadows.visible.size()) >= paths * lights) return;
+        camera_rays.resize(paths);
+        rays.reserve(paths);
+        hits.reserve(paths);
+        sorted.reserve(paths);
+        sorted_hits.reserve(paths);
+        materials.resize(paths);
+        next.reserve(paths);
+        alive.resize(paths);
+        shadows.reserve(paths * (lights > 0 ? lights : 1));
+        radiance.resize(3 * paths);
+    }
+};
+
+// Random streams of a pass: camera samples (1), lens samples (2) and bounces (depth + 2). The pass with seed s takes
+// the streams from s * WAVEFRONT_STREAMS on, so passes with different seeds share none.
+const uint64_t WAVEFRONT_STREAMS = TRACE_MAX_DEPTH + 2;
+
+inline uint64_t wavefront_stream(uint64_t seed, uint64_t stream) {
+    return seed * WAVEFRONT_STREAMS + stream;
+}
+
+inline int chunk_count(int n) {
+    return (n + WAVEFRONT_GRAIN - 1) / WAVEFRONT_GRAIN;
+}
+
+// Stage 1: camera rays for the paths [first_path, first_path + count) of the image. camera has the image's pixel size,
+// seed is the pass's TraceSettings::seed.
+inline void wavefront_generate(WavefrontState& st, int first_path, int count, const Camera& camera, int spp,
+                               uint64_t seed) {
+    st.rays.size = count;
+    st.first_path = first_path;
+    CameraRays& cr = st.camera_rays;
+    parallel_for(count, WAVEFRONT_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int path = first_path + i;
+            int pixel = path / spp;
+            int x = pixel % camera.width;
+            int j = camera.height - 1 - pixel / camera.width;
+            Rng rng(uint64_t(path), wavefront_stream(seed, 1));
+            cr.s[i] = float(x + rng.next()) / float(camera.width);
+            cr.t[i] = float(j + rng.next()) / float(camera.height);
+        }
+        Rng lens_rng(uint64_t(first_path + begin), wavefront_stream(seed, 2));
+        camera.generate(cr, begin, end, lens_rng);
+        for (int i = begin; i < end; i++) {
+            st.rays.set(i, cr.get(i), vec3(1, 1, 1), cr.cone(i), i);
+            st.radiance[3 * i] = st.radiance[3 * i + 1] = st.radiance[3 * i + 2] = 0.0f;
+        }
+    });
+}
+
+// Stage 2: nearest hit for every queued ray
+inline void wavefront_intersect(const Scene& scene, WavefrontState& st, int depth) {
+    parallel_for(st.rays.size, WAVEFRONT_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            HitRecord rec;
+            if (intersect_scene(scene, st.rays.get(i), rec, FLT_MAX, st.rays.cone(i))) {
+                st.hits.t[i] = rec.t;
+                st.hits.nx[i] = rec.N.x(); st.hits.ny[i] = rec.N.y(); st.hits.nz[i] = rec.N.z();
+                st.hits.kind[i] = rec.kind;
+                st.hits.index[i] = rec.index;
+                st.hits.level[i] = rec.kind == PRIM_MESH ? rec.level : 0;
+                st.hits.material[i] = material_id(scene, rec.kind, rec.index);
+            } else {
+                st.hits.kind[i] = -1;
+            }
+        }
+    });
+    st.counters.rays += st.rays.size;
+    PROFILE_COUNT(PROF_RAYS, st.rays.size);
+    st.counters.rays_per_depth[depth] += st.rays.size;
+}
+
+inline int wavefront_sort_key(const Scene& scene, const WavefrontState& st, int i) {
+    int octant = (st.rays.dx[i] < 0) | ((st.rays.dy[i] < 0) << 1) | ((st.rays.dz[i] < 0) << 2);
+    return scene.materials.type[st.hits.material[i]] * 8 + octant;
+}
+
+// Stage 3: misses add the sky and leave the wave, hits are counting-sorted by material type and direction octant
+inline int wavefront_sort(const Scene& scene, WavefrontState& st) {
+    int n = st.rays.size;
+    int chunks = chunk_count(n);
+    st.histogram.assign(size_t(chunks) * WAVEFRONT_SORT_KEYS, 0);
+
+    parallel_for_chunks(chunks, [&](int c) {
+        int* hist = &st.histogram[size_t(c) * WAVEFRONT_SORT_KEYS];
+        int end = (c + 1) * WAVEFRONT_GRAIN < n ? (c + 1) * WAVEFRONT_GRAIN : n;
+        for (int i = c * WAVEFRONT_GRAIN; i < end; i++) {
+            if (st.hits.kind[i] < 0) {
+                vec3 sky = st.rays.throughput(i) * sky_color(st.rays.get(i));
+                int p = st.rays.path[i];
+                st.radiance[3 * p] += sky.x(); st.radiance[3 * p + 1] += sky.y(); st.radiance[3 * p + 2] += sky.z();
+            } else {
+                hist[wavefront_sort_key(scene, st, i)]++;
+            }
+        }
+    });
+
+    // Exclusive scan, key-major so equal keys from all chunks end up next to each other
+    int total = 0;
+    for (int key = 0; key < WAVEFRONT_SORT_KEYS; key++) {
+        for (int c = 0; c < chunks; c++) {
+            int& h = st.histogram[size_t(c) * WAVEFRONT_SORT_KEYS + key];
+            int count = h;
+            h = total;
+            total += count;
+        }
+    }
+
+    parallel_for_chunks(chunks, [&](int c) {
+        int* offset = &st.histogram[size_t(c) * WAVEFRONT_SORT_KEYS];
+        int end = (c + 1) * WAVEFRONT_GRAIN < n ? (c + 1) * WAVEFRONT_GRAIN : n;
+        for (int i = c * WAVEFRONT_GRAIN; i < end; i++) {
+            if (st.hits.kind[i] < 0) continue;
+            int to = offset[wavefront_sort_key(scene, st, i)]++;
+            st.sorted.copy_from(st.rays, i, to);
+            st.sorted_hits.t[to] = st.hits.t[i];
+            st.sorted_hits.nx[to] = st.hits.nx[i]; st.sorted_hits.ny[to] = st.hits.ny[i]; st.sorted_hits.nz[to] = st.hits.nz[i];
+            st.sorted_hits.kind[to] = st.hits.kind[i];
+            st.sorted_hits.index[to] = st.hits.index[i];
+            st.sorted_hits.level[to] = st.hits.level[i];
+            st.sorted_hits.material[to] = st.hits.material[i];
+        }
+    });
+    st.sorted.size = total;
+    return total;
+}
+
+// Stage 4: shadow ray per light for diffuse hits, and the continuation ray from scatter()
+inline void wavefront_shade(const Scene& scene, WavefrontState& st, const TraceSettings& settings, int depth) {
+    int lights = int(scene.lights.size());
+    bool bounce = depth + 1 < clamp_depth(settings.max_depth);
+    parallel_for(st.sorted.size, WAVEFRONT_GRAIN, [&](int begin, int end) {
+        gather_materials(scene.materials, &st.sorted_hits.material[begin], end - begin, st.materials, begin);
+        for (int i = begin; i < end; i++) {
+            ray r = st.sorted.get(i);
+            vec3 throughput = st.sorted.throughput(i);
+            HitRecord rec;
+            rec.t = st.sorted_hits.t[i];
+            rec.N = vec3(st.sorted_hits.nx[i], st.sorted_hits.ny[i], st.sorted_hits.nz[i]);
+            rec.kind = st.sorted_hits.kind[i];
+            rec.index = st.sorted_hits.index[i];
+            rec.level = st.sorted_hits.level[i];
+            finish_hit(scene, r, rec);
+            bool front_face = dot(rec.N, r.direction()) < 0;
+            vec3 N = front_face ? rec.N : -rec.N;
+            Material m = st.materials.get(i);
+            RayCone cone = st.sorted.cone(i);
+            RayCone hit_cone = cone_at_hit(cone, r, rec);
+            m.albedo = surface_albedo(scene, rec, m, r, cone);
+            int path = st.sorted.path[i];
+            st.radiance[3 * path] += throughput.x() * m.emission.x();
+            st.radiance[3 * path + 1] += throughput.y() * m.emission.y();
+            st.radiance[3 * path + 2] += throughput.z() * m.emission.z();
+
+            for (int l = 0; l < lights; l++) {
+                int slot = i * lights + l;
+                vec3 to_light = scene.lights[l].position - rec.p;
+                float diffuse = m.type == MAT_DIFFUSE ? dot(N, unit_vector(to_light)) : 0.0f;
+                vec3 c = diffuse > 0.0f ? (1.0f - m.metallic) * diffuse * throughput * m.albedo * scene.lights[l].intensity
+                                        : vec3(0, 0, 0);
+                ray shadow = spawn_ray_to(rec, scene.lights[l].position);
+                st.shadows.ox[slot] = shadow.O.x(); st.shadows.oy[slot] = shadow.O.y(); st.shadows.oz[slot] = shadow.O.z();
+                st.shadows.dx[slot] = shadow.D.x(); st.shadows.dy[slot] = shadow.D.y(); st.shadows.dz[slot] = shadow.D.z();
+                st.shadows.cr[slot] = c.x(); st.shadows.cg[slot] = c.y(); st.shadows.cb[slot] = c.z();
+                st.shadows.cw[slot] = hit_cone.width; st.shadows.cs[slot] = hit_cone.spread;
+                st.shadows.lod_u[slot] = hit_cone.lod_u;
+                st.shadows.lod_mesh[slot] = hit_cone.lod_mesh;
+                st.shadows.lod_level[slot] = hit_cone.lod_level;
+                st.shadows.time[slot] = shadow.time;
+            }
+
+            st.alive[i] = 0;
+            if (!bounce || (m.type == MAT_DIFFUSE && m.metallic <= 0.0f && !settings.diffuse_bounces)) continue;
+            Rng rng(uint64_t(st.first_path + path), wavefront_stream(settings.seed, uint64_t(depth) + 2));
+            vec3 dir, weight;
+            bool specular;
+            if (!scatter(m, r.direction(), N, front_face, rng, dir, weight, &specular)) continue;
+            if (!specular && !settings.diffuse_bounces) continue;
+            float survive = survival_probability(throughput * weight, depth + 1, settings);
+            if (survive < 1.0f && rng.next() >= survive) continue;
+            st.alive[i] = 1;
+            st.next.set(i, spawn_ray(rec, dir), throughput * weight / survive, hit_cone, path);
+        }
+    });
+}
+
+// Stage 5: trace the shadow rays, then add the visible contributions to their paths
+inline void wavefront_shadow(const Scene& scene, WavefrontState& st) {
+    int lights = int(scene.lights.size());
+    int slots = st.sorted.size * lights;
+    atomic<uint64_t> traced(0);
+    parallel_for(slots, WAVEFRONT_GRAIN, [&](int begin, int end) {
+        uint64_t count = 0;
+        for (int s = begin; s < end; s++) {
+            bool used = st.shadows.cr[s] > 0.0f || st.shadows.cg[s] > 0.0f || st.shadows.cb[s] > 0.0f;
+            st.shadows.visible[s] = 0;
+            if (!used) continue;
+            count++;
+            ray shadow_ray(vec3(st.shadows.ox[s], st.shadows.oy[s], st.shadows.oz[s]),
+                           vec3(st.shadows.dx[s], st.shadows.dy[s], st.shadows.dz[s]), st.shadows.time[s]);
+            RayCone cone;
+            cone.width = st.shadows.cw[s];
+            cone.spread = st.shadows.cs[s];
+            cone.lod_u = st.shadows.lod_u[s];
+            cone.lod_mesh = st.shadows.lod_mesh[s];
+            cone.lod_level = st.shadows.lod_level[s];
+            st.shadows.visible[s] = !occluded(scene, shadow_ray, 1.0f, cone);
+        }
+        traced += count;
+    });
+    st.counters.shadow_rays += traced;
+
+    // Every path owns exactly one sorted hit, so each path is written by one thread only
+    parallel_for(st.sorted.size, WAVEFRONT_GRAIN, [&](int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            int p = st.sorted.path[i];
+            for (int l = 0; l < lights; l++) {
+                int s = i * lights + l;
+                if (!st.shadows.visible[s]) continue;
+                st.radiance[3 * p] += st.shadows.cr[s];
+                st.radiance[3 * p + 1] += st.shadows.cg[s];
+                st.radiance[3 * p + 2] += st.shadows.cb[s];
+            }
+        }
+    });
+}
+
+// Stage 6: compact the surviving bounce rays into the queue for the next iteration
+inline void wavefront_compact(WavefrontState& st) {
+    int n = st.sorted.size;
+    int chunks = chunk_count(n);
+    st.histogram.assign(chunks, 0);
+    parallel_for_chunks(chunks, [&](int c) {
+        int end = (c + 1) * WAVEFRONT_GRAIN < n ? (c + 1) * WAVEFRONT_GRAIN : n;
+        for (int i = c * WAVEFRONT_GRAIN; i < end; i++) st.histogram[c] += st.alive[i];
+    });
+    int total = 0;
+    for (int c = 0; c < chunks; c++) {
+        int count = st.histogram[c];
+        st.histogram[c] = total;
+        total += count;
+    }
+    parallel_for_chunks(chunks, [&](int c) {
+        int to = st.histogram[c];
+        int end = (c + 1) * WAVEFRONT_GRAIN < n ? (c + 1) * WAVEFRONT_GRAIN : n;
+        for (int i = c * WAVEFRONT_GRAIN; i < end; i++) {
+            if (st.alive[i]) st.rays.copy_from(st.next, i, to++);
+        }
+    });
+    st.rays.size = total;
+}
+
+// Render the image wave by wave. wave_size bounds the number of paths in flight and so the queue memory.
+inline RayCounters render_wavefront(const Scene& scene, const Camera& camera, const TraceSettings& settings, Framebuffer& fb,
+                                    WavefrontState& st, int wave_size = 1 << 20) {
+    Camera cam = camera;
+    cam.width = fb.width;
+    cam.height = fb.height;
+    int spp = settings.samples_per_pixel;
+    int total_paths = fb.width * fb.height * spp;
+    wave_size = wave_size / spp * spp;  // Waves hold whole pixels
+    if (wave_size < spp) wave_size = spp;
+    st.reserve(wave_size < total_paths ? wave_size : total_paths, int(scene.lights.size()));
+    st.counters = RayCounters();
+
+    for (int first = 0; first < total_paths; first += wave_size) {
+        int count = total_paths - first < wave_size ? total_paths - first : wave_size;
+        wavefront_generate(st, first, count, cam, spp, settings.seed);
+        for (int depth = 0; depth < clamp_depth(settings.max_depth) && st.rays.size > 0; depth++) {
+            wavefront_intersect(scene, st, depth);
+            if (wavefront_sort(scene, st) == 0) break;
+            wavefront_shade(scene, st, settings, depth);
+            wavefront_shadow(scene, st);
+            wavefront_compact(st);
+        }
+
+        // Resolve the samples of the wave's pixels
+        int first_pixel = first / spp;
+        parallel_for(count / spp, WAVEFRONT_GRAIN, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                vec3 col(0, 0, 0);
+                for (int s = 0; s < spp; s++) {
+                    int p = k * spp + s;
+                    col += vec3(st.radiance[3 * p], st.radiance[3 * p + 1], st.radiance[3 * p + 2]);
+                }
+                fb.pixels[first_pixel + k] = col / float(spp);
+            }
+        });
+    }
+    return st.counters;
+}
+
+#endif // WAVEFRONT_H
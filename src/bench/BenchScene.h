@@ -0,0 +1,49 @@
+#ifndef BENCH_SCENE_H
+#define BENCH_SCENE_H
+
+#include <cmath>
+#include "vec3.h"
+#include "Scene.h"
+#include "Material.h"
+#include "Image.h"
+
+using namespace std;
+
+// Scenes and image metrics shared by the benchmarks
+
+// The bonus.cpp primitives under one small bright light and one large dim light, the cases BSDF sampling and
+// light sampling each handle badly
+inline Scene make_area_light_scene() {
+    Scene scene;
+    scene.lights = {
+        {vec3(-1, 1, -0.5), vec3(1, 0, 1), 0.05f},  // Small purple light
+        {vec3(2, 1.5, -1), vec3(3, 3, 0), 1.0f}     // Large yellow light
+    };
+    scene.spheres = {{vec3(0, 0, -1), 0.3}};
+    scene.triangles = {{vec3(0.5, -0.25, -1), vec3(1.5, -0.25, -1), vec3(1, 0.25, -1)}};
+    scene.cubes = {{vec3(-1, 0, -1.25), 0.5}};
+    scene.planes = {{vec3(0, -0.5, -1), vec3(0, 1, 0)}};
+
+    Material glossy;
+    glossy.type = MAT_GLOSSY;
+    glossy.albedo = vec3(0.8, 0.6, 0.4);
+    glossy.roughness = 0.2f;
+    Material grey;
+    grey.albedo = vec3(0.5, 0.5, 0.5);
+    scene.material_ids[PRIM_SPHERE] = {scene.materials.add(glossy)};
+    scene.material_ids[PRIM_PLANE] = {scene.materials.add(grey)};
+    build_scene_bvh(scene);
+    return scene;
+}
+
+// Root mean square error over all color channels
+inline double rmse(const Framebuffer& a, const Framebuffer& b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        vec3 d = a.pixels[i] - b.pixels[i];
+        sum += d.squared_length();
+    }
+    return sqrt(sum / (3.0 * a.pixels.size()));
+}
+
+#endif // BENCH_SCENE_H
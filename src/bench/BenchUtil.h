@@ -0,0 +1,51 @@
+#ifndef BENCH_UTIL_H
+#define BENCH_UTIL_H
+
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include "vec3.h"
+#include "Triangle.h"
+
+using namespace std;
+
+// Timing and test meshes shared by the benchmarks, hw1 and the render services
+
+inline double seconds_since(chrono::steady_clock::time_point start) {
+    return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Latitude/longitude sphere with 2 * segments^2 triangles, neighbours share their vertices exactly. bumpy gives it
+// a wavy radius, otherwise the mesh is convex.
+inline void make_sphere_mesh(const vec3& center, float radius, int segments, vector<Triangle>& triangles,
+                             bool bumpy = false) {
+    int rows = segments / 2, cols = segments;
+    vector<vec3> grid(size_t(rows + 1) * (cols + 1));
+    for (int i = 0; i <= rows; i++) {
+        float theta = float(M_PI) * i / rows;
+        for (int j = 0; j <= cols; j++) {
+            float phi = 2.0f * float(M_PI) * (j % cols) / cols;
+            float bump = bumpy ? 1.0f + 0.08f * sinf(9.0f * theta) * sinf(7.0f * phi) +
+                                     0.03f * sinf(31.0f * theta + 23.0f * phi)
+                               : 1.0f;
+            vec3 n(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi));
+            grid[size_t(i) * (cols + 1) + j] = center + radius * bump * n;
+        }
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            const vec3& a = grid[size_t(i) * (cols + 1) + j];
+            const vec3& b = grid[size_t(i) * (cols + 1) + j + 1];
+            const vec3& c = grid[size_t(i + 1) * (cols + 1) + j];
+            const vec3& d = grid[size_t(i + 1) * (cols + 1) + j + 1];
+            if (i > 0) triangles.push_back({a, b, c});
+            if (i + 1 < rows) triangles.push_back({b, d, c});
+        }
+    }
+}
+
+inline void make_bumpy_sphere(const vec3& center, float radius, int segments, vector<Triangle>& triangles) {
+    make_sphere_mesh(center, radius, segments, triangles, true);
+}
+
+#endif // BENCH_UTIL_H
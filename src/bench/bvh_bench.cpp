@@ -0,0 +1,134 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include "vec3.h"
+#include "ray.h"
+#include "Triangle.h"
+#include "BVH.h"
+#include "CompressedBVH.h"
+#include "SBVH.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Compares the full-precision binary BVH against the compressed 8-wide BVH and the split BVH.
+// Usage: bvh_bench [triangle count] [ray count] [soup|thin]
+
+// Generate small randomly oriented triangles filling the cube [-1, 1]^3
+vector<Triangle> make_triangle_soup(int count) {
+    vector<Triangle> triangles(count);
+    float size = 3.0f / cbrt(float(count));  // Keeps the soup roughly equally dense at any count
+    for (int i = 0; i < count; i++) {
+        vec3 c(2 * drand48() - 1, 2 * drand48() - 1, 2 * drand48() - 1);
+        for (int k = 0; k < 3; k++) {
+            vec3 offset(drand48() - 0.5, drand48() - 0.5, drand48() - 0.5);
+            vec3& v = k == 0 ? triangles[i].v0 : (k == 1 ? triangles[i].v1 : triangles[i].v2);
+            v = c + size * offset;
+        }
+    }
+    return triangles;
+}
+
+// Generate long thin triangles (beams, mullions, planks) in the cube [-1, 1]^3, roughly aligned with the axes
+// the way architectural models are
+vector<Triangle> make_thin_triangles(int count) {
+    vector<Triangle> triangles(count);
+    float size = 3.0f / cbrt(float(count));
+    for (int i = 0; i < count; i++) {
+        vec3 a(2 * drand48() - 1, 2 * drand48() - 1, 2 * drand48() - 1);
+        vec3 dir(0, 0, 0);
+        dir[int(3 * drand48()) % 3] = 1;
+        dir = unit_vector(dir + 0.05f * vec3(drand48() - 0.5, drand48() - 0.5, drand48() - 0.5));
+        vec3 side = unit_vector(cross(dir, vec3(drand48() - 0.5, drand48() - 0.5, drand48() - 0.5)));
+        float length = size * (5 + 10 * drand48());
+        triangles[i].v0 = a;
+        triangles[i].v1 = a + length * dir;
+        triangles[i].v2 = a + 0.5f * length * dir + 0.05f * size * side;
+    }
+    return triangles;
+}
+
+// Primary rays from a camera in front of the soup, in scanline order
+vector<ray> make_camera_rays(int count) {
+    vector<ray> rays(count);
+    int side = int(sqrt(double(count)));
+    if (side < 1) side = 1;
+    vec3 origin(0, 0, 3);
+    for (int i = 0; i < count; i++) {
+        float u = float(i % side + drand48()) / side;
+        float v = float((i / side) % side + drand48()) / side;
+        rays[i] = ray(origin, vec3(-1.2 + 2.4 * u, -1.2 + 2.4 * v, -2));
+    }
+    return rays;
+}
+
+int main(int argc, char** argv) {
+    int triangle_count = argc > 1 ? atoi(argv[1]) : 1000000;
+    int ray_count = argc > 2 ? atoi(argv[2]) : 1000000;
+    string scene = argc > 3 ? argv[3] : "soup";
+    srand48(1);
+
+    vector<Triangle> triangles = scene == "thin" ? make_thin_triangles(triangle_count) : make_triangle_soup(triangle_count);
+    vector<ray> rays = make_camera_rays(ray_count);
+    cout << "scene: " << scene << ", triangles: " << triangle_count << ", rays: " << ray_count << "\n";
+
+    auto start = chrono::steady_clock::now();
+    BVH bvh;
+    build_triangle_bvh(bvh, triangles);
+    double binary_build = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    CompressedBVH cbvh;
+    compress_bvh(bvh, cbvh);
+    double compress_build = seconds_since(start);
+
+    // Trace with the full-precision nodes
+    vector<float> binary_t(ray_count);
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < ray_count; i++) {
+        float t;
+        vec3 N;
+        binary_t[i] = hit_bvh(bvh, triangles, rays[i], t, N) ? t : -1.0f;
+    }
+    double binary_trace = seconds_since(start);
+
+    // Trace with the compressed nodes and check both agree
+    int mismatches = 0;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < ray_count; i++) {
+        float t;
+        vec3 N;
+        float ct = hit_compressed_bvh(cbvh, triangles, rays[i], t, N) ? t : -1.0f;
+        if (ct != binary_t[i]) mismatches++;
+    }
+    double compressed_trace = seconds_since(start);
+
+    start = chrono::steady_clock::now();
+    BVH sbvh;
+    build_triangle_sbvh(sbvh, triangles);
+    double sbvh_build = seconds_since(start);
+
+    // Trace with the split BVH, which references the same triangles and must agree as well
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < ray_count; i++) {
+        float t;
+        vec3 N;
+        float st = hit_bvh(sbvh, triangles, rays[i], t, N) ? t : -1.0f;
+        if (st != binary_t[i]) mismatches++;
+    }
+    double sbvh_trace = seconds_since(start);
+
+    double mb = 1.0 / (1024.0 * 1024.0);
+    cout << "binary BVH:     build " << binary_build * 1000 << " ms, " << bvh.nodes.size() << " nodes, "
+         << bvh_memory_bytes(bvh) * mb << " MB, " << ray_count / binary_trace * 1e-6 << " Mrays/s\n";
+    cout << "compressed BVH: build +" << compress_build * 1000 << " ms, " << cbvh.nodes.size() << " nodes, "
+         << compressed_bvh_memory_bytes(cbvh) * mb << " MB, " << ray_count / compressed_trace * 1e-6 << " Mrays/s\n";
+    cout << "split BVH:      build " << sbvh_build * 1000 << " ms, " << sbvh.nodes.size() << " nodes, "
+         << bvh_memory_bytes(sbvh) * mb << " MB, " << ray_count / sbvh_trace * 1e-6 << " Mrays/s, "
+         << float(sbvh.prim_indices.size()) / triangle_count << " references per triangle\n";
+    cout << "mismatching hits: " << mismatches << "\n";
+
+    return mismatches == 0 ? 0 : 1;
+}
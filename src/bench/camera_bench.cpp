@@ -0,0 +1,83 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include "vec3.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Random.h"
+#include "Trace.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Times batched camera ray generation for every projection against rendering the same image at 1 spp, to show
+// generation is a negligible part of a frame, and optionally writes a 16 spp image per camera.
+// Usage: camera_bench [width] [height] [output prefix for PPMs]
+
+// Nanoseconds per ray to turn jittered film coordinates into rays on one thread, best of a few runs
+double generation_time(const Camera& camera) {
+    CameraRays rays;
+    rays.resize(camera.width * camera.height);
+    Rng rng(1);
+    for (int j = 0; j < camera.height; j++) {
+        for (int i = 0; i < camera.width; i++) {
+            rays.s[j * camera.width + i] = float(i + rng.next()) / float(camera.width);
+            rays.t[j * camera.width + i] = float(j + rng.next()) / float(camera.height);
+        }
+    }
+    double best = 1e30;
+    for (int run = 0; run < 5; run++) {
+        auto start = chrono::steady_clock::now();
+        camera.generate(rays, 0, rays.size, rng);
+        double t = seconds_since(start);
+        best = t < best ? t : best;
+    }
+    return best * 1e9 / rays.size;
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 400;
+    int height = argc > 2 ? atoi(argv[2]) : 200;
+    string prefix = argc > 3 ? argv[3] : "";
+
+    vec3 from(-0.6, 0.4, 0.6), at(0, 0, -1), up(0, 1, 0);
+    float focus_distance = (from - vec3(0, 0, -1)).length();  // The sphere is in focus
+    const int camera_count = 5;
+    const char* names[camera_count] = {"viewport", "look-at", "thin-lens", "orthographic", "equirect"};
+    Camera cameras[camera_count] = {
+        viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), width, height),
+        look_at_camera(from, at, up, 50.0f, width, height),
+        look_at_camera(from, at, up, 50.0f, width, height, 0.15f, focus_distance),
+        orthographic_camera(from, at, up, 2.0f, width, height),
+        equirect_camera(vec3(0, 0, 0), at, up, width, height)
+    };
+
+    Scene scene = make_area_light_scene();
+    TraceSettings settings;
+    settings.samples_per_pixel = 1;
+    cout << width << "x" << height << ", " << worker_count() << " threads\n";
+
+    for (int c = 0; c < camera_count; c++) {
+        double generate_ns = generation_time(cameras[c]);
+        Framebuffer fb(width, height);
+        settings.samples_per_pixel = 1;
+        auto start = chrono::steady_clock::now();
+        RayCounters counters = render_recursive(scene, cameras[c], settings, fb);
+        double render_ns = seconds_since(start) * 1e9 * worker_count() / (double(width) * height);
+        printf("%-12s: generate %6.2f ns/ray, render %8.1f ns/camera ray (thread time), generation %.2f%%, %llu rays\n",
+               names[c], generate_ns, render_ns, 100.0 * generate_ns / render_ns, (unsigned long long)counters.rays);
+
+        if (!prefix.empty()) {
+            settings.samples_per_pixel = 16;
+            render_recursive(scene, cameras[c], settings, fb);
+            if (!write_ppm(fb, prefix + names[c] + ".ppm")) {
+                cerr << "Could not write images with prefix " << prefix << "\n";
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
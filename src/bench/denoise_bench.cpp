@@ -0,0 +1,91 @@
+#include <iostream>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include "vec3.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Trace.h"
+#include "PathTracer.h"
+#include "Denoiser.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Renders the area light scene at low spp, denoises it with the SSE2 and the scalar filter and compares both with
+// brute-force sample counts against a converged reference.
+// Usage: denoise_bench [width] [height] [spp] [reference spp] [output prefix for PPMs]
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 400;
+    int height = argc > 2 ? atoi(argv[2]) : 200;
+    int spp = argc > 3 ? atoi(argv[3]) : 4;
+    int reference_spp = argc > 4 ? atoi(argv[4]) : 1024;
+    string prefix = argc > 5 ? argv[5] : "";
+
+    // The viewport of bonus.cpp
+    Camera camera = viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), width, height);
+
+    Scene scene = make_area_light_scene();
+    PathSettings settings;
+    settings.max_depth = 5;
+    cout << width << "x" << height << ", " << worker_count() << " threads\n";
+
+    Framebuffer reference(width, height);
+    settings.samples_per_pixel = reference_spp;
+    settings.seed = 1u << 20;
+    render_path_traced(scene, camera, settings, reference);
+
+    FeatureBuffers features;
+    features.resize(width, height);
+    auto start = chrono::steady_clock::now();
+    render_features(scene, camera, features);
+    double feature_time = seconds_since(start);
+
+    Framebuffer noisy(width, height);
+    settings.samples_per_pixel = spp;
+    settings.seed = 0;
+    start = chrono::steady_clock::now();
+    render_path_traced(scene, camera, settings, noisy);
+    double render_time = seconds_since(start);
+    cout << spp << " spp: " << render_time * 1000 << " ms + " << feature_time * 1000 << " ms features, RMSE "
+         << rmse(noisy, reference) << "\n";
+
+    DenoiseSettings denoise_settings;
+    DenoiseBuffers buffers;
+    Framebuffer denoised;
+    for (bool simd : {false, true}) {
+        denoise_settings.simd = simd;
+        const int runs = 5;
+        double best = 1e30;
+        for (int run = 0; run < runs; run++) {
+            denoised = noisy;
+            start = chrono::steady_clock::now();
+            denoise(denoised, features, denoise_settings, buffers);
+            double t = seconds_since(start);
+            best = t < best ? t : best;
+        }
+        cout << "  denoised (" << (simd ? "SSE2" : "scalar") << "): " << best * 1000 << " ms, RMSE "
+             << rmse(denoised, reference) << "\n";
+    }
+
+    // Brute force sample counts for comparison
+    for (int brute_spp = spp * 4; brute_spp <= reference_spp / 4; brute_spp *= 4) {
+        Framebuffer fb(width, height);
+        settings.samples_per_pixel = brute_spp;
+        settings.seed = uint64_t(brute_spp) << 8;
+        start = chrono::steady_clock::now();
+        render_path_traced(scene, camera, settings, fb);
+        cout << brute_spp << " spp: " << seconds_since(start) * 1000 << " ms, RMSE " << rmse(fb, reference) << "\n";
+    }
+
+    if (!prefix.empty()) {
+        if (!write_ppm(noisy, prefix + "noisy.ppm") || !write_ppm(denoised, prefix + "denoised.ppm") ||
+            !write_ppm(reference, prefix + "reference.ppm")) {
+            cerr << "Could not write images with prefix " << prefix << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
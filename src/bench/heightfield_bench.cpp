@@ -0,0 +1,180 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "vec3.h"
+#include "Scene.h"
+#include "Heightfield.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Renders a 1000 x 1000 terrain as a heightfield and, at a small grid size, also as the equivalent triangles
+// through the triangle BVH: memory, build and render time and the image difference. Then builds the full size
+// heightfield (16k x 16k samples by default) and compares its memory with what the triangles would need.
+// Usage: heightfield_bench [samples per side] [width] [height] [output prefix for PPMs]
+
+const float TERRAIN_EXTENT = 1000.0f;
+const float TERRAIN_HEIGHT = 80.0f;
+
+// Rolling hills from separable waves of falling amplitude plus hashed detail a fraction of a cell high. The waves
+// are tabulated per column and per row, which keeps filling 16k x 16k samples to a few multiply-adds each.
+void fill_terrain(Heightfield& hf) {
+    const int waves = 7;
+    int nx = hf.samples_x, nz = hf.samples_z;
+    vector<float> wx(size_t(waves) * nx), wz(size_t(waves) * nz);
+    float amplitude[waves], total = 0.0f;
+    for (int k = 0; k < waves; k++) {
+        float f = 2.0f * float(M_PI) * 2.3f * powf(2.1f, float(k)) / TERRAIN_EXTENT;
+        for (int x = 0; x < nx; x++) wx[size_t(k) * nx + x] = sinf(f * 1.13f * x * hf.cell_size + 1.7f * k);
+        for (int z = 0; z < nz; z++) wz[size_t(k) * nz + z] = sinf(f * 0.87f * z * hf.cell_size + 0.6f + 2.9f * k);
+        amplitude[k] = powf(0.48f, float(k));
+        total += amplitude[k];
+    }
+    parallel_for(nz, 64, [&](int begin, int end) {
+        for (int z = begin; z < end; z++) {
+            uint16_t* row = &hf.heights[size_t(z) * nx];
+            for (int x = 0; x < nx; x++) {
+                float h = 0.0f;
+                for (int k = 0; k < waves; k++) h += amplitude[k] * wx[size_t(k) * nx + x] * wz[size_t(k) * nz + z];
+                uint32_t hash = (uint32_t(x) * 73856093u) ^ (uint32_t(z) * 19349663u);
+                hash = (hash ^ (hash >> 13)) * 0x5bd1e995u;
+                float detail = float(hash >> 16) / 65535.0f - 0.5f;
+                float v = 0.5f + 0.45f * h / total + 0.3f * hf.cell_size / TERRAIN_HEIGHT * detail;
+                row[x] = uint16_t(v < 0.0f ? 0.0f : (v > 1.0f ? 65535.0f : v * 65535.0f));
+            }
+        }
+    });
+}
+
+// Terrain with samples per side, filled and with its pyramid built. Returns the build time.
+double build_terrain(Heightfield& hf, int samples) {
+    auto start = chrono::steady_clock::now();
+    float cell = TERRAIN_EXTENT / (samples - 1);
+    make_heightfield(hf, samples, samples, vec3(-0.5f * TERRAIN_EXTENT, 0, -TERRAIN_EXTENT), cell,
+                     TERRAIN_HEIGHT / 65535.0f);
+    fill_terrain(hf);
+    build_heightfield_pyramid(hf);
+    return seconds_since(start);
+}
+
+Scene make_terrain_scene() {
+    Scene scene;
+    scene.lights = {
+        {vec3(-400, 300, 100), vec3(0.95, 0.85, 0.7)},
+        {vec3(500, 200, -900), vec3(0.25, 0.3, 0.45)}
+    };
+    Material grass;
+    grass.albedo = vec3(0.45, 0.55, 0.3);
+    scene.material_ids[PRIM_HEIGHTFIELD] = {scene.materials.add(grass)};
+    return scene;
+}
+
+// Time of a 1 spp direct lighting render, best of three
+double render_time(const Scene& scene, const Camera& camera, Framebuffer& fb) {
+    TraceSettings settings;
+    settings.samples_per_pixel = 1;
+    settings.diffuse_bounces = false;
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        auto start = chrono::steady_clock::now();
+        render_recursive(scene, camera, settings, fb);
+        best = min(best, seconds_since(start));
+    }
+    return best;
+}
+
+// Pyramid blocks visited per camera ray through the pixel centers
+
+double blocks_per_ray(const Heightfield& hf, const Camera& camera) {
+    long long blocks = 0;
+    for (int j = 0; j < camera.height; j++) {
+        for (int i = 0; i < camera.width; i++) {
+            ray r = camera.get_ray((i + 0.5f) / camera.width, (j + 0.5f) / camera.height);
+            float t = FLT_MAX;
+            vec3 N;
+            int steps = 0;
+            intersect_heightfield(hf, r, 0.0f, t, N, &steps);
+            blocks += steps;
+        }
+    }
+    return double(blocks) / (double(camera.width) * camera.height);
+}
+
+int main(int argc, char** argv) {
+    int samples = argc > 1 ? atoi(argv[1]) : 16384;
+    int width = argc > 2 ? atoi(argv[2]) : 400;
+    int height = argc > 3 ? atoi(argv[3]) : 200;
+    string prefix = argc > 4 ? argv[4] : "";
+    const int small = 512;
+
+    Camera camera = look_at_camera(vec3(0, 70, -20), vec3(0, 25, -400), vec3(0, 1, 0), 50.0f, width, height);
+    cout << width << "x" << height << ", " << worker_count() << " threads\n";
+
+    // Small terrain both ways
+    Scene hf_scene = make_terrain_scene();
+    hf_scene.heightfields.emplace_back();
+    double hf_build = build_terrain(hf_scene.heightfields[0], small);
+    const Heightfield& small_hf = hf_scene.heightfields[0];
+    size_t hf_bytes = heightfield_memory_bytes(small_hf);
+
+    Scene tri_scene = make_terrain_scene();
+    auto start = chrono::steady_clock::now();
+    for (int z = 0; z + 1 < small; z++) {
+        for (int x = 0; x + 1 < small; x++) {
+            Triangle a, b;
+            heightfield_cell_triangles(small_hf, x, z, a, b);
+            tri_scene.triangles.push_back(a);
+            tri_scene.triangles.push_back(b);
+        }
+    }
+    Material grass;
+    grass.albedo = vec3(0.45, 0.55, 0.3);
+    tri_scene.material_ids[PRIM_TRIANGLE].assign(tri_scene.triangles.size(), tri_scene.materials.add(grass));
+    build_scene_bvh(tri_scene);
+    double tri_build = seconds_since(start);
+    size_t tri_bytes = tri_scene.triangles.size() * sizeof(Triangle) + bvh_memory_bytes(tri_scene.triangle_bvh);
+    double tri_bytes_per_triangle = double(tri_bytes) / tri_scene.triangles.size();
+
+    Framebuffer hf_fb(width, height), tri_fb(width, height);
+    double hf_time = render_time(hf_scene, camera, hf_fb);
+    double tri_time = render_time(tri_scene, camera, tri_fb);
+    printf("%dx%d samples, %zu triangles:\n", small, small, tri_scene.triangles.size());
+    printf("  heightfield: %8.2f MB, built in %6.3f s, 1 spp in %7.1f ms, %.1f pyramid blocks per camera ray\n",
+           hf_bytes / 1048576.0, hf_build, hf_time * 1000, blocks_per_ray(small_hf, camera));
+    printf("  triangles:   %8.2f MB, built in %6.3f s, 1 spp in %7.1f ms\n", tri_bytes / 1048576.0, tri_build,
+           tri_time * 1000);
+    printf("  RMSE between the two images %.5f\n", rmse(hf_fb, tri_fb));
+
+    // Full size terrain as a heightfield only
+    Scene scene = make_terrain_scene();
+    scene.heightfields.emplace_back();
+    double build = build_terrain(scene.heightfields[0], samples);
+    const Heightfield& hf = scene.heightfields[0];
+    double cells = double(samples - 1) * (samples - 1);
+    double equivalent = 2.0 * cells * tri_bytes_per_triangle;
+    Framebuffer fb(width, height);
+    double time = render_time(scene, camera, fb);
+    printf("%dx%d samples, %zu pyramid levels:\n", samples, samples, hf.levels.size());
+    printf("  heightfield: %8.1f MB (heights %.1f MB), built in %.2f s, 1 spp in %.1f ms, "
+           "%.1f pyramid blocks per camera ray\n", heightfield_memory_bytes(hf) / 1048576.0,
+           hf.heights.size() * 2.0 / 1048576.0, build, time * 1000, blocks_per_ray(hf, camera));
+    printf("  as %.0f triangles with a BVH at %.1f bytes per triangle: %.1f GB\n", 2.0 * cells,
+           tri_bytes_per_triangle, equivalent / 1073741824.0);
+
+    if (!prefix.empty()) {
+        if (!write_ppm(hf_fb, prefix + "small.ppm") || !write_ppm(fb, prefix + "full.ppm")) {
+            cerr << "Could not write images with prefix " << prefix << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
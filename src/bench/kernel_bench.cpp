@@ -0,0 +1,305 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include "vec3.h"
+#include "ray.h"
+#include "AABB.h"
+#include "Sphere.h"
+#include "Triangle.h"
+#include "Cube.h"
+#include "Plane.h"
+#include "Random.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Times the ray/primitive intersection kernels on their own: every kernel gets a fixed set of primitive and ray
+// pairs of which a chosen fraction hit, in shuffled order so the branches see the same mix a traversal would.
+// Reports nanoseconds and cycles per test. Cycles are the core's own counter from perf_event_open where the kernel
+// allows it, else the time stamp counter (constant rate reference cycles), else not reported.
+// Usage: kernel_bench [pairs per kernel] [tests per pair] [hit percentages...]
+
+// Source of cycle counts, picked once at startup
+struct CycleCounter {
+    int fd = -1;                  // perf_event_open counter of core cycles, -1 if unavailable
+    const char* source = "none";
+
+    CycleCounter() {
+#ifdef __linux__
+        perf_event_attr attr = {};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = int(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (fd >= 0) {
+            source = "core cycles (perf_event_open)";
+            return;
+        }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+        source = "reference cycles (rdtsc)";
+#endif
+    }
+
+    ~CycleCounter() {
+#ifdef __linux__
+        if (fd >= 0) close(fd);
+#endif
+    }
+
+    bool available() const {
+#if defined(__x86_64__) || defined(__i386__)
+        return true;
+#else
+        return fd >= 0;
+#endif
+    }
+
+    inline uint64_t now() const {
+#ifdef __linux__
+        if (fd >= 0) {
+            uint64_t count = 0;
+            if (read(fd, &count, sizeof(count)) == sizeof(count)) return count;
+        }
+#endif
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+};
+
+vec3 random_unit(Rng& rng) {
+    while (true) {
+        vec3 v(2.0f * rng.next() - 1.0f, 2.0f * rng.next() - 1.0f, 2.0f * rng.next() - 1.0f);
+        float len2 = v.squared_length();
+        if (len2 > 1e-4f && len2 <= 1.0f) return v / sqrtf(len2);
+    }
+}
+
+// Unit vector perpendicular to d
+vec3 random_perpendicular(const vec3& d, Rng& rng) {
+    vec3 b1, b2;
+    make_basis(d, b1, b2);
+    float phi = 2.0f * float(M_PI) * rng.next();
+    return cosf(phi) * b1 + sinf(phi) * b2;
+}
+
+// Ray at a random angle passing at distance offset from center; it misses a convex primitive of bounding radius
+// below offset and hits one that contains the ball of radius offset around center
+ray ray_past(const vec3& center, float offset, Rng& rng) {
+    vec3 d = random_unit(rng);
+    vec3 through = center + offset * random_perpendicular(d, rng);
+    return ray(through - 5.0f * d, d);
+}
+
+// Random primitive and ray pairs, hit[i] says whether pair i was made to hit
+template <class Prim>
+struct KernelCase {
+    vector<Prim> prims;
+    vector<ray> rays;
+    vector<char> hit;
+};
+
+vec3 random_center(Rng& rng) {
+    return vec3(10.0f * rng.next() - 5.0f, 10.0f * rng.next() - 5.0f, 10.0f * rng.next() - 5.0f);
+}
+
+// Hit or miss pattern with round(hit_fraction * count) hits, shuffled
+vector<char> hit_pattern(int count, double hit_fraction, Rng& rng) {
+    vector<char> hit(count, 0);
+    int hits = int(lround(hit_fraction * count));
+    for (int i = 0; i < hits; i++) hit[i] = 1;
+    for (int i = count - 1; i > 0; i--) swap(hit[i], hit[rng.next_uint() % (i + 1)]);
+    return hit;
+}
+
+KernelCase<Sphere> make_sphere_case(const vector<char>& hit, Rng& rng) {
+    KernelCase<Sphere> kc;
+    kc.hit = hit;
+    for (char h : hit) {
+        Sphere s{random_center(rng), 0.5f + rng.next()};
+        kc.prims.push_back(s);
+        kc.rays.push_back(ray_past(s.center, (h ? 0.9f * rng.next() : 1.05f + rng.next()) * s.radius, rng));
+    }
+    return kc;
+}
+
+// Triangles hit through a point inside them, missed through a point in their plane outside them
+KernelCase<Triangle> make_triangle_case(const vector<char>& hit, Rng& rng) {
+    KernelCase<Triangle> kc;
+    kc.hit = hit;
+    for (char h : hit) {
+        vec3 c = random_center(rng);
+        Triangle tri{c + random_unit(rng), c + random_unit(rng), c + random_unit(rng)};
+        float u = rng.next(), v = rng.next();
+        if (h) {
+            if (u + v > 1.0f) { u = 1.0f - u; v = 1.0f - v; }
+            u = 0.05f + 0.9f * u;
+            v = 0.05f + 0.9f * v * (1.0f - u);
+        } else {
+            u += 1.05f;
+        }
+        vec3 through = tri.v0 + u * (tri.v1 - tri.v0) + v * (tri.v2 - tri.v0);
+        vec3 d = random_unit(rng);
+        kc.prims.push_back(tri);
+        kc.rays.push_back(ray(through - 5.0f * d, d));
+    }
+    return kc;
+}
+
+KernelCase<Cube> make_cube_case(const vector<char>& hit, Rng& rng) {
+    KernelCase<Cube> kc;
+    kc.hit = hit;
+    for (char h : hit) {
+        Cube cube{random_center(rng), 0.5f + rng.next()};
+        float half = 0.5f * cube.side_length;
+        float offset = h ? 0.9f * half * rng.next() : (1.05f + rng.next()) * sqrtf(3.0f) * half;
+        kc.prims.push_back(cube);
+        kc.rays.push_back(ray_past(cube.center, offset, rng));
+    }
+    return kc;
+}
+
+// Planes are hit from above by rays heading down and missed by rays heading up
+KernelCase<Plane> make_plane_case(const vector<char>& hit, Rng& rng) {
+    KernelCase<Plane> kc;
+    kc.hit = hit;
+    for (char h : hit) {
+        Plane plane{random_center(rng), random_unit(rng)};
+        vec3 d = random_unit(rng);
+        if ((dot(d, plane.normal) < 0.0f) != bool(h)) d = -d;
+        kc.prims.push_back(plane);
+        vec3 from = plane.point + (1.0f + rng.next()) * plane.normal + 2.0f * random_perpendicular(plane.normal, rng);
+        kc.rays.push_back(ray(from, d));
+    }
+    return kc;
+}
+
+KernelCase<AABB> make_box_case(const vector<char>& hit, Rng& rng) {
+    KernelCase<AABB> kc;
+    kc.hit = hit;
+    for (char h : hit) {
+        vec3 c = random_center(rng);
+        vec3 half(0.25f + 0.5f * rng.next(), 0.25f + 0.5f * rng.next(), 0.25f + 0.5f * rng.next());
+        AABB box;
+        box.bmin = c - half;
+        box.bmax = c + half;
+        float inner = min(half.x(), min(half.y(), half.z()));
+        float offset = h ? 0.9f * inner * rng.next() : (1.05f + rng.next()) * half.length();
+        kc.prims.push_back(box);
+        kc.rays.push_back(ray_past(c, offset, rng));
+    }
+    return kc;
+}
+
+struct KernelResult {
+    double ns = 0;      // Per test
+    double cycles = 0;  // Per test, 0 without a cycle counter
+    int hits = 0;       // Pairs the kernel reported as hits
+    int expected = 0;   // Pairs made to hit
+};
+
+// Runs test(i, t) over all pairs reps times, best of five. test returns whether pair i hit and its distance.
+template <class Test>
+KernelResult time_kernel(int count, int reps, const vector<char>& hit, const CycleCounter& counter, Test&& test) {
+    KernelResult res;
+    for (int i = 0; i < count; i++) {
+        float t;
+        res.hits += test(i, t);
+        res.expected += hit[i];
+    }
+    double best = 1e30;
+    uint64_t best_cycles = 0;
+    volatile float sink = 0.0f;  // Keeps the distances live
+    for (int run = 0; run < 5; run++) {
+        float sum = 0.0f;
+        auto start = chrono::steady_clock::now();
+        uint64_t c0 = counter.now();
+        for (int rep = 0; rep < reps; rep++) {
+            for (int i = 0; i < count; i++) {
+                float t = 0.0f;
+                if (test(i, t)) sum += t;
+            }
+        }
+        uint64_t c1 = counter.now();
+        double seconds = seconds_since(start);
+        sink = sink + sum;
+        if (seconds < best) {
+            best = seconds;
+            best_cycles = c1 - c0;
+        }
+    }
+    double tests = double(count) * reps;
+    res.ns = best / tests * 1e9;
+    res.cycles = counter.available() ? best_cycles / tests : 0.0;
+    return res;
+}
+
+void print_result(const char* name, double hit_percent, const KernelResult& res) {
+    printf("  %-24s %5.0f%%  %8.2f ns  %8.1f cycles  %d / %d hits\n", name, hit_percent, res.ns, res.cycles, res.hits,
+           res.expected);
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 4096;
+    int reps = argc > 2 ? atoi(argv[2]) : 200;
+    vector<double> percents;
+    for (int a = 3; a < argc; a++) percents.push_back(atof(argv[a]));
+    if (percents.empty()) percents = {0, 50, 100};
+
+    CycleCounter counter;
+    printf("%d pairs per kernel, %d tests per pair, best of 5, cycles: %s\n", count, reps, counter.source);
+    for (double percent : percents) {
+        Rng rng(uint64_t(percent * 1000) + 1);
+        vector<char> hit = hit_pattern(count, percent / 100.0, rng);
+        KernelCase<Sphere> spheres = make_sphere_case(hit, rng);
+        KernelCase<Triangle> triangles = make_triangle_case(hit, rng);
+        KernelCase<Cube> cubes = make_cube_case(hit, rng);
+        KernelCase<Plane> planes = make_plane_case(hit, rng);
+        KernelCase<AABB> boxes = make_box_case(hit, rng);
+
+        // Per ray data is set up outside the timed loops, the way traversal amortizes it over many tests
+        vector<RayShear> shears;
+        for (const ray& r : triangles.rays) shears.push_back(make_ray_shear(r.D));
+        vector<RayBoxQuery> queries;
+        for (const ray& r : boxes.rays) queries.push_back(make_box_query(r));
+
+        vec3 N;
+        print_result("hit_sphere", percent, time_kernel(count, reps, hit, counter, [&](int i, float& t) {
+            return hit_sphere(spheres.prims[i], spheres.rays[i], t, N) && t > 0.0f;
+        }));
+        print_result("hit_triangle", percent, time_kernel(count, reps, hit, counter, [&](int i, float& t) {
+            return hit_triangle(triangles.prims[i], triangles.rays[i], t, N);
+        }));
+        print_result("hit_triangle_watertight", percent, time_kernel(count, reps, hit, counter, [&](int i, float& t) {
+            return hit_triangle_watertight(triangles.prims[i], triangles.rays[i], shears[i], FLT_MAX, t);
+        }));
+        print_result("hit_cube", percent, time_kernel(count, reps, hit, counter, [&](int i, float& t) {
+            return hit_cube(cubes.prims[i], cubes.rays[i], t, N);
+        }));
+        print_result("hit_plane", percent, time_kernel(count, reps, hit, counter, [&](int i, float& t) {
+            return hit_plane(planes.prims[i], planes.rays[i], t, N);
+        }));
+        print_result("hit_aabb", percent, time_kernel(count, reps, hit, counter, [&](int i, float& t) {
+            return hit_aabb(boxes.prims[i], queries[i], FLT_MAX, t);
+        }));
+    }
+    return 0;
+}
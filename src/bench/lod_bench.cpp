@@ -0,0 +1,165 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "vec3.h"
+#include "Triangle.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "MeshLOD.h"
+#include "Image.h"
+#include "Trace.h"
+#include "RayDifferential.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Places three copies of a dense bumpy sphere near, mid-distance and far from the camera and compares tracing them
+// at full resolution with picking levels of detail from the ray cones: BVH steps per camera ray, render time and
+// the image difference. Also checks that a convex mesh does not shadow itself: rays leaving a hit must test the mesh
+// at the level they left. Usage: lod_bench [width] [height] [segments] [output prefix for PPMs]
+
+// Function to count the rays leaving a convex sphere mesh along its outward normal that the mesh itself blocks, out of
+// the hits of rays fired at it. Rays pick levels with a cone of the given spread; with keep_level the rays leaving a
+// hit reuse its level as the renderers do, without it each picks its own like a ray of another path would.
+void count_self_occlusion(const Scene& scene, float spread, bool keep_level, int rays, int& hits, int& blocked) {
+    Rng rng(5);
+    hits = blocked = 0;
+    for (int k = 0; k < rays; k++) {
+        vec3 origin = 4.0f * unit_vector(sample_unit_ball(rng) + vec3(1e-4f, 0, 0));
+        ray r(origin, 0.9f * sample_unit_ball(rng) - origin);
+        RayCone cone;
+        cone.spread = spread;
+        cone.lod_u = lod_sample(r);
+        HitRecord rec;
+        if (!intersect_scene(scene, r, rec, FLT_MAX, cone)) continue;
+        hits++;
+        RayCone leaving = keep_level ? cone_at_hit(cone, r, rec) : cone_at_hit(cone, r, rec.t);
+        if (!keep_level) leaving.lod_u = -1.0f;
+        vec3 N = unit_vector(face_forward(rec.N, r));
+        blocked += occluded(scene, spawn_ray(rec, N), 100.0f, leaving);
+    }
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 400;
+    int height = argc > 2 ? atoi(argv[2]) : 200;
+    int segments = argc > 3 ? atoi(argv[3]) : 384;
+    string prefix = argc > 4 ? argv[4] : "";
+
+    Camera camera = look_at_camera(vec3(0, 0.5, 2), vec3(0, 0, -4), vec3(0, 1, 0), 40.0f, width, height);
+
+    Scene scene;
+    scene.lights = {
+        {vec3(-4, 6, 2), vec3(0.9, 0.8, 0.7)},
+        {vec3(5, 3, -10), vec3(0.3, 0.4, 0.6)}
+    };
+    scene.planes = {{vec3(0, -1.2, 0), vec3(0, 1, 0)}};
+    const vec3 centers[3] = {vec3(-1.3, 0, -1), vec3(1.5, 0, -8), vec3(0, 0, -40)};
+    auto start = chrono::steady_clock::now();
+    for (const vec3& center : centers) {
+        vector<Triangle> triangles;
+        make_bumpy_sphere(center, 1.0f, segments, triangles);
+        scene.meshes.emplace_back();
+        build_mesh_lod(scene.meshes.back(), triangles);
+    }
+    double build_time = seconds_since(start);
+    Material clay;
+    clay.albedo = vec3(0.8, 0.55, 0.4);
+    scene.material_ids[PRIM_MESH].assign(scene.meshes.size(), scene.materials.add(clay));
+
+    const MeshLOD& mesh = scene.meshes[0];
+    cout << width << "x" << height << ", " << worker_count() << " threads, 3 meshes built in " << build_time << " s\n";
+    for (size_t l = 0; l < mesh.levels.size(); l++) {
+        printf("  level %zu: %7zu triangles, mean edge %.5f\n", l, mesh.levels[l].size(), mesh.edge_lengths[l]);
+    }
+
+    // BVH steps of one camera ray per pixel center against each mesh, with the camera's cone and without
+    CameraRays rays;
+    rays.resize(width * height);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            rays.s[j * width + i] = (i + 0.5f) / float(width);
+            rays.t[j * width + i] = (j + 0.5f) / float(height);
+        }
+    }
+    Rng rng(1);
+    camera.generate(rays, 0, rays.size, rng);
+    for (size_t m = 0; m < scene.meshes.size(); m++) {
+        long long steps_full = 0, steps_lod = 0, hits_full = 0, hits_lod = 0, entered = 0;
+        vector<int> level_counts(scene.meshes[m].levels.size(), 0);
+        for (int i = 0; i < rays.size; i++) {
+            ray r = rays.get(i);
+            RayCone cone = rays.cone(i);
+            float t = FLT_MAX;
+            vec3 N;
+            int steps = 0;
+            hits_full += intersect_mesh(scene.meshes[m], r, LODQuery(), 0.0f, t, N, nullptr, &steps);
+            steps_full += steps;
+            steps = 0;
+            t = FLT_MAX;
+            hits_lod += intersect_mesh(scene.meshes[m], r, lod_query(cone, int(m)), 0.0f, t, N, nullptr, &steps);
+            steps_lod += steps;
+            float t_near;
+            if (!hit_aabb(scene.meshes[m].bounds, make_box_query(r), FLT_MAX, t_near)) continue;
+            entered++;
+            float footprint = cone.width + cone.spread * t_near * r.direction().length();
+            level_counts[select_lod(scene.meshes[m], footprint, cone.lod_u)]++;
+        }
+        entered = entered ? entered : 1;
+        printf("mesh %zu at distance %4.1f: steps per ray entering its bounds %6.2f full, %6.2f LOD; %lld / %lld pixels hit;"
+               " levels used:", m, (centers[m] - camera.origin).length(), double(steps_full) / entered,
+               double(steps_lod) / entered, hits_full, hits_lod);
+        for (size_t l = 0; l < level_counts.size(); l++) {
+            if (level_counts[l]) printf(" %zu:%d", l, level_counts[l]);
+        }
+        printf("\n");
+    }
+
+    // Self-occlusion of a convex mesh with a cone that picks coarse levels
+    Scene convex;
+    vector<Triangle> sphere_triangles;
+    make_sphere_mesh(vec3(0, 0, 0), 1.0f, 256, sphere_triangles);
+    convex.meshes.emplace_back();
+    build_mesh_lod(convex.meshes.back(), sphere_triangles);
+    const int occlusion_rays = 50000;
+    int hits, blocked_kept, blocked_own, blocked_full;
+    count_self_occlusion(convex, 0.02f, true, occlusion_rays, hits, blocked_kept);
+    count_self_occlusion(convex, 0.02f, false, occlusion_rays, hits, blocked_own);
+    count_self_occlusion(convex, 0.0f, true, occlusion_rays, hits, blocked_full);
+    printf("convex mesh, rays along the normal blocked by the mesh itself: %d / %d with the hit's level, %d with each"
+           " ray's own level, %d at full resolution%s\n", blocked_kept, hits, blocked_own, blocked_full,
+           blocked_kept || blocked_full ? "  FAIL" : "");
+
+    // Whole renders, best of three: full resolution (no footprint) against LOD picked by ray cones, and a second
+    // full resolution render with other seeds for the noise floor
+    TraceSettings settings;
+    settings.samples_per_pixel = 8;
+    settings.diffuse_bounces = false;
+    Framebuffer full(width, height), full2(width, height), lod(width, height);
+    double full_time = 1e30, lod_time = 1e30;
+    for (int run = 0; run < 3; run++) {
+        start = chrono::steady_clock::now();
+        render_recursive<NoFootprint>(scene, camera, settings, full);
+        full_time = min(full_time, seconds_since(start));
+        start = chrono::steady_clock::now();
+        render_recursive<RayCone>(scene, camera, settings, lod);
+        lod_time = min(lod_time, seconds_since(start));
+    }
+    settings.seed = 7;
+    render_recursive<NoFootprint>(scene, camera, settings, full2);
+    printf("%d spp: full %.1f ms, LOD %.1f ms; RMSE LOD against full %.4f, full against full with other seeds %.4f\n",
+           settings.samples_per_pixel, full_time * 1000, lod_time * 1000, rmse(lod, full), rmse(full2, full));
+
+    if (!prefix.empty()) {
+        if (!write_ppm(full, prefix + "full.ppm") || !write_ppm(lod, prefix + "lod.ppm")) {
+            cerr << "Could not write images with prefix " << prefix << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "vec3.h"
+#include "Scene.h"
+#include "Motion.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Random.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Measures what motion blur costs. A field of spheres and triangles is traced three ways: as static primitives, as
+// moving primitives that do not move, and as moving primitives with the shutter open. The first two show the
+// overhead of the motion BVH, the third the cost of the motion itself. Also renders the blurred image by averaging
+// whole frames at fixed instants, the approach time sampled rays replace.
+// Usage: motion_bench [objects per kind] [width] [height] [samples per pixel] [output prefix for PPMs]
+
+// Random triangles and a thousandth as many spheres over a ground plane, every object moving by velocity * (its random
+// speed) over the shutter. Velocity 0 with moving = true keeps the moving types but not the motion. Static spheres
+// are tested one by one, so they are kept few.
+Scene make_field_scene(int count, bool moving, const vec3& velocity) {
+    Scene scene;
+    scene.lights = {
+        {vec3(-10, 12, 6), vec3(0.9, 0.85, 0.8)},
+        {vec3(12, 8, -4), vec3(0.3, 0.35, 0.45)}
+    };
+    scene.planes = {{vec3(0, 0, 0), vec3(0, 1, 0)}};
+    Rng rng(11);
+    for (int i = 0; i < count / 1000; i++) {
+        vec3 c(20.0f * rng.next() - 10.0f, 0.3f + 2.0f * rng.next(), -20.0f * rng.next() - 2.0f);
+        float radius = 0.2f + 0.3f * rng.next();
+        vec3 move = (0.5f + rng.next()) * velocity;
+        if (moving) scene.moving_spheres.push_back({c, c + move, radius});
+        else scene.spheres.push_back({c, radius});
+    }
+    for (int i = 0; i < count; i++) {
+        vec3 c(20.0f * rng.next() - 10.0f, 0.3f + 2.0f * rng.next(), -20.0f * rng.next() - 2.0f);
+        vec3 a = c + 0.4f * sample_unit_ball(rng), b = c + 0.4f * sample_unit_ball(rng), d = c + 0.4f * sample_unit_ball(rng);
+        Triangle tri{a, b, d};
+        vec3 move = (0.5f + rng.next()) * velocity;
+        if (moving) scene.moving_triangles.push_back({tri, Triangle{a + move, b + move, d + move}});
+        else scene.triangles.push_back(tri);
+    }
+    Material red, grey;
+    red.albedo = vec3(0.7, 0.3, 0.25);
+    grey.albedo = vec3(0.5, 0.5, 0.5);
+    MaterialId red_id = scene.materials.add(red);
+    scene.material_ids[PRIM_SPHERE] = {red_id};
+    scene.material_ids[PRIM_MOVING_SPHERE] = {red_id};
+    scene.material_ids[PRIM_PLANE] = {scene.materials.add(grey)};
+    build_scene_bvh(scene);
+    return scene;
+}
+
+// Nearest hits of the camera rays through random points of every pixel at random times, best of three
+double trace_mrays(const Scene& scene, const Camera& camera, int& hits) {
+    vector<ray> rays;
+    Rng rng(5);
+    for (int j = 0; j < camera.height; j++) {
+        for (int i = 0; i < camera.width; i++) {
+            rays.push_back(camera.get_ray((i + rng.next()) / camera.width, (j + rng.next()) / camera.height, 0.0f,
+                                          0.0f, rng.next()));
+        }
+    }
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (const ray& r : rays) {
+            HitRecord rec;
+            hits += intersect_scene(scene, r, rec);
+        }
+        best = min(best, seconds_since(start));
+    }
+    return rays.size() / best * 1e-6;
+}
+
+// Time of a direct lighting render, best of three
+double render_time(const Scene& scene, const Camera& camera, int spp, Framebuffer& fb) {
+    TraceSettings settings;
+    settings.samples_per_pixel = spp;
+    settings.diffuse_bounces = false;
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        auto start = chrono::steady_clock::now();
+        render_recursive(scene, camera, settings, fb);
+        best = min(best, seconds_since(start));
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+    int width = argc > 2 ? atoi(argv[2]) : 400;
+    int height = argc > 3 ? atoi(argv[3]) : 200;
+    int spp = argc > 4 ? atoi(argv[4]) : 8;
+    string prefix = argc > 5 ? argv[5] : "";
+
+    Camera camera = look_at_camera(vec3(0, 3, 4), vec3(0, 0.5f, -8), vec3(0, 1, 0), 60.0f, width, height);
+    Camera blurred = camera;
+    blurred.shutter_close = 1.0f;
+    vec3 velocity(0.6f, 0.0f, 0.0f);
+    Scene still = make_field_scene(count, false, velocity);
+    Scene zero = make_field_scene(count, true, vec3(0, 0, 0));
+    Scene moving = make_field_scene(count, true, velocity);
+    cout << count << " triangles and " << count / 1000 << " spheres, " << width << "x" << height << ", " << worker_count()
+         << " threads\n";
+
+    printf("Triangle BVH memory: static %.2f MB, motion %.2f MB\n", bvh_memory_bytes(still.triangle_bvh) / 1048576.0,
+           motion_bvh_memory_bytes(moving.moving_triangle_bvh) / 1048576.0);
+
+    int hits_still, hits_zero, hits_moving;
+    double mr_still = trace_mrays(still, camera, hits_still);
+    double mr_zero = trace_mrays(zero, camera, hits_zero);
+    double mr_moving = trace_mrays(moving, blurred, hits_moving);
+    printf("Camera rays, best of 3 (1 thread):\n");
+    printf("  static:              %6.2f Mrays/s, %d hits\n", mr_still, hits_still);
+    printf("  moving, no motion:   %6.2f Mrays/s, %d hits\n", mr_zero, hits_zero);
+    printf("  moving, shutter open %6.2f Mrays/s, %d hits\n", mr_moving, hits_moving);
+
+    Framebuffer fb_still(width, height), fb_zero(width, height), fb_moving(width, height);
+    double t_still = render_time(still, camera, spp, fb_still);
+    double t_zero = render_time(zero, camera, spp, fb_zero);
+    double t_moving = render_time(moving, blurred, spp, fb_moving);
+    printf("%d spp direct lighting, best of 3:\n", spp);
+    printf("  static:               %7.1f ms\n", t_still * 1000);
+    printf("  moving, no motion:    %7.1f ms, RMSE to static %.6f\n", t_zero * 1000, rmse(fb_still, fb_zero));
+    printf("  moving, time sampled: %7.1f ms\n", t_moving * 1000);
+
+    // The same blur from spp whole frames, each at one instant of the shutter with 1 sample per pixel
+    Framebuffer fb_frames(width, height), frame(width, height);
+    auto start = chrono::steady_clock::now();
+    for (int f = 0; f < spp; f++) {
+        Camera instant = camera;
+        instant.shutter_open = instant.shutter_close = (f + 0.5f) / spp;
+        TraceSettings settings;
+        settings.samples_per_pixel = 1;
+        settings.diffuse_bounces = false;
+        settings.seed = uint64_t(f);
+        render_recursive(moving, instant, settings, frame);
+        for (size_t i = 0; i < frame.pixels.size(); i++) fb_frames.pixels[i] += frame.pixels[i] / float(spp);
+    }
+    printf("  %d frames averaged:   %7.1f ms, RMSE to time sampled %.5f\n", spp, seconds_since(start) * 1000,
+           rmse(fb_frames, fb_moving));
+
+    if (!prefix.empty()) {
+        if (!write_ppm(fb_still, prefix + "static.ppm") || !write_ppm(fb_moving, prefix + "blurred.ppm") ||
+            !write_ppm(fb_frames, prefix + "frames.ppm")) {
+            cerr << "Could not write images with prefix " << prefix << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
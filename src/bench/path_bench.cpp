@@ -0,0 +1,66 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include "vec3.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "PathTracer.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Equal-time comparison of the path tracer's light sampling strategies against a converged reference.
+// Usage: path_bench [width] [height] [milliseconds per strategy] [reference spp]
+
+// Render 1 spp passes with independent seeds until the time budget is spent, returns the number of passes.
+// first_seed keeps the streams of different renders apart.
+int render_for(const Scene& scene, const Camera& camera, PathSettings settings, double budget, uint64_t first_seed, Framebuffer& fb) {
+    Framebuffer pass(fb.width, fb.height);
+    vector<vec3> sum(fb.pixels.size(), vec3(0, 0, 0));
+    settings.samples_per_pixel = 1;
+    int passes = 0;
+    auto start = chrono::steady_clock::now();
+    while (passes == 0 || seconds_since(start) < budget) {
+        settings.seed = first_seed + passes;
+        render_path_traced(scene, camera, settings, pass);
+        for (size_t i = 0; i < sum.size(); i++) sum[i] += pass.pixels[i];
+        passes++;
+    }
+    for (size_t i = 0; i < sum.size(); i++) fb.pixels[i] = sum[i] / float(passes);
+    return passes;
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 200;
+    int height = argc > 2 ? atoi(argv[2]) : 100;
+    double budget = (argc > 3 ? atof(argv[3]) : 1000.0) * 1e-3;
+    int reference_spp = argc > 4 ? atoi(argv[4]) : 4096;
+
+    // The viewport of bonus.cpp
+    Camera camera = viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), width, height);
+
+    Scene scene = make_area_light_scene();
+    PathSettings settings;
+    settings.max_depth = 5;
+    cout << width << "x" << height << ", " << budget * 1000 << " ms per strategy, " << worker_count() << " threads\n";
+
+    // Reference: MIS with many samples, on random streams none of the timed renders use
+    Framebuffer reference(width, height);
+    settings.samples_per_pixel = reference_spp;
+    settings.seed = 1u << 20;
+    auto start = chrono::steady_clock::now();
+    render_path_traced(scene, camera, settings, reference);
+    cout << "reference: " << reference_spp << " spp MIS in " << seconds_since(start) << " s\n";
+
+    const char* names[3] = {"BSDF sampling", "light sampling", "MIS"};
+    for (int s = SAMPLE_BSDF; s <= SAMPLE_MIS; s++) {
+        settings.sampling = LightSampling(s);
+        Framebuffer fb(width, height);
+        int spp = render_for(scene, camera, settings, budget, uint64_t(s) << 16, fb);
+        cout << "  " << names[s] << ": " << spp << " spp, RMSE " << rmse(fb, reference) << "\n";
+    }
+    return 0;
+}
@@ -0,0 +1,300 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "vec3.h"
+#include "Scene.h"
+#include "MeshLOD.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Random.h"
+#include "Parallel.h"
+#include "Trace.h"
+#include "Heatmap.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Standard scenes for tracking render performance across changes: a sphere field, a triangle soup, cube voxels, a
+// plane with a dense mesh and a scene lit by many lights. Each is generated from a fixed seed and reports its build
+// time, memory, single thread camera ray throughput and the time of a path traced frame. The results go to stdout
+// as JSON (or to the given file), a readable table goes to stderr. Given a heatmap directory, every scene's frame
+// and its traversal heatmap are written there as <scene>.ppm and <scene>_heatmap.ppm.
+// Usage: render_bench [width] [height] [samples per pixel] [output JSON file] [heatmap directory]
+
+// One generated scene with the camera it is rendered from
+struct BenchCase {
+    string name;
+    Scene scene;
+    Camera camera;
+    double build_seconds = 0;  // Generating the primitives and building the acceleration structures
+};
+
+// Results of one scene, the fields of its JSON object
+struct BenchResult {
+    string name;
+    size_t primitives = 0;
+    size_t lights = 0;
+    size_t memory_bytes = 0;
+    double build_ms = 0;
+    double camera_mrays = 0;     // Nearest hits of camera rays, one thread
+    double camera_hit_rate = 0;  // Fraction of them that hit, a change means the scene or the tracing changed
+    double frame_ms = 0;         // Path traced frame on all threads, best of three
+    double frame_mrays = 0;      // Path segments and shadow rays of that frame per second
+    uint64_t frame_rays = 0;
+};
+
+// Sun and sky fill light shared by the single light scenes
+void add_default_lights(Scene& scene) {
+    scene.lights = {
+        {vec3(-6, 10, 4), vec3(0.9, 0.85, 0.75)},
+        {vec3(8, 6, -6), vec3(0.25, 0.3, 0.4)}
+    };
+}
+
+// Spheres of random size and material on a jittered grid over a ground plane
+void make_sphere_field(Scene& scene, Rng& rng) {
+    add_default_lights(scene);
+    scene.planes = {{vec3(0, 0, 0), vec3(0, 1, 0)}};
+    Material matte, mirror, glossy;
+    matte.albedo = vec3(0.6, 0.35, 0.3);
+    mirror.type = MAT_MIRROR;
+    mirror.albedo = vec3(0.9, 0.9, 0.9);
+    glossy.type = MAT_GLOSSY;
+    glossy.albedo = vec3(0.4, 0.5, 0.7);
+    glossy.roughness = 0.25f;
+    const MaterialId ids[3] = {scene.materials.add(matte), scene.materials.add(mirror), scene.materials.add(glossy)};
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            float radius = 0.15f + 0.15f * rng.next();
+            vec3 c(-8.0f + x + 0.5f * rng.next(), radius, -2.0f - z - 0.5f * rng.next());
+            scene.spheres.push_back({c, radius});
+            scene.material_ids[PRIM_SPHERE].push_back(ids[rng.next_uint() % 3]);
+        }
+    }
+}
+
+// Small randomly oriented triangles filling a box in front of the camera
+void make_triangle_soup(Scene& scene, Rng& rng) {
+    add_default_lights(scene);
+    const int count = 200000;
+    float size = 6.0f / cbrtf(float(count));
+    for (int i = 0; i < count; i++) {
+        vec3 c(4.0f * rng.next() - 2.0f, 4.0f * rng.next() - 2.0f, -4.0f * rng.next() - 3.0f);
+        scene.triangles.push_back({c + size * (sample_unit_ball(rng)), c + size * (sample_unit_ball(rng)),
+                                   c + size * (sample_unit_ball(rng))});
+    }
+}
+
+// Columns of unit cubes over a rolling height function, only the top cube of each column
+void make_cube_voxels(Scene& scene, Rng& rng) {
+    add_default_lights(scene);
+    Material grass, rock;
+    grass.albedo = vec3(0.35, 0.55, 0.25);
+    rock.albedo = vec3(0.5, 0.45, 0.4);
+    MaterialId grass_id = scene.materials.add(grass), rock_id = scene.materials.add(rock);
+    for (int z = 0; z < 24; z++) {
+        for (int x = 0; x < 24; x++) {
+            float h = floorf(2.0f + 1.5f * sinf(0.4f * x) * cosf(0.3f * z) + rng.next());
+            scene.cubes.push_back({vec3(x - 12.0f + 0.5f, h + 0.5f, -z - 2.5f), 1.0f});
+            scene.material_ids[PRIM_CUBE].push_back(h > 2.0f ? rock_id : grass_id);
+        }
+    }
+}
+
+// A dense bumpy mesh with levels of detail resting on a ground plane
+void make_plane_mesh(Scene& scene, Rng&) {
+    add_default_lights(scene);
+    scene.planes = {{vec3(0, 0, 0), vec3(0, 1, 0)}};
+    vector<Triangle> triangles;
+    make_bumpy_sphere(vec3(0, 1.1f, -4), 1.0f, 384, triangles);
+    scene.meshes.emplace_back();
+    build_mesh_lod(scene.meshes[0], triangles);
+    Material glossy;
+    glossy.type = MAT_GLOSSY;
+    glossy.albedo = vec3(0.8, 0.6, 0.4);
+    glossy.roughness = 0.2f;
+    scene.material_ids[PRIM_MESH] = {scene.materials.add(glossy)};
+}
+
+// A few objects lit by 64 colored lights scattered above them, each shading point sends 64 shadow rays
+void make_many_lights(Scene& scene, Rng& rng) {
+    scene.planes = {{vec3(0, 0, 0), vec3(0, 1, 0)}};
+    for (int i = 0; i < 64; i++) {
+        vec3 p(10.0f * rng.next() - 5.0f, 1.0f + 3.0f * rng.next(), -10.0f * rng.next() - 1.0f);
+        vec3 color(rng.next(), rng.next(), rng.next());
+        scene.lights.push_back({p, 0.05f * color});
+    }
+    for (int i = 0; i < 8; i++) {
+        scene.spheres.push_back({vec3(-3.5f + i, 0.4f, -4.0f - 0.5f * (i % 3)), 0.4f});
+        scene.cubes.push_back({vec3(-3.0f + i, 0.3f, -6.5f + 0.5f * (i % 2)), 0.6f});
+    }
+}
+
+size_t mesh_memory_bytes(const MeshLOD& mesh) {
+    size_t bytes = 0;
+    for (size_t l = 0; l < mesh.levels.size(); l++) {
+        bytes += mesh.levels[l].size() * sizeof(Triangle) + bvh_memory_bytes(mesh.bvhs[l]);
+    }
+    return bytes;
+}
+
+// Bytes of the primitives and acceleration structures, textures and materials left out
+size_t scene_memory_bytes(const Scene& scene) {
+    size_t bytes = scene.lights.size() * sizeof(Light) + scene.spheres.size() * sizeof(Sphere) +
+                   scene.triangles.size() * sizeof(Triangle) + scene.cubes.size() * sizeof(Cube) +
+                   scene.planes.size() * sizeof(Plane) + bvh_memory_bytes(scene.triangle_bvh);
+    for (const MeshLOD& mesh : scene.meshes) bytes += mesh_memory_bytes(mesh);
+    for (const auto& ids : scene.material_ids) bytes += ids.size() * sizeof(MaterialId);
+    return bytes;
+}
+
+size_t primitive_count(const Scene& scene) {
+    size_t count = scene.spheres.size() + scene.triangles.size() + scene.cubes.size() + scene.planes.size();
+    for (const MeshLOD& mesh : scene.meshes) count += mesh.levels.empty() ? 0 : mesh.levels[0].size();
+    return count;
+}
+
+BenchCase make_case(const string& name, void (*make)(Scene&, Rng&), const Camera& camera) {
+    BenchCase bc;
+    bc.name = name;
+    bc.camera = camera;
+    auto start = chrono::steady_clock::now();
+    Rng rng(42);
+    make(bc.scene, rng);
+    build_scene_bvh(bc.scene);
+    bc.build_seconds = seconds_since(start);
+    return bc;
+}
+
+// Camera rays through random points of every pixel, nearest hits on one thread, best of three
+double camera_mrays(const Scene& scene, const Camera& camera, double& hit_rate) {
+    vector<ray> rays;
+    Rng rng(5);
+    for (int j = 0; j < camera.height; j++) {
+        for (int i = 0; i < camera.width; i++) {
+            rays.push_back(camera.get_ray((i + rng.next()) / camera.width, (j + rng.next()) / camera.height));
+        }
+    }
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        int hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (const ray& r : rays) {
+            HitRecord rec;
+            hits += intersect_scene(scene, r, rec);
+        }
+        best = min(best, seconds_since(start));
+        hit_rate = double(hits) / rays.size();
+    }
+    return rays.size() / best * 1e-6;
+}
+
+BenchResult run_case(const BenchCase& bc, int spp, const string& heatmap_dir) {
+    BenchResult res;
+    res.name = bc.name;
+    res.primitives = primitive_count(bc.scene);
+    res.lights = bc.scene.lights.size();
+    res.memory_bytes = scene_memory_bytes(bc.scene);
+    res.build_ms = bc.build_seconds * 1000;
+    res.camera_mrays = camera_mrays(bc.scene, bc.camera, res.camera_hit_rate);
+
+    TraceSettings settings;
+    settings.samples_per_pixel = spp;
+    Framebuffer fb(bc.camera.width, bc.camera.height);
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        auto start = chrono::steady_clock::now();
+        RayCounters counters = render_recursive(bc.scene, bc.camera, settings, fb);
+        best = min(best, seconds_since(start));
+        res.frame_rays = counters.rays + counters.shadow_rays;
+    }
+    res.frame_ms = best * 1000;
+    res.frame_mrays = res.frame_rays / best * 1e-6;
+    if (!heatmap_dir.empty() && !write_ppm(fb, heatmap_dir + "/" + bc.name + ".ppm")) {
+        cerr << "Could not write " << heatmap_dir << "/" << bc.name << ".ppm\n";
+    }
+    return res;
+}
+
+// Traversal cost of the scene's primary rays, summarized on stderr and written next to its frame
+void write_heatmap(const BenchCase& bc, const string& heatmap_dir) {
+    TraversalHeatmap heatmap;
+    render_heatmap(bc.scene, bc.camera, heatmap);
+    HeatmapSummary summary = summarize_heatmap(heatmap);
+    cerr << "\n" << bc.name << " ";
+    print_heatmap_summary(cerr, summary);
+    string path = heatmap_dir + "/" + bc.name + "_heatmap.ppm";
+    if (!write_heatmap_ppm(heatmap, summary, path)) cerr << "Could not write " << path << "\n";
+}
+
+string to_json(const vector<BenchResult>& results, int width, int height, int spp) {
+    ostringstream os;
+    os << "{\n  \"width\": " << width << ",\n  \"height\": " << height << ",\n  \"samples_per_pixel\": " << spp
+       << ",\n  \"threads\": " << worker_count() << ",\n  \"scenes\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        char line[512];
+        snprintf(line, sizeof(line),
+                 "    {\"name\": \"%s\", \"primitives\": %zu, \"lights\": %zu, \"memory_bytes\": %zu, "
+                 "\"build_ms\": %.3f, \"camera_mrays\": %.4f, \"camera_hit_rate\": %.4f, \"frame_ms\": %.3f, \"frame_rays\": %llu, "
+                 "\"frame_mrays\": %.4f}%s\n",
+                 r.name.c_str(), r.primitives, r.lights, r.memory_bytes, r.build_ms, r.camera_mrays, r.camera_hit_rate, r.frame_ms,
+                 (unsigned long long)r.frame_rays, r.frame_mrays, i + 1 < results.size() ? "," : "");
+        os << line;
+    }
+    os << "  ]\n}\n";
+    return os.str();
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 320;
+    int height = argc > 2 ? atoi(argv[2]) : 180;
+    int spp = argc > 3 ? atoi(argv[3]) : 4;
+    string output = argc > 4 ? argv[4] : "";
+    string heatmap_dir = argc > 5 ? argv[5] : "";
+
+    Camera ground = look_at_camera(vec3(0, 3, 3), vec3(0, 0.5f, -8), vec3(0, 1, 0), 50.0f, width, height);
+    Camera front = look_at_camera(vec3(0, 0, 3), vec3(0, 0, -5), vec3(0, 1, 0), 50.0f, width, height);
+    Camera voxels = look_at_camera(vec3(0, 9, 6), vec3(0, 2, -14), vec3(0, 1, 0), 55.0f, width, height);
+    Camera close = look_at_camera(vec3(0, 1.5f, 0), vec3(0, 1, -4), vec3(0, 1, 0), 45.0f, width, height);
+
+    vector<BenchCase> cases;
+    cases.push_back(make_case("sphere_field", make_sphere_field, ground));
+    cases.push_back(make_case("triangle_soup", make_triangle_soup, front));
+    cases.push_back(make_case("cube_voxels", make_cube_voxels, voxels));
+    cases.push_back(make_case("plane_mesh", make_plane_mesh, close));
+    cases.push_back(make_case("many_lights", make_many_lights, ground));
+
+    fprintf(stderr, "%dx%d, %d spp, %d threads\n", width, height, spp, worker_count());
+    fprintf(stderr, "%-14s %10s %10s %10s %12s %10s %12s\n", "scene", "prims", "MB", "build ms", "camera Mr/s",
+            "frame ms", "frame Mr/s");
+    vector<BenchResult> results;
+    for (const BenchCase& bc : cases) {
+        BenchResult r = run_case(bc, spp, heatmap_dir);
+        fprintf(stderr, "%-14s %10zu %10.2f %10.1f %12.2f %10.1f %12.2f\n", r.name.c_str(), r.primitives,
+                r.memory_bytes / 1048576.0, r.build_ms, r.camera_mrays, r.frame_ms, r.frame_mrays);
+        results.push_back(r);
+    }
+    if (!heatmap_dir.empty()) {
+        for (const BenchCase& bc : cases) write_heatmap(bc, heatmap_dir);
+    }
+
+    string json = to_json(results, width, height, spp);
+    if (output.empty()) {
+        cout << json;
+    } else {
+        ofstream file(output);
+        file << json;
+        if (!file) {
+            cerr << "Could not write " << output << "\n";
+            return 1;
+        }
+    }
+    return 0;
+}
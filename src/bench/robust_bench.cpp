@@ -0,0 +1,212 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "vec3.h"
+#include "Triangle.h"
+#include "BVH.h"
+#include "Scene.h"
+#include "MeshLOD.h"
+#include "SDF.h"
+#include "Random.h"
+#include "Material.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Checks the watertight triangle test and the error bounded ray offsets:
+// - speed of Moller-Trumbore and the watertight test through a triangle BVH,
+// - rays from inside a closed mesh aimed at its vertices and edges, which must all hit,
+// - secondary rays leaving hits on every kind of primitive near the origin, far from it and at a small scale, with
+//   the old fixed epsilon, with no offset and with the error bounds: rays leaving a convex surface must not hit it
+//   again, rays entering a closed one must find its far side.
+// Usage: robust_bench [rays]
+
+vec3 random_unit(Rng& rng) {
+    vec3 v = sample_unit_ball(rng);
+    float len = v.length();
+    return len > 1e-3f ? v / len : vec3(0, 1, 0);
+}
+
+// Nearest hit through a triangle BVH with either triangle test
+template <bool Watertight>
+bool hit_triangles(const BVH& bvh, const vector<Triangle>& triangles, const ray& r, float& t) {
+    RayShear shear = make_ray_shear(r.D);
+    float t_max = FLT_MAX;
+    bool hit = traverse_bvh(bvh, r, t_max, [&](int prim, float& t_closest) {
+        float t_tri;
+        vec3 N;
+        bool h = Watertight ? hit_triangle_watertight(triangles[prim], r, shear, t_closest, t_tri)
+                            : hit_triangle(triangles[prim], r, t_tri, N);
+        if (h && t_tri < t_closest) {
+            t_closest = t_tri;
+            return true;
+        }
+        return false;
+    });
+    t = t_max;
+    return hit;
+}
+
+template <bool Watertight>
+double triangle_mrays(const BVH& bvh, const vector<Triangle>& triangles, const vector<ray>& rays, int& hits) {
+    double best = 1e30;
+    for (int run = 0; run < 3; run++) {
+        hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (const ray& r : rays) {
+            float t;
+            hits += hit_triangles<Watertight>(bvh, triangles, r, t);
+        }
+        best = min(best, seconds_since(start));
+    }
+    return rays.size() / best * 1e-6;
+}
+
+// Ways of starting a secondary ray at a hit
+enum OffsetScheme {
+    OFFSET_EPSILON,       // From the computed point, hits before 1e-4 skipped (the old SCENE_EPSILON)
+    OFFSET_NONE,          // From the computed point, any hit beyond 0
+    OFFSET_ERROR_BOUNDS   // From offset_ray_origin
+};
+
+ray secondary_ray(const ray& r, const HitRecord& rec, const vec3& dir, OffsetScheme scheme) {
+    vec3 p = r.point_at_parameter(rec.t);
+    if (scheme == OFFSET_EPSILON) return ray(p + 1e-4f * dir, dir);
+    if (scheme == OFFSET_NONE) return ray(p, dir);
+    return spawn_ray(rec, dir);
+}
+
+// Scene of one primitive of the given kind around center, size across
+Scene make_single_scene(int kind, const vec3& center, float size) {
+    Scene scene;
+    if (kind == PRIM_SPHERE) {
+        scene.spheres.push_back({center, 0.5f * size});
+    } else if (kind == PRIM_CUBE) {
+        scene.cubes.push_back({center, size});
+    } else if (kind == PRIM_PLANE) {
+        scene.planes.push_back({center, unit_vector(vec3(0.2f, 1.0f, 0.1f))});
+    } else if (kind == PRIM_TRIANGLE) {
+        scene.triangles.push_back({center + size * vec3(-2, 0.3f, -2), center + size * vec3(0, -0.2f, 2.5f),
+                                   center + size * vec3(2.5f, 0.1f, -1.5f)});
+    } else if (kind == PRIM_MESH) {
+        vector<Triangle> triangles;
+        make_sphere_mesh(center, 0.5f * size, 64, triangles);
+        scene.meshes.emplace_back();
+        build_mesh_lod(scene.meshes[0], triangles, 1);
+    } else if (kind == PRIM_SDF) {
+        SDFObject obj;
+        add_sdf_rounded_box(obj, center, vec3(0.3f, 0.3f, 0.3f) * size, 0.15f * size);
+        scene.sdfs.push_back(obj);
+    }
+    build_scene_bvh(scene);
+    return scene;
+}
+
+struct OffsetResult {
+    int hits = 0;          // Primary rays that hit
+    int self_hits = 0;     // Rays leaving the surface that hit it again
+    int entering = 0;      // Rays into a closed primitive
+    int missed_exits = 0;  // Of those, the ones that missed its far side
+};
+
+OffsetResult test_offsets(int kind, const vec3& center, float size, OffsetScheme scheme, int count) {
+    Scene scene = make_single_scene(kind, center, size);
+    bool closed = kind != PRIM_PLANE && kind != PRIM_TRIANGLE;
+    Rng rng(7);
+    OffsetResult res;
+    for (int i = 0; i < count; i++) {
+        vec3 from = center + 3.0f * size * random_unit(rng);
+        if (!closed && dot(from - center, vec3(0, 1, 0)) < 0.0f) from = 2.0f * center - from;
+        vec3 to = center + 0.9f * size * sample_unit_ball(rng);
+        ray r(from, to - from);
+        HitRecord rec;
+        if (!intersect_scene(scene, r, rec)) continue;
+        res.hits++;
+        bool front_face = dot(rec.N, r.direction()) < 0;
+        vec3 N = unit_vector(front_face ? rec.N : -rec.N);
+
+        HitRecord next;
+        vec3 out = sample_cosine_hemisphere(N, rng.next(), rng.next());
+        if (intersect_scene(scene, secondary_ray(r, rec, out, scheme), next)) res.self_hits++;
+        if (closed && front_face) {
+            res.entering++;
+            vec3 in = sample_cosine_hemisphere(-N, rng.next(), rng.next());
+            if (!intersect_scene(scene, secondary_ray(r, rec, in, scheme), next)) res.missed_exits++;
+        }
+    }
+    return res;
+}
+
+int main(int argc, char** argv) {
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+
+    // Speed through a dense mesh, rays from around it to points inside
+    vector<Triangle> dense;
+    make_sphere_mesh(vec3(0, 0, 0), 1.0f, 512, dense);
+    BVH dense_bvh;
+    build_triangle_bvh(dense_bvh, dense);
+    Rng rng(3);
+    vector<ray> rays;
+    for (int i = 0; i < 10 * count; i++) {
+        vec3 from = 3.0f * random_unit(rng);
+        rays.push_back(ray(from, 1.2f * sample_unit_ball(rng) - from));
+    }
+    int hits_mt, hits_wt;
+    double mt = triangle_mrays<false>(dense_bvh, dense, rays, hits_mt);
+    double wt = triangle_mrays<true>(dense_bvh, dense, rays, hits_wt);
+    printf("%zu triangles, %zu rays, best of 3 (1 thread):\n", dense.size(), rays.size());
+    printf("  Moller-Trumbore: %6.2f Mrays/s, %d hits\n", mt, hits_mt);
+    printf("  watertight:      %6.2f Mrays/s, %d hits\n", wt, hits_wt);
+
+    // Rays from inside a closed mesh at its vertices and edge midpoints
+    vector<Triangle> closed;
+    make_sphere_mesh(vec3(0.3f, -0.2f, 0.1f), 1.0f, 48, closed);
+    BVH closed_bvh;
+    build_triangle_bvh(closed_bvh, closed);
+    int aimed = 0, leaks_mt = 0, leaks_wt = 0;
+    for (int k = 0; k < 16; k++) {
+        vec3 from = vec3(0.3f, -0.2f, 0.1f) + 0.5f * sample_unit_ball(rng);
+        for (const Triangle& tri : closed) {
+            const vec3 targets[6] = {tri.v0, tri.v1, tri.v2, 0.5f * (tri.v0 + tri.v1), 0.5f * (tri.v1 + tri.v2),
+                                     0.5f * (tri.v2 + tri.v0)};
+            for (const vec3& target : targets) {
+                ray r(from, target - from);
+                float t;
+                aimed++;
+                leaks_mt += !hit_triangles<false>(closed_bvh, closed, r, t);
+                leaks_wt += !hit_triangles<true>(closed_bvh, closed, r, t);
+            }
+        }
+    }
+    printf("%d rays from inside a closed mesh of %zu triangles at its vertices and edges:\n", aimed, closed.size());
+    printf("  Moller-Trumbore: %d leaks\n  watertight:      %d leaks\n", leaks_mt, leaks_wt);
+
+    // Secondary rays at three placements
+    struct Placement { const char* name; vec3 center; float size; };
+    const Placement placements[] = {
+        {"size 1 at the origin", vec3(0.3f, 0.2f, -0.1f), 1.0f},
+        {"size 1 at 10^4", vec3(1e4f, 5e3f, -1e4f), 1.0f},
+        {"size 10^-3 at the origin", vec3(3e-4f, 2e-4f, -1e-4f), 1e-3f}
+    };
+    struct Kind { const char* name; int kind; };
+    const Kind kinds[] = {{"sphere", PRIM_SPHERE}, {"cube", PRIM_CUBE}, {"plane", PRIM_PLANE},
+                          {"triangle", PRIM_TRIANGLE}, {"mesh", PRIM_MESH}, {"sdf", PRIM_SDF}};
+    const char* schemes[] = {"epsilon 1e-4", "no offset", "error bounds"};
+    printf("%d primary rays per primitive, secondary rays that hit the surface again / missed exits:\n", count);
+    for (const Placement& pl : placements) {
+        printf("  %s\n", pl.name);
+        for (const Kind& k : kinds) {
+            printf("    %-9s", k.name);
+            for (int s = 0; s < 3; s++) {
+                OffsetResult res = test_offsets(k.kind, pl.center, pl.size, OffsetScheme(s), count);
+                printf("  %s: %5d / %5d", schemes[s], res.self_hits, res.missed_exits);
+            }
+            printf("\n");
+        }
+    }
+    return 0;
+}
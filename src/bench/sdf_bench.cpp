@@ -0,0 +1,194 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include "vec3.h"
+#include "Scene.h"
+#include "SDF.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Trace.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Traces a field of SDF objects (rounded boxes, tori and smooth-union blobs) with one camera ray per pixel and
+// compares marching without bounds, inside each object's bounds, through the BVH over the bounds, and with
+// over-relaxation: distance evaluations per ray, ray throughput and hits. Then renders the scene, a glass blob
+// included, and optionally writes it.
+// Usage: sdf_bench [width] [height] [output prefix for PPMs]
+
+Scene make_sdf_scene() {
+    Scene scene;
+    scene.lights = {
+        {vec3(-4, 6, 3), vec3(0.9, 0.85, 0.8)},
+        {vec3(5, 4, -6), vec3(0.4, 0.45, 0.6)}
+    };
+    scene.planes = {{vec3(0, -0.6, 0), vec3(0, 1, 0)}};
+
+    Material colors[3];
+    colors[0].albedo = vec3(0.8, 0.35, 0.25);
+    colors[1].albedo = vec3(0.3, 0.6, 0.8);
+    colors[2].type = MAT_GLOSSY;
+    colors[2].albedo = vec3(0.85, 0.75, 0.4);
+    colors[2].roughness = 0.15f;
+    MaterialId ids[3];
+    for (int i = 0; i < 3; i++) ids[i] = scene.materials.add(colors[i]);
+    Material glass;
+    glass.type = MAT_DIELECTRIC;
+    glass.albedo = vec3(1, 1, 1);
+    MaterialId glass_id = scene.materials.add(glass);
+
+    // A 5 x 4 field, rows receding from the camera
+    for (int row = 0; row < 4; row++) {
+        for (int col = 0; col < 5; col++) {
+            vec3 c(-4.0f + 2.0f * col, 0.0f, -2.0f - 2.5f * row);
+            SDFObject obj;
+            int shape = (row + col) % 3;
+            if (shape == 0) {
+                add_sdf_rounded_box(obj, c, vec3(0.35, 0.35, 0.35), 0.15f);
+            } else if (shape == 1) {
+                add_sdf_torus(obj, c, 0.45f, 0.15f);
+            } else {
+                add_sdf_sphere(obj, c + vec3(0, 0.1, 0), 0.35f);
+                add_sdf_torus(obj, c - vec3(0, 0.2, 0), 0.5f, 0.12f);
+                add_sdf_smooth_union(obj, 0.3f);
+                add_sdf_rounded_box(obj, c + vec3(0, 0.45, 0), vec3(0.12, 0.12, 0.12), 0.05f);
+                add_sdf_smooth_union(obj, 0.2f);
+            }
+            scene.sdfs.push_back(obj);
+            bool is_glass = row == 0 && col == 2;
+            scene.material_ids[PRIM_SDF].push_back(is_glass ? glass_id : ids[shape]);
+        }
+    }
+    build_scene_bvh(scene);
+    return scene;
+}
+
+// Ways of finding the nearest SDF hit of a ray
+enum MarchMode {
+    MARCH_UNBOUNDED,  // Every object, from the ray origin to the nearest hit so far
+    MARCH_BOUNDS,     // Every object, only inside its bounds
+    MARCH_BVH         // The objects whose bounds the BVH reaches, inside their bounds
+};
+
+struct MarchResult {
+    double evaluations_per_ray;
+    double evaluations_per_marched_ray;  // Over the rays that evaluated any distance
+    double mrays_per_second;
+    int hits;
+    float max_t_error;  // Largest difference to the reference hit distances, relative
+};
+
+MarchResult march_all(const Scene& scene, const CameraRays& rays, MarchMode mode, float relaxation,
+                      vector<float>& t_hits, const vector<float>* reference) {
+    const float far = 1000.0f;
+    long long evaluations = 0;
+    int hits = 0, marched = 0;
+    t_hits.assign(rays.size, FLT_MAX);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < rays.size; i++) {
+        ray r = rays.get(i);
+        float t_closest = far;
+        int steps = 0;
+        vec3 N;
+        if (mode == MARCH_BVH) {
+            traverse_bvh(scene.sdf_bvh, r, t_closest, [&](int prim, float& t_max) {
+                float t = t_max;
+                if (!intersect_sdf(scene.sdfs[prim], r, 0.0f, t, N, &steps, relaxation)) return false;
+                t_max = t;
+                return true;
+            });
+        } else {
+            for (const SDFObject& obj : scene.sdfs) {
+                float t = t_closest;
+                bool hit = mode == MARCH_BOUNDS ? intersect_sdf(obj, r, 0.0f, t, N, &steps, relaxation)
+                                                : sphere_trace(obj, r, 0.0f, t_closest, false, t, &steps, relaxation);
+                if (hit) t_closest = t;
+            }
+        }
+        evaluations += steps;
+        marched += steps > 0;
+        if (t_closest < far) {
+            hits++;
+            t_hits[i] = t_closest;
+        }
+    }
+    double seconds = seconds_since(start);
+
+    MarchResult result;
+    result.evaluations_per_ray = double(evaluations) / rays.size;
+    result.evaluations_per_marched_ray = marched ? double(evaluations) / marched : 0.0;
+    result.mrays_per_second = rays.size / seconds * 1e-6;
+    result.hits = hits;
+    result.max_t_error = 0.0f;
+    if (reference) {
+        for (int i = 0; i < rays.size; i++) {
+            float a = t_hits[i], b = (*reference)[i];
+            if (a == FLT_MAX || b == FLT_MAX) continue;
+            float e = fabsf(a - b) / b;
+            result.max_t_error = e > result.max_t_error ? e : result.max_t_error;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 400;
+    int height = argc > 2 ? atoi(argv[2]) : 200;
+    string prefix = argc > 3 ? argv[3] : "";
+
+    Scene scene = make_sdf_scene();
+    Camera camera = look_at_camera(vec3(0, 1.6, 3), vec3(0, -0.2, -5), vec3(0, 1, 0), 55.0f, width, height);
+    cout << width << "x" << height << ", " << scene.sdfs.size() << " SDF objects, " << worker_count() << " threads\n";
+
+    // One camera ray per pixel center
+    CameraRays rays;
+    rays.resize(width * height);
+    for (int j = 0; j < height; j++) {
+        for (int i = 0; i < width; i++) {
+            rays.s[j * width + i] = (i + 0.5f) / float(width);
+            rays.t[j * width + i] = (j + 0.5f) / float(height);
+        }
+    }
+    Rng rng(1);
+    camera.generate(rays, 0, rays.size, rng);
+
+    struct Config { const char* name; MarchMode mode; float relaxation; };
+    const Config configs[] = {
+        {"no bounds", MARCH_UNBOUNDED, 1.0f},
+        {"bounds", MARCH_BOUNDS, 1.0f},
+        {"bounds + BVH", MARCH_BVH, 1.0f},
+        {"bounds + BVH, relaxed 1.2", MARCH_BVH, 1.2f},
+        {"bounds + BVH, relaxed 1.6", MARCH_BVH, 1.6f},
+        {"no bounds, relaxed 1.2", MARCH_UNBOUNDED, 1.2f},
+        {"no bounds, relaxed 1.6", MARCH_UNBOUNDED, 1.6f}
+    };
+    vector<float> reference, t_hits;
+    for (const Config& c : configs) {
+        MarchResult res = march_all(scene, rays, c.mode, c.relaxation, reference.empty() ? reference : t_hits,
+                                    reference.empty() ? nullptr : &reference);
+        printf("%-26s: %7.2f evaluations/ray, %7.2f per marched ray, %6.2f Mrays/s (1 thread), %d hits, "
+               "max relative t difference %.2g\n", c.name, res.evaluations_per_ray, res.evaluations_per_marched_ray,
+               res.mrays_per_second, res.hits, res.max_t_error);
+    }
+
+    TraceSettings settings;
+    settings.samples_per_pixel = 4;
+    Framebuffer fb(width, height);
+    auto start = chrono::steady_clock::now();
+    RayCounters counters = render_recursive(scene, camera, settings, fb);
+    double seconds = seconds_since(start);
+    printf("render %d spp: %.1f ms, %llu rays + %llu shadow rays, %.2f Mrays/s\n", settings.samples_per_pixel,
+           seconds * 1000, (unsigned long long)counters.rays, (unsigned long long)counters.shadow_rays,
+           (counters.rays + counters.shadow_rays) / seconds * 1e-6);
+
+    if (!prefix.empty() && !write_ppm(fb, prefix + "sdf.ppm")) {
+        cerr << "Could not write images with prefix " << prefix << "\n";
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include "vec3.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Texture.h"
+#include "Trace.h"
+#include "RayDifferential.h"
+#include "BenchScene.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Renders a textured ground plane and a textured triangle wall through the tile cache at several memory budgets,
+// reporting time, hit rate and I/O, then compares filtering without a footprint, with ray cones and with ray
+// differentials against a supersampled reference.
+// Usage: texture_bench [texture size] [width] [height] [texture file] [output prefix for PPMs]
+
+// Checkerboard with a fine grid and a color gradient, detailed enough to alias without filtering
+void make_test_texture(int size, vector<uint8_t>& rgb) {
+    rgb.resize(size_t(size) * size * 3);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            bool check = ((x / 64) + (y / 64)) % 2 == 0;
+            bool line = x % 16 == 0 || y % 16 == 0;
+            uint8_t* c = &rgb[(size_t(y) * size + x) * 3];
+            c[0] = uint8_t(line ? 20 : (check ? 230 : 60));
+            c[1] = uint8_t(line ? 20 : (check ? 200 : 40 + 150 * x / size));
+            c[2] = uint8_t(line ? 20 : (check ? 160 : 40 + 150 * y / size));
+        }
+    }
+}
+
+Scene make_textured_scene(int texture) {
+    Scene scene;
+    scene.lights = {
+        {vec3(-1, 1, 0), vec3(1, 0, 1)},  // Purple light
+        {vec3(2, 1, 0), vec3(1, 1, 0)}    // Yellow light
+    };
+    scene.planes = {{vec3(0, -0.5, -1), vec3(0, 1, 0)}};
+    scene.plane_uvs = {{vec3(0.25, 0, 0), vec3(0, 0, 0.25)}};  // One texture repeat per 4 units
+
+    // A wall of 16 x 8 quads at z = -6, the whole texture spread over it
+    const int nx = 16, ny = 8;
+    for (int y = 0; y < ny; y++) {
+        for (int x = 0; x < nx; x++) {
+            vec3 p(-8 + x, -0.5 + y, -6);
+            float u0 = float(x) / nx, u1 = float(x + 1) / nx, v0 = float(y) / ny, v1 = float(y + 1) / ny;
+            scene.triangles.push_back({p, p + vec3(1, 0, 0), p + vec3(0, 1, 0)});
+            scene.triangle_uvs.push_back({{u0, u1, u0}, {v0, v0, v1}});
+            scene.triangles.push_back({p + vec3(1, 0, 0), p + vec3(1, 1, 0), p + vec3(0, 1, 0)});
+            scene.triangle_uvs.push_back({{u1, u1, u0}, {v0, v1, v1}});
+        }
+    }
+
+    // A mirror and a glass sphere show the texture through reflection and refraction
+    scene.spheres = {{vec3(-0.9, 0.1, -2.2), 0.6}, {vec3(0.9, 0.1, -2.2), 0.6}};
+
+    Material textured;
+    textured.texture = texture;
+    MaterialId id = scene.materials.add(textured);
+    Material mirror;
+    mirror.type = MAT_MIRROR;
+    mirror.albedo = vec3(0.9, 0.9, 0.9);
+    Material glass;
+    glass.type = MAT_DIELECTRIC;
+    glass.albedo = vec3(1, 1, 1);
+    scene.material_ids[PRIM_PLANE] = {id};
+    scene.material_ids[PRIM_TRIANGLE].assign(scene.triangles.size(), id);
+    scene.material_ids[PRIM_SPHERE] = {scene.materials.add(mirror), scene.materials.add(glass)};
+    build_scene_bvh(scene);
+    return scene;
+}
+
+// Render a cold and then a warm frame through a fresh cache and print its counters
+bool report_cache(const string& path, size_t budget_mb, bool mipmapping, const Camera& camera,
+                  const TraceSettings& settings, int width, int height) {
+    shared_ptr<TextureCache> cache = make_shared<TextureCache>(budget_mb << 20);
+    cache->mipmapping = mipmapping;
+    int texture = cache->open(path);
+    if (texture < 0) {
+        cerr << "Could not open " << path << "\n";
+        return false;
+    }
+    Scene scene = make_textured_scene(texture);
+    scene.textures = cache;
+
+    for (int frame = 0; frame < 2; frame++) {
+        Framebuffer fb(width, height);
+        cache->reset_stats();
+        auto start = chrono::steady_clock::now();
+        render_recursive(scene, camera, settings, fb);
+        double time = seconds_since(start);
+        TextureCacheStats stats = cache->stats();
+        printf("%s, budget %3zu MB, %s: %7.1f ms, %8llu lookups, hit rate %6.2f%%, read %7.2f MB, %6llu evictions, "
+               "resident %6.2f MB\n",
+               mipmapping ? "trilinear" : "level 0  ", budget_mb, frame == 0 ? "cold" : "warm", time * 1000,
+               (unsigned long long)stats.lookups, 100.0 * stats.hit_rate(), stats.bytes_read / 1048576.0,
+               (unsigned long long)stats.evictions, stats.resident_bytes / 1048576.0);
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    int texture_size = argc > 1 ? atoi(argv[1]) : 4096;
+    int width = argc > 2 ? atoi(argv[2]) : 400;
+    int height = argc > 3 ? atoi(argv[3]) : 200;
+    string path = argc > 4 ? argv[4] : "texture_bench.ttx";
+    string prefix = argc > 5 ? argv[5] : "";
+
+    // The viewport of bonus.cpp
+    Camera camera = viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), width, height);
+
+    {
+        vector<uint8_t> rgb;
+        make_test_texture(texture_size, rgb);
+        if (!write_tiled_texture(path, texture_size, texture_size, rgb)) {
+            cerr << "Could not write " << path << "\n";
+            return 1;
+        }
+    }
+
+    TraceSettings settings;
+    settings.samples_per_pixel = 1;
+    settings.diffuse_bounces = false;
+    cout << width << "x" << height << ", " << texture_size << "^2 texture, " << worker_count() << " threads\n";
+
+    // Trilinear filtering touches coarse levels far away; level 0 lookups show a working set beyond the budget
+    for (bool mipmapping : {true, false}) {
+        for (size_t budget_mb : {1, 4, 16, 64}) {
+            if (!report_cache(path, budget_mb, mipmapping, camera, settings, width, height)) return 1;
+        }
+    }
+
+    // Filtering quality: 1 spp with each footprint type against 64 spp at level 0
+    shared_ptr<TextureCache> cache = make_shared<TextureCache>(size_t(256) << 20);
+    Scene scene = make_textured_scene(cache->open(path));
+    scene.textures = cache;
+    Framebuffer reference(width, height), fb(width, height);
+    cache->mipmapping = false;
+    settings.samples_per_pixel = 64;
+    render_recursive<NoFootprint>(scene, camera, settings, reference);
+    settings.samples_per_pixel = 1;
+    settings.seed = 1;
+    cache->mipmapping = true;
+    const char* names[3] = {"none", "ray cone", "ray differentials"};
+    for (int f = 0; f < 3; f++) {
+        double best = 1e30;
+        for (int run = 0; run < 3; run++) {
+            auto start = chrono::steady_clock::now();
+            if (f == 0) render_recursive<NoFootprint>(scene, camera, settings, fb);
+            if (f == 1) render_recursive<RayCone>(scene, camera, settings, fb);
+            if (f == 2) render_recursive<RayDifferential>(scene, camera, settings, fb);
+            double t = seconds_since(start);
+            best = t < best ? t : best;
+        }
+        printf("1 spp, footprint %-17s: %6.1f ms, RMSE against 64 spp %.4f\n", names[f], best * 1000, rmse(fb, reference));
+        if (!prefix.empty() && !write_ppm(fb, prefix + to_string(f) + ".ppm")) {
+            cerr << "Could not write images with prefix " << prefix << "\n";
+            return 1;
+        }
+    }
+    remove(path.c_str());
+    return 0;
+}
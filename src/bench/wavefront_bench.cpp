@@ -0,0 +1,119 @@
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <cstdlib>
+#include <cmath>
+#include "vec3.h"
+#include "Scene.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Trace.h"
+#include "Wavefront.h"
+#include "BenchUtil.h"
+using namespace std;
+
+// Compares the per-pixel recursive renderer with the wavefront renderer at increasing bounce counts.
+// Usage: wavefront_bench [width] [height] [samples per pixel]
+
+// The scene from bonus.cpp with a glass sphere, plus a field of spheres and cubes so secondary rays have
+// something to hit
+Scene make_bench_scene() {
+    Scene scene;
+    scene.lights = {
+        {vec3(-1, 1, 0), vec3(1, 0, 1)}, // Purple light
+        {vec3(2, 1, 0), vec3(1, 1, 0)}   // Yellow light
+    };
+    scene.spheres = {{vec3(0, 0, -1), 0.3}};
+    scene.triangles = {{vec3(0.5, -0.25, -1), vec3(1.5, -0.25, -1), vec3(1, 0.25, -1)}};
+    scene.cubes = {{vec3(-1, 0, -1.25), 0.5}};
+    scene.planes = {{vec3(0, -0.5, -1), vec3(0, 1, 0)}};
+
+    // Spheres in every material and diffuse cubes
+    Material diffuse;
+    diffuse.albedo = vec3(0.5, 0.5, 0.5);
+    Material mirror;
+    mirror.type = MAT_MIRROR;
+    mirror.albedo = vec3(0.9, 0.9, 0.9);
+    Material glossy;
+    glossy.type = MAT_GLOSSY;
+    glossy.albedo = vec3(0.8, 0.6, 0.4);
+    glossy.roughness = 0.3f;
+    Material glass;
+    glass.type = MAT_DIELECTRIC;
+    MaterialId diffuse_id = scene.materials.add(diffuse);
+    MaterialId glass_id = scene.materials.add(glass);
+    const MaterialId sphere_ids[4] = {diffuse_id, scene.materials.add(mirror), scene.materials.add(glossy), glass_id};
+
+    scene.material_ids[PRIM_SPHERE] = {glass_id};
+    scene.material_ids[PRIM_CUBE] = {diffuse_id};
+    scene.material_ids[PRIM_PLANE] = {diffuse_id};
+    srand48(7);
+    for (int i = 0; i < 40; i++) {
+        vec3 c(-3 + 6 * drand48(), -0.5 + 0.1 + 0.2 * drand48(), -1.5 - 3 * drand48());
+        if (i % 2) {
+            scene.spheres.push_back({c, float(0.1 + 0.15 * drand48())});
+            scene.material_ids[PRIM_SPHERE].push_back(sphere_ids[(i / 2) % 4]);
+        } else {
+            scene.cubes.push_back({c, float(0.15 + 0.2 * drand48())});
+            scene.material_ids[PRIM_CUBE].push_back(diffuse_id);
+        }
+    }
+    // A tessellated back wall for the BVH
+    for (int y = 0; y < 20; y++) {
+        for (int x = 0; x < 60; x++) {
+            vec3 p(-3 + 0.1f * x, -0.5 + 0.1f * y, -5);
+            scene.triangles.push_back({p, p + vec3(0.1, 0, 0), p + vec3(0, 0.1, 0)});
+            scene.triangles.push_back({p + vec3(0.1, 0, 0), p + vec3(0.1, 0.1, 0), p + vec3(0, 0.1, 0)});
+        }
+    }
+    build_scene_bvh(scene);
+    return scene;
+}
+
+// Mean absolute difference between two images, to check both renderers estimate the same thing
+float mean_difference(const Framebuffer& a, const Framebuffer& b) {
+    double sum = 0;
+    for (size_t i = 0; i < a.pixels.size(); i++) {
+        vec3 d = a.pixels[i] - b.pixels[i];
+        sum += fabs(d.x()) + fabs(d.y()) + fabs(d.z());
+    }
+    return float(sum / (3.0 * a.pixels.size()));
+}
+
+int main(int argc, char** argv) {
+    int width = argc > 1 ? atoi(argv[1]) : 400;
+    int height = argc > 2 ? atoi(argv[2]) : 400;
+    TraceSettings settings;
+    settings.samples_per_pixel = argc > 3 ? atoi(argv[3]) : 4;
+
+    // The viewport of bonus.cpp
+    Camera camera = viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), width, height);
+
+    Scene scene = make_bench_scene();
+    WavefrontState state;
+    cout << width << "x" << height << ", " << settings.samples_per_pixel << " spp, " << worker_count() << " threads\n";
+
+    for (int depth : {1, 2, 4, 8, 16}) {
+        settings.max_depth = depth;
+
+        Framebuffer recursive_fb(width, height);
+        auto start = chrono::steady_clock::now();
+        RayCounters rc = render_recursive(scene, camera, settings, recursive_fb);
+        double recursive_time = seconds_since(start);
+
+        Framebuffer wavefront_fb(width, height);
+        start = chrono::steady_clock::now();
+        RayCounters wc = render_wavefront(scene, camera, settings, wavefront_fb, state);
+        double wavefront_time = seconds_since(start);
+
+        cout << "max depth " << depth << ":\n";
+        cout << "  recursive: " << recursive_time * 1000 << " ms, "
+             << (rc.rays + rc.shadow_rays) / recursive_time * 1e-6 << " Mrays/s\n";
+        cout << "  wavefront: " << wavefront_time * 1000 << " ms, "
+             << (wc.rays + wc.shadow_rays) / wavefront_time * 1e-6 << " Mrays/s\n";
+        cout << "  mean difference: " << mean_difference(recursive_fb, wavefront_fb) << "\n";
+        cout << "  rays per depth (recursive):\n";
+        print_depth_counts(cout, rc);
+    }
+    return 0;
+}
@@ -1,151 +1,109 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <string>
 #include <cfloat> 
+#include <cstring>
 #include "vec3.h"
 #include "ray.h"
 #include "Sphere.h"
 #include "Triangle.h"
 #include "Cube.h"
 #include "Plane.h"
+#include "Scene.h"
+#include "Material.h"
+#include "Random.h"
+#include "Trace.h"
+#include "Camera.h"
+#include "Heatmap.h"
+#include "Profile.h"
 using namespace std;
 
-// Define the Light structure
-struct Light {
-    vec3 position;   // Position of the light source
-    vec3 intensity;  // Intensity of the light source
-};
-
-// Function to compute the color of a ray
-vec3 color(const ray& r, const vector<Light>& lights, const vector<Sphere>& spheres, const vector<Triangle>& triangles, const vector<Cube>& cubes, const vector<Plane>& planes) {
-    vec3 hit_color(0, 0, 0);  // Initialize the hit color to black
-    float t_min = FLT_MAX;    // Initialize the minimum hit distance to the maximum float value
-    vec3 N;                   // Normal at the hit point
-    vec3 hit_point;           // Hit point
-
-    // Check for intersection with spheres
-    for (const auto& sphere : spheres) {
-        float t;
-        if (hit_sphere(sphere, r, t, N) && t < t_min) {
-            t_min = t;
-            hit_point = r.point_at_parameter(t);
-            hit_color = vec3(0, 0, 0);
-            for (const auto& light : lights) {
-                vec3 L = unit_vector(light.position - hit_point);  // Direction to the light source
-                float diffuse = max(dot(N, L), 0.0f);              // Diffuse lighting component
-                hit_color += light.intensity * diffuse;            // Accumulate the light contribution
-            }
-        }
-    }
-
-    // Check for intersection with triangles
-    for (const auto& tri : triangles) {
-        float t;
-        if (hit_triangle(tri, r, t, N) && t < t_min) {
-            t_min = t;
-            hit_point = r.point_at_parameter(t);
-            hit_color = vec3(0, 0, 0);
-            for (const auto& light : lights) {
-                vec3 L = unit_vector(light.position - hit_point);  // Direction to the light source
-                float diffuse = max(dot(N, L), 0.0f);              // Diffuse lighting component
-                hit_color += light.intensity * diffuse;            // Accumulate the light contribution
-            }
-        }
-    }
-
-    // Check for intersection with cubes
-    for (const auto& cube : cubes) {
-        float t;
-        if (hit_cube(cube, r, t, N) && t < t_min) {
-            t_min = t;
-            hit_point = r.point_at_parameter(t);
-            hit_color = vec3(0, 0, 0);
-            for (const auto& light : lights) {
-                vec3 L = unit_vector(light.position - hit_point);  // Direction to the light source
-                float diffuse = max(dot(N, L), 0.0f);              // Diffuse lighting component
-                hit_color += light.intensity * diffuse;            // Accumulate the light contribution
-            }
-        }
-    }
-
-    // Check for intersection with planes
-    for (const auto& plane : planes) {
-        float t;
-        if (hit_plane(plane, r, t, N) && t < t_min) {
-            t_min = t;
-            hit_point = r.point_at_parameter(t);
-            hit_color = vec3(0, 0, 0);
-            for (const auto& light : lights) {
-                vec3 L = unit_vector(light.position - hit_point);  // Direction to the light source
-                float diffuse = max(dot(N, L), 0.0f);              // Diffuse lighting component
-                hit_color += light.intensity * diffuse;            // Accumulate the light contribution
-            }
-        }
-    }
-
-    // If there was an intersection, return the accumulated color
-    if (t_min < FLT_MAX) {
-        return hit_color;
-    }
-
-    // If no intersection, return the background color
-    vec3 unit_direction = unit_vector(r.direction());
-    float t = 0.5 * (unit_direction.y() + 1.0);
-    return (1.0 - t) * vec3(1, 1, 1) + t * vec3(0.5, 0.7, 1.0);
-}
+const string OUTPUT_PATH = "/home/nonohuang/CG/src/ray.ppm";  // The render, the heatmap goes next to it
+const string HEATMAP_PATH = OUTPUT_PATH.substr(0, OUTPUT_PATH.size() - 4) + "_heatmap.ppm";
 
-int main() {
+// With --heatmap the traversal cost of every pixel is also written, as a false color image next to the render
+// (see Heatmap.h)
+int main(int argc, char** argv) {
+    bool heatmap_mode = argc > 1 && strcmp(argv[1], "--heatmap") == 0;
     int width = 800;            // Image width
     int height = 800;           // Image height
     int samples_per_pixel = 4;  // Number of samples per pixel for anti-aliasing
 
     fstream file;
-    file.open("/home/nonohuang/CG/src/ray.ppm", ios::out);  // Open the output file
+    file.open(OUTPUT_PATH, ios::out);  // Open the output file
 
     file << "P3\n" << width << " " << height << "\n255\n";  // Write the PPM header
-    vec3 lower_left_corner(-2, -1, -1);  // Lower left corner of the viewport
-    vec3 horizontal(4, 0, 0);            // Horizontal span of the viewport
-    vec3 vertical(0, 2, 0);              // Vertical span of the viewport
-    vec3 origin(0, 0, 0);                // Camera origin
+    // Viewport from (-2, -1, -1) spanning 4 x 2 units, seen from the origin
+    Camera camera = viewport_camera(vec3(-2, -1, -1), vec3(4, 0, 0), vec3(0, 2, 0), vec3(0, 0, 0), width, height);
+
+    Scene scene;
+    TraceSettings settings;
+    settings.samples_per_pixel = samples_per_pixel;
+    settings.max_depth = 8;               // Cap on reflection/refraction depth
+    settings.diffuse_bounces = false;     // Diffuse surfaces only take direct light
+    Rng rng(1);
+    RayCounters counters;
 
     // Define the lights in the scene
-    vector<Light> lights = {
+    scene.lights = {
         {vec3(-1, 1, 0), vec3(1, 0, 1)}, // Purple light
         {vec3(2, 1, 0), vec3(1, 1, 0)}   // Yellow light
     };
 
     // Define the spheres in the scene
-    vector<Sphere> spheres = {
+    scene.spheres = {
         {vec3(0, 0, -1), 0.3}
     };
 
     // Define the triangles in the scene
-    vector<Triangle> triangles = {
+    scene.triangles = {
         {vec3(0.5, -0.25, -1), vec3(1.5, -0.25, -1), vec3(1, 0.25, -1)}
     };
 
     // Define the cubes in the scene
-    vector<Cube> cubes = {
+    scene.cubes = {
         {vec3(-1, 0, -1.25), 0.5}
     };
 
     // Define the planes in the scene
-    vector<Plane> planes = {
+    scene.planes = {
         {vec3(0, -0.5, -1), vec3(0, 1, 0)}
     };
 
-    // Loop over each pixel in the image
+    // Primitives without an entry in scene.material_ids use material 0, white diffuse
+    {
+        PROFILE_SCOPE("BVH build");
+        build_scene_bvh(scene);
+    }
+
+    // Loop over the rows of the image: generate the camera rays of a row, trace them, write the row
+    vector<ray> row_rays(width * samples_per_pixel);
+    vector<vec3> row_colors(width);
     for (int j = height - 1; j >= 0; j--) {
-        for (int i = 0; i < width; i++) {
-            vec3 col(0, 0, 0);  // Initialize the color to black
+        {
+            PROFILE_SCOPE("camera rays");
             // Perform anti-aliasing by taking multiple samples per pixel
-            for (int s = 0; s < samples_per_pixel; s++) {
-                float u = float(i + drand48()) / float(width);
-                float v = float(j + drand48()) / float(height);
-                ray r(origin, lower_left_corner + (u * horizontal) + (v * vertical) - origin);
-                col += color(r, lights, spheres, triangles, cubes, planes);
+            for (int i = 0; i < width; i++) {
+                for (int s = 0; s < samples_per_pixel; s++) {
+                    float u = float(i + drand48()) / float(width);
+                    float v = float(j + drand48()) / float(height);
+                    row_rays[i * samples_per_pixel + s] = camera.get_ray(u, v);
+                }
             }
-            col /= float(samples_per_pixel);  // Average the color samples
+        }
+        {
+            PROFILE_SCOPE("trace row");
+            for (int i = 0; i < width; i++) {
+                vec3 col(0, 0, 0);  // Initialize the color to black
+                for (int s = 0; s < samples_per_pixel; s++) {
+                    col += trace_path(scene, row_rays[i * samples_per_pixel + s], settings, rng, counters);
+                }
+                row_colors[i] = col / float(samples_per_pixel);  // Average the color samples
+            }
+        }
+        PROFILE_SCOPE("file output");
+        for (const vec3& col : row_colors) {
             file << int(255.99 * col.x()) << " "
                  << int(255.99 * col.y()) << " "
                  << int(255.99 * col.z()) << "\n";  // Write the color to the file
@@ -154,5 +112,25 @@ int main() {
 
     file.close();  // Close the output file
 
+    // Report where the rays went
+    cout << "rays traced: " << counters.rays << "\n";
+    print_depth_counts(cout, counters);
+
+    if (heatmap_mode) {
+        TraversalHeatmap heatmap;
+        render_heatmap(scene, camera, heatmap);
+        HeatmapSummary summary = summarize_heatmap(heatmap);
+        print_heatmap_summary(cout, summary);
+        if (!write_heatmap_ppm(heatmap, summary, HEATMAP_PATH)) {
+            cerr << "Could not write " << HEATMAP_PATH << "\n";
+        }
+    }
+
+#ifdef RT_PROFILE
+    // Stage times and counters, and the timeline for chrome://tracing
+    print_profile(cout);
+    if (!write_chrome_trace("ray_trace.json")) cerr << "Could not write ray_trace.json\n";
+#endif
+
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <algorithm>
+#include "vec3.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "ShadingModes.h"
+#include "bench/BenchUtil.h"
+using namespace std;
+
+// The first homework's programs in one binary: renders the named shading mode of ShadingModes.h, or all of them, to
+// <output directory>/<mode>.ppm and reports the render time (best of three) and ray throughput of each.
+// Usage: hw1 <skybox|dusk|normal|shading|colorful|plane|multiple|all> [output directory] [width height]
+
+void print_usage(const vector<ShadingVariant>& variants) {
+    cerr << "Usage: hw1 <mode|all> [output directory] [width height]\nModes:";
+    for (const ShadingVariant& sv : variants) cerr << " " << sv.name;
+    cerr << "\n";
+}
+
+int main(int argc, char** argv) {
+    vector<ShadingVariant> variants = make_shading_variants();
+    if (argc < 2) {
+        print_usage(variants);
+        return 2;
+    }
+    string mode = argv[1];
+    string output_dir = argc > 2 ? argv[2] : ".";
+    int width = argc > 4 ? atoi(argv[3]) : 0;  // 0 keeps each mode's own size
+    int height = argc > 4 ? atoi(argv[4]) : 0;
+
+    vector<ShadingVariant> selected;
+    if (mode == "all") {
+        selected = variants;
+    } else {
+        ShadingVariant sv;
+        if (!find_shading_variant(variants, mode, sv)) {
+            cerr << "Unknown mode " << mode << "\n";
+            print_usage(variants);
+            return 2;
+        }
+        selected.push_back(sv);
+    }
+
+    printf("%d threads\n", worker_count());
+    int failures = 0;
+    for (const ShadingVariant& sv : selected) {
+        Framebuffer fb(width > 0 ? width : sv.width, height > 0 ? height : sv.height);
+        RayCounters counters;
+        double best = 1e30;
+        for (int run = 0; run < 3; run++) {
+            auto start = chrono::steady_clock::now();
+            counters = render_variant(sv, fb);
+            best = min(best, seconds_since(start));
+        }
+        uint64_t rays = counters.rays + counters.shadow_rays;
+        string path = output_dir + "/" + sv.name + ".ppm";
+        bool written = write_ppm(fb, path);
+        printf("  %-10s %4dx%-4d %8.2f ms %8.2f Mrays/s  %s\n", sv.name.c_str(), fb.width, fb.height, best * 1000,
+               rays / best * 1e-6, written ? path.c_str() : "not written");
+        if (!written) failures++;
+    }
+    return failures ? 1 : 0;
+}
@@ -6,13 +6,14 @@
 class ray {
 public:
     ray() {}
-    ray(const vec3& a, const vec3& b) { O = a; D = b; }
+    ray(const vec3& a, const vec3& b, float ti = 0.0f) { O = a; D = b; time = ti; }
     vec3 origin() const { return O; }
     vec3 direction() const { return D; }
     vec3 point_at_parameter(float t) const { return O + t * D; }
 
     vec3 O;
     vec3 D;
+    float time = 0.0f;  // Within the shutter interval [0, 1], where moving primitives are
 };
 
 #endif
@@ -0,0 +1,312 @@
+#include <iostream>
+#include <vector>
+#include <deque>
+#include <string>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <csignal>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include "vec3.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "RenderService.h"
+#include "bench/BenchUtil.h"
+using namespace std;
+
+// Multi-process rendering of one frame. The coordinator forks worker processes, each of which loads the scene and
+// builds its BVHs itself, so on a NUMA machine every worker's scene sits in the memory of the node it runs on. The
+// frame is a shared memory mapping all processes see: workers write their finished tiles straight into it, and
+// only short lines go over each worker's local socket pair:
+//   coordinator: render ... (the job, as in RenderService.h, once), then tile <index> <x0> <y0> <x1> <y1>
+//   worker:      done <index> <rays> <ms> per finished tile, or error <message> if the scene cannot be loaded
+// Tiles are handed out as workers finish them, a few ahead so no worker waits on the coordinator. A worker that
+// dies has its unfinished tiles put back at the front of the queue and is started again; tiles come out the same
+// whichever worker renders them (see render_tile), so a retried tile simply overwrites what was there. A worker
+// that finishes nothing for TILE_TIMEOUT_SECONDS while it has tiles is taken to be hung and is killed, which puts
+// its tiles back the same way.
+// Usage: render_distributed <workers, 0 for one per core> <output PPM> <scene file> <from x y z> <at x y z>
+//                           <up x y z> <vfov> <width> <height> <spp>
+
+const int TILES_AHEAD = 2;          // Tiles assigned to a worker at a time
+const int MAX_WORKER_RESTARTS = 3;  // Per worker, after that it is left dead
+const int MAX_TILE_ATTEMPTS = 3;    // A tile that brings down this many workers fails the frame
+const double TILE_TIMEOUT_SECONDS = 60;  // Longest a worker may go without finishing one of its tiles
+
+// Function to run a worker process: load the job's scene, then render the tiles it is sent into frame
+int worker_main(int fd, uint8_t* frame) {
+    ServiceClient connection(fd);
+    SocketReader reader(fd);
+    string line, error;
+    RenderJob job;
+    if (!reader.read_line(line) || !parse_job(line, job, error)) return 1;
+    Scene scene;
+    if (!load_scene(job.scene_path, scene, error)) {
+        connection.send_line("error " + error);
+        return 1;
+    }
+    build_scene_bvh(scene);
+    Camera camera = look_at_camera(job.from, job.at, job.up, job.vfov, job.width, job.height);
+    TraceSettings settings;
+    settings.samples_per_pixel = job.spp;
+
+    CameraRays rays;
+    vector<vec3> row;
+    vector<uint8_t> rgb;
+    while (reader.read_line(line)) {
+        istringstream in(line);
+        string command;
+        int index;
+        TileRect tile;
+        if (!(in >> command >> index >> tile.x0 >> tile.y0 >> tile.x1 >> tile.y1) || command != "tile") return 1;
+        auto start = chrono::steady_clock::now();
+        RayCounters counters = render_tile(scene, camera, settings, tile, rays, row, rgb);
+        size_t w = size_t(tile.x1 - tile.x0) * 3;
+        for (int y = tile.y0; y < tile.y1; y++) {
+            memcpy(frame + (size_t(y) * job.width + tile.x0) * 3, &rgb[size_t(y - tile.y0) * w], w);
+        }
+        char done[96];
+        snprintf(done, sizeof(done), "done %d %llu %.3f", index,
+                 (unsigned long long)(counters.rays + counters.shadow_rays), seconds_since(start) * 1000);
+        if (!connection.send_line(done)) return 1;
+    }
+    return 0;
+}
+
+// A worker process as the coordinator sees it
+struct WorkerProcess {
+    pid_t pid = -1;  // -1 when not running
+    shared_ptr<ServiceClient> connection;
+    shared_ptr<SocketReader> reader;
+    deque<int> assigned;  // Tiles sent and not finished yet
+    chrono::steady_clock::time_point progress;  // When the oldest of them became the one it is working on
+    int tiles = 0;
+    uint64_t rays = 0;
+    double busy_ms = 0;
+    int restarts = 0;
+};
+
+// Function to fork worker w and send it the job. Returns false if it cannot be started.
+bool start_worker(vector<WorkerProcess>& workers, int w, const string& job_line, uint8_t* frame) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) return false;
+    fflush(stdout);
+    fflush(stderr);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+    if (pid == 0) {
+        close(fds[0]);
+        for (const WorkerProcess& other : workers) {
+            if (other.connection) close(other.connection->fd);
+        }
+        _exit(worker_main(fds[1], frame));
+    }
+    close(fds[1]);
+    WorkerProcess& worker = workers[w];
+    worker.pid = pid;
+    worker.connection = make_shared<ServiceClient>(fds[0]);
+    worker.reader = make_shared<SocketReader>(fds[0]);
+    worker.assigned.clear();
+    if (worker.connection->send_line(job_line)) return true;
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+    worker.pid = -1;
+    worker.connection.reset();
+    worker.reader.reset();
+    return false;
+}
+
+// Function to stop all running workers, without waiting for their tiles
+void kill_workers(vector<WorkerProcess>& workers) {
+    for (WorkerProcess& worker : workers) {
+        if (worker.pid < 0) continue;
+        kill(worker.pid, SIGKILL);
+        waitpid(worker.pid, nullptr, 0);
+        worker.pid = -1;
+        worker.connection.reset();
+    }
+}
+
+// Function to render job's frame on the given number of worker processes and write it to output
+int coordinate(int count, const string& output, const RenderJob& job) {
+    auto start = chrono::steady_clock::now();
+    size_t frame_bytes = size_t(job.width) * job.height * 3;
+    uint8_t* frame = (uint8_t*)mmap(nullptr, frame_bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (frame == MAP_FAILED) {
+        cerr << "Cannot map the frame: " << strerror(errno) << "\n";
+        return 1;
+    }
+    vector<TileRect> tiles = split_tiles(job.region, SERVICE_TILE_SIZE);
+    deque<int> pending;
+    for (int t = 0; t < int(tiles.size()); t++) pending.push_back(t);
+    vector<int> attempts(tiles.size(), 0);
+    int finished = 0, failures = 0;
+
+    string job_line = format_job(job);
+    vector<WorkerProcess> workers(count);
+    for (int w = 0; w < count; w++) {
+        if (!start_worker(workers, w, job_line, frame)) {
+            cerr << "Cannot start worker " << w << ": " << strerror(errno) << "\n";
+            kill_workers(workers);
+            return 1;
+        }
+    }
+    fprintf(stderr, "%d workers, %zu tiles of %d pixels\n", count, tiles.size(), SERVICE_TILE_SIZE);
+
+    vector<pollfd> fds;
+    vector<int> polled;
+    string line;
+    while (finished < int(tiles.size())) {
+        // Top every running worker up to TILES_AHEAD tiles and kill the ones that have hung on a tile
+        fds.clear();
+        polled.clear();
+        auto now = chrono::steady_clock::now();
+        double wait_seconds = -1;
+        for (int w = 0; w < count; w++) {
+            WorkerProcess& worker = workers[w];
+            if (worker.pid < 0) continue;
+            if (worker.assigned.empty()) worker.progress = now;
+            while (int(worker.assigned.size()) < TILES_AHEAD && !pending.empty()) {
+                int t = pending.front();
+                pending.pop_front();
+                attempts[t]++;
+                worker.assigned.push_back(t);
+                const TileRect& r = tiles[t];
+                worker.connection->send_line("tile " + to_string(t) + " " + to_string(r.x0) + " " + to_string(r.y0) +
+                                             " " + to_string(r.x1) + " " + to_string(r.y1));
+            }
+            fds.push_back({worker.connection->fd, POLLIN, 0});
+            polled.push_back(w);
+            if (worker.assigned.empty()) continue;
+            double left = TILE_TIMEOUT_SECONDS - chrono::duration<double>(now - worker.progress).count();
+            if (left <= 0) {
+                // Once it is dead its socket reads as closed and it is handled like any other failed worker
+                fprintf(stderr, "worker %d (pid %d) hung on tile %d\n", w, int(worker.pid), worker.assigned.front());
+                kill(worker.pid, SIGKILL);
+            } else if (wait_seconds < 0 || left < wait_seconds) {
+                wait_seconds = left;
+            }
+        }
+        if (fds.empty()) {
+            cerr << "All workers failed\n";
+            return 1;
+        }
+        int timeout_ms = wait_seconds < 0 ? -1 : int(ceil(wait_seconds * 1000));
+        if (poll(fds.data(), fds.size(), timeout_ms) < 0) {
+            if (errno == EINTR) continue;
+            cerr << "poll failed: " << strerror(errno) << "\n";
+            kill_workers(workers);
+            return 1;
+        }
+
+        for (size_t p = 0; p < fds.size(); p++) {
+            if (!fds[p].revents) continue;
+            int w = polled[p];
+            WorkerProcess& worker = workers[w];
+            bool open = worker.reader->fill();
+            while (worker.reader->buffered_line(line)) {
+                istringstream in(line);
+                string kind;
+                int t;
+                unsigned long long rays;
+                double ms;
+                in >> kind;
+                if (kind == "done" && in >> t >> rays >> ms) {
+                    auto it = find(worker.assigned.begin(), worker.assigned.end(), t);
+                    if (it == worker.assigned.end()) continue;
+                    worker.assigned.erase(it);
+                    worker.progress = chrono::steady_clock::now();
+                    worker.tiles++;
+                    worker.rays += rays;
+                    worker.busy_ms += ms;
+                    finished++;
+                } else {
+                    cerr << "worker " << w << ": " << line << "\n";
+                    kill_workers(workers);
+                    return 1;
+                }
+            }
+            if (open) continue;
+
+            // The worker died: its unfinished tiles go back to the front of the queue and it is started again
+            int status = 0;
+            waitpid(worker.pid, &status, 0);
+            failures++;
+            bool signaled = WIFSIGNALED(status);
+            fprintf(stderr, "worker %d (pid %d) %s %d with %zu tiles unfinished\n", w, int(worker.pid),
+                    signaled ? "killed by signal" : "exited with", signaled ? WTERMSIG(status) : WEXITSTATUS(status),
+                    worker.assigned.size());
+            worker.pid = -1;
+            worker.connection.reset();
+            for (auto it = worker.assigned.rbegin(); it != worker.assigned.rend(); ++it) {
+                if (attempts[*it] >= MAX_TILE_ATTEMPTS) {
+                    fprintf(stderr, "tile %d failed %d times\n", *it, attempts[*it]);
+                    kill_workers(workers);
+                    return 1;
+                }
+                pending.push_front(*it);
+            }
+            worker.assigned.clear();
+            if (worker.restarts < MAX_WORKER_RESTARTS) {
+                worker.restarts++;
+                if (!start_worker(workers, w, job_line, frame)) fprintf(stderr, "cannot restart worker %d\n", w);
+            }
+        }
+    }
+
+    // Closing the sockets ends the workers
+    uint64_t rays = 0;
+    for (WorkerProcess& worker : workers) {
+        rays += worker.rays;
+        worker.connection.reset();
+        if (worker.pid >= 0) waitpid(worker.pid, nullptr, 0);
+    }
+    double seconds = seconds_since(start);
+    vector<uint8_t> image(frame, frame + frame_bytes);
+    munmap(frame, frame_bytes);
+    for (int w = 0; w < count; w++) {
+        const WorkerProcess& worker = workers[w];
+        printf("worker %d: %4d tiles, %8.1f ms rendering, %.2f Mrays, %d restarts\n", w, worker.tiles,
+               worker.busy_ms, worker.rays * 1e-6, worker.restarts);
+    }
+    printf("%zu tiles in %.1f ms, %d worker failures, %.2f Mrays/s\n", tiles.size(), seconds * 1000, failures,
+           rays / seconds * 1e-6);
+    if (!write_ppm_rgb(job.width, job.height, image, output)) {
+        cerr << "Cannot write " << output << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    signal(SIGPIPE, SIG_IGN);
+    if (argc != 17) {
+        cerr << "Usage: render_distributed <workers, 0 for one per core> <output PPM> <scene file> <from x y z> "
+                "<at x y z> <up x y z> <vfov> <width> <height> <spp>\n";
+        return 2;
+    }
+    int count = atoi(argv[1]);
+    if (count <= 0) count = worker_count();
+    // The job line is the arguments after the output file, for the whole image
+    string line = "render frame";
+    for (int a = 3; a < argc; a++) line += string(" ") + argv[a];
+    line += " 0 0 " + string(argv[14]) + " " + string(argv[15]);
+    RenderJob job;
+    string error;
+    if (!parse_job(line, job, error)) {
+        cerr << "Bad job: " << error << "\n";
+        return 2;
+    }
+    return coordinate(count, argv[2], job);
+}
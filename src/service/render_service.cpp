@@ -0,0 +1,236 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <thread>
+#include <chrono>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <csignal>
+#include <sys/socket.h>
+#include "vec3.h"
+#include "Image.h"
+#include "Parallel.h"
+#include "RenderService.h"
+#include "bench/BenchUtil.h"
+using namespace std;
+
+// Local render service. "serve" keeps the scene files it is asked for loaded, with their BVHs, and renders the jobs
+// of any number of local clients on one set of worker threads, streaming every tile back as it completes (protocol
+// in RenderService.h). Finished tiles are cached, in memory and in the cache directory if one is given, so tiles
+// that were rendered before with the same scene file contents, camera and settings are sent without rendering them
+// again. "render" is a client: it submits one job and writes the tiles it gets back to a PPM. "stats" prints the
+// service's tile cache counts.
+// Usage: render_service serve <socket path> [threads, 0 for one per core] [cache directory]
+//        render_service render <socket path> <output PPM> <scene file> <from x y z> <at x y z> <up x y z> <vfov>
+//                              <width> <height> <spp> [x0 y0 x1 y1]
+//        render_service stats <socket path>
+
+// Function to render tiles from the queue until it shuts down
+void service_worker(TileQueue& queue) {
+    CameraRays rays;
+    vector<vec3> row;
+    vector<uint8_t> rgb;
+    shared_ptr<ActiveJob> job;
+    int tile;
+    while (queue.next(job, tile)) {
+        RayCounters counters = render_tile(*job->scene, job->camera, job->settings, job->tiles[tile], rays, row, rgb);
+        job->rays += counters.rays + counters.shadow_rays;
+        if (job->cache) job->cache->store(job->keys[tile], rgb);
+        if (!job->client->send_tile(job->job.id, job->tiles[tile], rgb)) continue;
+        if (--job->remaining == 0) send_job_done(*job);
+    }
+}
+
+// Function to format the tile cache's counts as the reply to "stats"
+string format_stats(const TileCacheStats& stats) {
+    char line[256];
+    snprintf(line, sizeof(line), "stats %llu %llu %llu %.4f %llu %llu", (unsigned long long)stats.lookups,
+             (unsigned long long)stats.memory_hits, (unsigned long long)stats.disk_hits, stats.hit_rate(),
+             (unsigned long long)stats.bytes_saved, (unsigned long long)stats.memory_bytes);
+    return line;
+}
+
+// Function to read a client's jobs and queue them until it stops sending
+void serve_client(shared_ptr<ServiceClient> client, SceneCache& cache, TileCache& tiles, TileQueue& queue) {
+    SocketReader reader(client->fd);
+    string line;
+    while (reader.read_line(line)) {
+        if (line.empty()) continue;
+        if (line == "stats") {
+            client->send_line(format_stats(tiles.get_stats()));
+            continue;
+        }
+        RenderJob job;
+        string error;
+        if (!parse_job(line, job, error)) {
+            client->send_line("error " + (job.id.empty() ? string("-") : job.id) + " " + error);
+            continue;
+        }
+        CachedScene scene;
+        if (!cache.get(job.scene_path, scene, error)) {
+            client->send_line("error " + job.id + " " + error);
+            continue;
+        }
+        shared_ptr<ActiveJob> active = make_active_job(job, scene, client, &tiles);
+        TileCacheStats stats = tiles.get_stats();
+        fprintf(stderr, "job %s: %s, %dx%d region of %dx%d, %d spp, %zu tiles to render, %d cached "
+                "(hit rate %.1f%%, %.1f MB saved)\n", job.id.c_str(), job.scene_path.c_str(),
+                job.region.x1 - job.region.x0, job.region.y1 - job.region.y0, job.width, job.height, job.spp,
+                active->tiles.size(), active->cached_tiles, stats.hit_rate() * 100, stats.bytes_saved / 1e6);
+        if (active->tiles.empty()) {
+            send_job_done(*active);
+        } else {
+            queue.submit(active);
+        }
+    }
+}
+
+int serve(const string& path, int threads, const string& cache_directory) {
+    int listener = listen_unix(path);
+    if (listener < 0) {
+        cerr << "Cannot listen on " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    if (!cache_directory.empty() && mkdir(cache_directory.c_str(), 0755) != 0 && errno != EEXIST) {
+        cerr << "Cannot create " << cache_directory << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    SceneCache cache;
+    TileCache tiles(size_t(256) << 20, cache_directory);
+    TileQueue queue;
+    vector<thread> workers;
+    for (int w = 0; w < threads; w++) workers.emplace_back(service_worker, ref(queue));
+    fprintf(stderr, "serving on %s with %d worker threads, tile cache %s\n", path.c_str(), threads,
+            cache_directory.empty() ? "in memory" : cache_directory.c_str());
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            cerr << "accept failed: " << strerror(errno) << "\n";
+            break;
+        }
+        thread(serve_client, make_shared<ServiceClient>(fd), ref(cache), ref(tiles), ref(queue)).detach();
+    }
+    queue.shutdown();
+    for (auto& t : workers) t.join();
+    close(listener);
+    return 1;
+}
+
+// Function to submit one job and assemble the tiles of its region into an image
+int render(const string& path, const string& output, const RenderJob& job) {
+    auto start = chrono::steady_clock::now();
+    int fd = connect_unix(path);
+    if (fd < 0) {
+        cerr << "Cannot connect to " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    ServiceClient connection(fd);
+    if (!connection.send_line(format_job(job))) {
+        cerr << "Cannot send the job\n";
+        return 1;
+    }
+    shutdown(fd, SHUT_WR);
+
+    const TileRect& region = job.region;
+    int width = region.x1 - region.x0, height = region.y1 - region.y0;
+    vector<uint8_t> image(size_t(width) * height * 3, 0);
+    vector<uint8_t> rgb;
+    SocketReader reader(fd);
+    string line;
+    int tiles = 0;
+    double first_tile = 0;
+    while (reader.read_line(line)) {
+        istringstream in(line);
+        string kind, id;
+        in >> kind >> id;
+        if (kind == "tile") {
+            int x, y, w, h;
+            if (!(in >> x >> y >> w >> h) || x < region.x0 || y < region.y0 || x + w > region.x1 || y + h > region.y1) {
+                cerr << "Bad tile: " << line << "\n";
+                return 1;
+            }
+            rgb.resize(size_t(w) * h * 3);
+            if (!reader.read_bytes((char*)rgb.data(), rgb.size())) break;
+            for (int r = 0; r < h; r++) {
+                size_t offset = (size_t(y - region.y0 + r) * width + (x - region.x0)) * 3;
+                memcpy(&image[offset], &rgb[size_t(r) * w * 3], size_t(w) * 3);
+            }
+            if (tiles++ == 0) first_tile = seconds_since(start);
+        } else if (kind == "done") {
+            unsigned long long rays;
+            double ms;
+            int cached = 0;
+            in >> rays >> ms >> cached;
+            printf("%d tiles (%d cached), first after %.1f ms, all after %.1f ms (%.1f ms in the service), "
+                   "%.2f Mrays/s\n", tiles, cached, first_tile * 1000, seconds_since(start) * 1000, ms,
+                   rays / ms * 1e-3);
+            if (!write_ppm_rgb(width, height, image, output)) {
+                cerr << "Cannot write " << output << "\n";
+                return 1;
+            }
+            return 0;
+        } else {
+            cerr << line << "\n";
+            return 1;
+        }
+    }
+    cerr << "The service closed the connection\n";
+    return 1;
+}
+
+// Function to ask the service for its tile cache counts
+int print_stats(const string& path) {
+    int fd = connect_unix(path);
+    if (fd < 0) {
+        cerr << "Cannot connect to " << path << ": " << strerror(errno) << "\n";
+        return 1;
+    }
+    ServiceClient connection(fd);
+    if (!connection.send_line("stats")) return 1;
+    shutdown(fd, SHUT_WR);
+    SocketReader reader(fd);
+    string line, kind;
+    unsigned long long lookups, memory_hits, disk_hits, bytes_saved, memory_bytes;
+    double hit_rate;
+    if (!reader.read_line(line)) return 1;
+    istringstream in(line);
+    if (!(in >> kind >> lookups >> memory_hits >> disk_hits >> hit_rate >> bytes_saved >> memory_bytes) ||
+        kind != "stats") {
+        cerr << line << "\n";
+        return 1;
+    }
+    printf("%llu tile lookups, %llu memory hits, %llu disk hits, hit rate %.1f%%, %.2f MB saved, %.2f MB in memory\n",
+           lookups, memory_hits, disk_hits, hit_rate * 100, bytes_saved / 1e6, memory_bytes / 1e6);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    signal(SIGPIPE, SIG_IGN);
+    string mode = argc > 1 ? argv[1] : "";
+    if (mode == "serve" && argc > 2) {
+        int threads = argc > 3 ? atoi(argv[3]) : 0;
+        if (threads <= 0) threads = worker_count();
+        return serve(argv[2], threads, argc > 4 ? argv[4] : "");
+    }
+    if (mode == "stats" && argc > 2) return print_stats(argv[2]);
+    if (mode == "render" && argc > 4) {
+        // The job line is the arguments after the output file, a missing region is the whole image
+        string line = "render job";
+        for (int a = 4; a < argc; a++) line += string(" ") + argv[a];
+        if (argc == 18) line += " 0 0 " + string(argv[15]) + " " + string(argv[16]);
+        RenderJob job;
+        string error;
+        if (!parse_job(line, job, error)) {
+            cerr << "Bad job: " << error << "\n";
+            return 2;
+        }
+        return render(argv[2], argv[3], job);
+    }
+    cerr << "Usage: render_service serve <socket path> [threads, 0 for one per core] [cache directory]\n"
+            "       render_service render <socket path> <output PPM> <scene file> <from x y z> <at x y z> "
+            "<up x y z> <vfov> <width> <height> <spp> [x0 y0 x1 y1]\n"
+            "       render_service stats <socket path>\n";
+    return 2;
+}
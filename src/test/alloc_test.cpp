@@ -0,0 +1,105 @@
+#include <iostream>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <cstdio>
+#include <cstdint>
+#include "vec3.h"
+#include "Scene.h"
+#include "Material.h"
+#include "Camera.h"
+#include "Image.h"
+#include "Random.h"
+#include "Trace.h"
+#include "RenderContext.h"
+using namespace std;
+
+// Allocation test of RenderContext: after a warm-up frame, rendering more frames of the same size must not touch
+// the heap on any thread. Global operator new is replaced to count allocations. The frames must also be those
+// render_recursive gives for the same scene and settings.
+// Usage: alloc_test
+
+atomic<long> allocations(0);
+
+void* operator new(size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+void* operator new[](size_t size) {
+    allocations++;
+    void* p = malloc(size ? size : 1);
+    if (!p) throw bad_alloc();
+    return p;
+}
+
+// Function to free what the replaced operator new allocated. The deletes go through it rather than calling free
+// themselves, which GCC takes for a delete mismatched with its new (-Wmismatched-new-delete); it must stay out of
+// line for that, inlined the free is seen again.
+__attribute__((noinline)) static void release(void* p) { free(p); }
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+
+// Spheres and a triangle BVH on a plane, a cube, a mirror and two lights: every intersection path and diffuse
+// bounces with Russian roulette
+Scene make_test_scene() {
+    Scene scene;
+    Rng rng(3);
+    for (int i = 0; i < 40; i++) {
+        scene.spheres.push_back({vec3(4 * rng.next() - 2, 0.2f * rng.next(), -1 - 3 * rng.next()), 0.1f + 0.2f * rng.next()});
+    }
+    for (int i = 0; i < 200; i++) {
+        vec3 c(4 * rng.next() - 2, rng.next(), -2 - 3 * rng.next());
+        scene.triangles.push_back({c, c + vec3(0.2f, 0, 0), c + vec3(0, 0.2f, 0.1f)});
+    }
+    scene.cubes = {{vec3(-1, 0, -1.5), 0.5f}};
+    scene.planes = {{vec3(0, -0.5, -1), vec3(0, 1, 0)}};
+    scene.lights = {{vec3(-1, 2, 0), vec3(1, 0.8f, 0.6f)}, {vec3(2, 1, -1), vec3(0.4f, 0.6f, 1)}};
+    Material mirror;
+    mirror.type = MAT_MIRROR;
+    set_material(scene, PRIM_CUBE, 0, scene.materials.add(mirror));
+    return scene;
+}
+
+int main() {
+    const int width = 96, height = 64, frames = 10;
+    Scene scene = make_test_scene();
+    Camera camera = look_at_camera(vec3(0, 0.5f, 1), vec3(0, 0, -2), vec3(0, 1, 0), 60.0f, width, height);
+    TraceSettings settings;
+    settings.samples_per_pixel = 2;
+    settings.max_depth = 4;
+
+    RenderContext context(scene, width, height, 4);  // A pool with workers even on one core
+    vector<uint8_t> image(size_t(width) * height * 3);
+    context.render(camera, settings, image.data());  // Warm-up, sizes the ray batches
+
+    int failures = 0;
+    long before = allocations.load();
+    uint64_t rays = 0;
+    for (int f = 0; f < frames; f++) {
+        settings.seed = uint64_t(f);
+        rays += context.render(camera, settings, image.data()).rays;
+    }
+    long steady = allocations.load() - before;
+    printf("%s %d frames, %d threads, %llu rays: %ld allocations\n", steady == 0 ? "ok  " : "FAIL", frames,
+           context.pool.size(), (unsigned long long)rays, steady);
+    if (steady != 0) failures++;
+
+    // Same frame as render_recursive
+    Framebuffer reference(width, height);
+    build_scene_bvh(scene);
+    render_recursive(scene, camera, settings, reference);
+    int differing = 0;
+    for (size_t p = 0; p < reference.pixels.size(); p++) {
+        for (int c = 0; c < 3; c++) differing += image[3 * p + c] != uint8_t(to_byte(reference.pixels[p][c]));
+    }
+    printf("%s last frame against render_recursive: %d channels differ\n", differing == 0 ? "ok  " : "FAIL", differing);
+    if (differing) failures++;
+    return failures ? 1 : 0;
+}
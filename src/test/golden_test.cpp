@@ -0,0 +1,167 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <algorithm>
+#include "vec3.h"
+#include "Image.h"
+#include "ShadingModes.h"
+using namespace std;
+
+// Golden image regression test. Renders the shading variants of ShadingModes.h (the first homework's programs) and
+// compares them with the reference images those programs rendered, checked in under src/hw1/ppm: PSNR, the largest
+// channel error and the number of pixels off by more than a per-pixel tolerance. Where the engine legitimately
+// differs from the homework code (edge pixels of the watertight triangle test) or a reference does not show its
+// program's scene, the case names those pixels; anything else beyond the limits fails the test.
+// Usage: golden_test <reference directory> [output directory for the renders and difference images]
+
+// Pixel rectangle [x0, x1) x [y0, y1), rows counted from the top as in the PPM files
+struct PixelRect {
+    int x0, y0, x1, y1;
+};
+
+// Pixel segment from (x0, y0) to (x1, y1), rows counted from the top
+struct PixelSegment {
+    float x0, y0, x1, y1;
+};
+
+// Define a golden case: the variant to render and how close it must come to the reference
+struct GoldenCase {
+    string name;
+    string reference;  // File name in the reference directory, which also gives the image size
+    ShadingVariant variant;
+    double min_psnr = 40.0;       // dB over 8-bit channels
+    int max_error = 16;           // Largest error of any channel
+    int pixel_tolerance = 2;      // Channel error a pixel may have and still count as matching
+    double max_bad_pixels = 0.0;  // Fraction of pixels allowed beyond pixel_tolerance
+    vector<PixelRect> ignore;     // Where the reference is known not to show the scene its program describes
+    vector<PixelSegment> edges;   // Edges whose pixels may take the color of either side, which max_error leaves
+                                  // out; they still count against max_bad_pixels
+};
+
+struct GoldenResult {
+    double psnr = 0;
+    int max_error = 0;
+    double bad_pixels = 0;  // Fraction beyond the tolerance
+};
+
+// Function to tell whether pixel (x, y) lies within one pixel of the segment
+bool near_segment(const PixelSegment& s, int x, int y) {
+    float dx = s.x1 - s.x0, dy = s.y1 - s.y0;
+    float k = ((x - s.x0) * dx + (y - s.y0) * dy) / (dx * dx + dy * dy);
+    k = k < 0 ? 0 : (k > 1 ? 1 : k);
+    float ex = s.x0 + k * dx - x, ey = s.y0 + k * dy - y;
+    return ex * ex + ey * ey <= 1.0f;
+}
+
+GoldenResult compare(const GoldenCase& gc, const Framebuffer& fb, const vector<uint8_t>& reference, Framebuffer& diff) {
+    GoldenResult res;
+    double sum = 0;
+    size_t bad = 0, compared = 0;
+    for (size_t p = 0; p < fb.pixels.size(); p++) {
+        int x = int(p % fb.width), y = int(p / fb.width);
+        bool ignored = false;
+        for (const PixelRect& rect : gc.ignore) {
+            ignored = ignored || (x >= rect.x0 && x < rect.x1 && y >= rect.y0 && y < rect.y1);
+        }
+        if (ignored) {
+            diff.pixels[p] = vec3(0, 0, 0.5f);
+            continue;
+        }
+        compared++;
+        int worst = 0;
+        for (int c = 0; c < 3; c++) {
+            int e = abs(to_byte(fb.pixels[p][c]) - int(reference[3 * p + c]));
+            sum += double(e) * e;
+            worst = max(worst, e);
+        }
+        bool edge = false;
+        for (const PixelSegment& s : gc.edges) edge = edge || near_segment(s, x, y);
+        if (!edge) res.max_error = max(res.max_error, worst);
+        if (worst > gc.pixel_tolerance) bad++;
+        diff.pixels[p] = vec3(1, 1, 1) * (worst / 255.0f);
+    }
+    double mse = sum / (3.0 * compared);
+    res.psnr = mse > 0 ? 10.0 * log10(255.0 * 255.0 / mse) : INFINITY;
+    res.bad_pixels = double(bad) / compared;
+    return res;
+}
+
+GoldenCase make_case(const vector<ShadingVariant>& variants, const string& mode, const string& reference) {
+    GoldenCase gc;
+    gc.name = mode;
+    gc.reference = reference;
+    find_shading_variant(variants, mode, gc.variant);
+    return gc;
+}
+
+vector<GoldenCase> make_golden_cases() {
+    vector<ShadingVariant> variants = make_shading_variants();
+    vector<GoldenCase> cases;
+
+    cases.push_back(make_case(variants, "dusk", "dusk.ppm"));
+    cases.push_back(make_case(variants, "skybox", "skybox.ppm"));
+
+    cases.push_back(make_case(variants, "normal", "normal.ppm"));
+
+    // The shading program with its light at each of the three positions it was rendered with
+    const vec3 positions[3] = {vec3(1, 1, 0), vec3(-1, 1, 0), vec3(0, 0, 0)};
+    const char* references[3] = {"shadingLightSource(1,1,0).ppm", "shadingLightSource(-1,1,0).ppm",
+                                 "shadingLightSource(0,0,0).ppm"};
+    for (int k = 0; k < 3; k++) {
+        GoldenCase gc = make_case(variants, "shading", references[k]);
+        gc.name = string("shading ") + references[k];
+        gc.variant.scene.lights[0].position = positions[k];
+        cases.push_back(gc);
+    }
+
+    cases.push_back(make_case(variants, "colorful", "colorfulLight.ppm"));
+    cases.push_back(make_case(variants, "plane", "rayinstersection.ppm"));
+
+    // The reference of the multiple program was rendered with a larger box than the program's cube (0.75 wide and
+    // deep). Their front faces coincide; the strip the larger box adds on the left and the side face, which it moves,
+    // are left out. The watertight triangle test decides about twenty pixels along the triangle's left edge the
+    // other way.
+    GoldenCase gc = make_case(variants, "multiple", "multiple.ppm");
+    gc.ignore = {{100, 149, 151, 250}, {250, 149, 315, 250}};
+    gc.edges = {{600, 149, 700, 249}};
+    gc.max_bad_pixels = 0.0001;
+    cases.push_back(gc);
+    return cases;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2) {
+        cerr << "Usage: golden_test <reference directory> [output directory]\n";
+        return 2;
+    }
+    string reference_dir = string(argv[1]) + "/";
+    string output_dir = argc > 2 ? string(argv[2]) + "/" : "";
+
+    int failures = 0;
+    for (const GoldenCase& gc : make_golden_cases()) {
+        int width, height;
+        vector<uint8_t> reference;
+        if (!read_ppm(reference_dir + gc.reference, width, height, reference)) {
+            printf("FAIL %-38s cannot read %s\n", gc.name.c_str(), (reference_dir + gc.reference).c_str());
+            failures++;
+            continue;
+        }
+        Framebuffer fb(width, height), diff(width, height);
+        render_variant(gc.variant, fb);
+        GoldenResult res = compare(gc, fb, reference, diff);
+        bool pass = res.psnr >= gc.min_psnr && res.max_error <= gc.max_error && res.bad_pixels <= gc.max_bad_pixels;
+        printf("%s %-38s %dx%d  PSNR %6.2f dB (min %.1f)  max error %3d (max %3d)  beyond %d: %.4f%% (max %.4f%%)\n",
+               pass ? "ok  " : "FAIL", gc.name.c_str(), width, height, res.psnr, gc.min_psnr, res.max_error,
+               gc.max_error, gc.pixel_tolerance, 100.0 * res.bad_pixels, 100.0 * gc.max_bad_pixels);
+        if (!pass) failures++;
+        if (!output_dir.empty()) {
+            write_ppm(fb, output_dir + gc.reference);
+            write_ppm(diff, output_dir + "diff_" + gc.reference);
+        }
+    }
+    if (failures) printf("%d golden image(s) differ\n", failures);
+    return failures ? 1 : 0;
+}